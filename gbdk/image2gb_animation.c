@@ -0,0 +1,85 @@
+/**
+ * @file  image2gb_animation.c
+ * @brief Player for the animations exported by Image2GB, for use with GBDK-2020 - implementation.
+ */
+
+#include "image2gb_animation.h"
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_ANIMATION_LOAD_MAX 128U /**< Most tiles loaded by a single set_bkg_data() call. */
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Loads the tiles a frame adds (given its entry of the frames table), from
+ *  first_tile on, base being the first tile of the animation.
+ */
+static void load_tiles(const uint8_t* data, const uint8_t* entry, uint8_t base)
+{
+	uint8_t first_tile = entry[0];
+	uint16_t tiles = entry[1] | ((uint16_t) entry[2] << 8);
+	uint8_t chunk;
+
+	// Tiles are stored in order of appearance, so the data of this frame is
+	// right after the one of the frames before.
+	data += (uint16_t) (uint8_t) (first_tile - base) << 4;
+
+	while (tiles != 0U)
+	{
+		chunk = (tiles > IMAGE2GB_ANIMATION_LOAD_MAX) ? IMAGE2GB_ANIMATION_LOAD_MAX : (uint8_t) tiles;
+
+		// set_bkg_data() follows LCDC bit 4, like the tile base does.
+		set_bkg_data(first_tile, chunk, data);
+
+		first_tile += chunk;
+		data += (uint16_t) chunk << 4;
+		tiles -= chunk;
+	}
+}
+
+void image2gb_animation_start(image2gb_animation_t* animation, uint8_t x, uint8_t y, uint8_t w, uint8_t h,
+                              const uint8_t* data, const uint8_t* map, const uint8_t* frames, const uint8_t* deltas, uint8_t count)
+{
+	animation->data = data;
+	animation->frames = frames;
+	animation->deltas = deltas;
+	animation->x = x;
+	animation->y = y;
+	animation->count = count;
+	animation->frame = 0U;
+	animation->loaded = (count == 1U);
+
+	// The first frame starts at the tile base.
+	load_tiles(data, frames, frames[0]);
+	set_bkg_tiles(x, y, w, h, map);
+
+	// The changes of the first frame are for looping back to it.
+	animation->next = deltas + (frames[3] | ((uint16_t) frames[4] << 8)) * IMAGE2GB_ANIMATION_DELTA_SIZE;
+}
+
+uint8_t image2gb_animation_next(image2gb_animation_t* animation)
+{
+	const uint8_t* entry;
+	uint16_t cells;
+
+	if (++animation->frame == animation->count)
+	{
+		animation->frame = 0U;
+		animation->next = animation->deltas;
+		animation->loaded = 1U;
+	}
+
+	entry = animation->frames + (uint16_t) animation->frame * IMAGE2GB_ANIMATION_FRAME_SIZE;
+
+	if (!animation->loaded)
+		load_tiles(animation->data, entry, animation->frames[0]);
+
+	for (cells = entry[3] | ((uint16_t) entry[4] << 8); cells != 0U; cells--)
+	{
+		set_bkg_tile_xy((animation->x + animation->next[0]) & 31U, (animation->y + animation->next[1]) & 31U, animation->next[2]);
+
+		animation->next += IMAGE2GB_ANIMATION_DELTA_SIZE;
+	}
+
+	return animation->frame;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file  image2gb_animation.h
+ * @brief Player for the animations exported by Image2GB, for use with GBDK-2020 - header.
+ *
+ * Copy this file and image2gb_animation.c to your project. All frames of an
+ * animation share a single tileset, and every frame only loads the tiles it
+ * adds and redraws the map cells it changes, instead of the whole background,
+ * for example:
+ *
+ *     image2gb_animation_t animation;
+ *
+ *     image2gb_animation_start(& animation, 0U, 0U, GAME_BACKGROUNDS_NAME_SIZE_X, GAME_BACKGROUNDS_NAME_SIZE_Y,
+ *                              BackgroundDataName, BackgroundMapName, AnimationFramesName, AnimationDeltasName,
+ *                              GAME_BACKGROUNDS_NAME_FRAMES);
+ *
+ *     while (1)
+ *     {
+ *         vsync();
+ *         image2gb_animation_next(& animation);
+ *         // Game logic...
+ *     }
+ *
+ * Call image2gb_animation_next() right after vsync() (or from a VBlank
+ * interrupt handler), so the changes are made while VRAM is free. The first
+ * time through, a frame also loads its new tiles (up to
+ * GAME_BACKGROUNDS_NAME_FRAME_TILES_MAX), so it can take longer than a VBlank;
+ * after that, only GAME_BACKGROUNDS_NAME_FRAME_CELLS_MAX map cells at most.
+ * The data must be in the current ROM bank.
+ */
+
+#pragma once
+
+#include <gb/gb.h>
+#include <stdint.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_ANIMATION_FRAME_SIZE 5U /**< Bytes of every entry of the frames table (first tile, tiles low, tiles high, cells low, cells high). */
+#define IMAGE2GB_ANIMATION_DELTA_SIZE 3U /**< Bytes of every changed map cell (column, row, tile). */
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** State of an animation being played.
+ */
+typedef struct image2gb_animation_t
+{
+	const uint8_t* data; /**< Tile data of all frames. */
+	const uint8_t* frames; /**< Frames table. */
+	const uint8_t* deltas; /**< Changed map cells of all frames. */
+	const uint8_t* next; /**< Changed map cells of the next frame. */
+	uint8_t x; /**< Column of the background map the animation is drawn at. */
+	uint8_t y; /**< Row of the background map the animation is drawn at. */
+	uint8_t count; /**< Number of frames. */
+	uint8_t frame; /**< Frame on screen. */
+	uint8_t loaded; /**< Whether all tiles are in VRAM already (after the first loop). */
+} image2gb_animation_t;
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Starts the animation of the given number of frames at the given position
+ *  of the background map, in tiles (w x h being its size): loads the tiles of
+ *  the first frame and draws it. Better done with the display off, like
+ *  loading any background.
+ */
+void image2gb_animation_start(image2gb_animation_t* animation, uint8_t x, uint8_t y, uint8_t w, uint8_t h,
+                              const uint8_t* data, const uint8_t* map, const uint8_t* frames, const uint8_t* deltas, uint8_t count);
+
+/** Moves on to the next frame (back to the first one after the last), loading
+ *  its new tiles if needed and redrawing the map cells it changes. Returns the
+ *  frame now on screen.
+ */
+uint8_t image2gb_animation_next(image2gb_animation_t* animation);
@@ -0,0 +1,242 @@
+/**
+ * @file  image2gb_decompress.c
+ * @brief Decompressors for the assets exported by Image2GB with compression, for use with GBDK-2020 - implementation.
+ *
+ * The data is a list of blocks, each starting with a control byte C:
+ *   - 0x00: end of the data.
+ *   - 0x01 to 0x7F: C literal bytes follow.
+ *   - RLE, 0x81 to 0xFF: one byte follows, repeated (C & 0x7F) times.
+ *   - LZ, 0x80 to 0xBF: one byte D follows, copy (C & 0x3F) + 3 bytes from D + 1
+ *     bytes back in the output.
+ *   - LZ, 0xC0 to 0xFF: two bytes D follow (little-endian), copy (C & 0x3F) + 4
+ *     bytes from D + 1 bytes back in the output.
+ * Copies read the output back, so when it is in VRAM they read VRAM too.
+ */
+
+#include "image2gb_decompress.h"
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_TARGET_RAM   0U /**< The output goes to RAM, one byte after another. */
+#define IMAGE2GB_TARGET_TILES 1U /**< The output goes to the background tiles in VRAM. */
+#define IMAGE2GB_TARGET_MAP   2U /**< The output goes to an area of the background map in VRAM. */
+
+#define IMAGE2GB_VRAM_TILES_END  ((uint8_t*) 0x9800U) /**< End of the tile data in VRAM. */
+#define IMAGE2GB_VRAM_TILES_WRAP ((uint8_t*) 0x8800U) /**< Where the tile data continues after tile 127 of the 0x9000 block. */
+#define IMAGE2GB_VRAM_MAP_SIZE   0x400U               /**< Size of a background map in bytes (32x32 tiles). */
+
+// VARIABLES ///////////////////////////////////////////////////////////////////
+
+// State of the current decompression (static, faster than locals with SDCC).
+
+static uint8_t target; /**< Where the output goes (IMAGE2GB_TARGET_*). */
+static uint16_t written; /**< Bytes written so far. */
+static uint8_t wrapped; /**< Tiles: whether the output went from 0x97FF on to 0x8800. */
+static uint8_t* map_start; /**< Map: first byte of the background map. */
+static uint8_t area_x; /**< Map: first column of the area, in tiles. */
+static uint8_t area_w; /**< Map: width of the area, in tiles. */
+
+static uint8_t* out; /**< Where the next byte is written. */
+static uint8_t* out_row; /**< Map: column 0 of the map row being written. */
+static uint8_t out_col; /**< Map: column of the area being written. */
+
+static uint8_t* from; /**< Where the next byte of a copy is read. */
+static uint8_t* from_row; /**< Map: column 0 of the map row being read. */
+static uint8_t from_col; /**< Map: column of the area being read. */
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Writes a byte to the output and moves on to the next one.
+ */
+static void put(uint8_t value)
+{
+	if (target != IMAGE2GB_TARGET_RAM)
+		while (STAT_REG & STATF_BUSY);
+
+	*out = value;
+	written++;
+
+	switch (target)
+	{
+		case IMAGE2GB_TARGET_TILES:
+			if (++out == IMAGE2GB_VRAM_TILES_END)
+			{
+				out = IMAGE2GB_VRAM_TILES_WRAP;
+				wrapped = 1U;
+			}
+			break;
+
+		case IMAGE2GB_TARGET_MAP:
+			if (++out_col == area_w)
+			{
+				out_col = 0U;
+				out_row += 32U;
+				if (out_row == map_start + IMAGE2GB_VRAM_MAP_SIZE)
+					out_row = map_start;
+			}
+			out = out_row + ((area_x + out_col) & 31U);
+			break;
+
+		default:
+			out++;
+	}
+}
+
+/** Reads a byte of the output back (for a copy) and moves on to the next one.
+ */
+static uint8_t take(void)
+{
+	uint8_t value;
+
+	if (target != IMAGE2GB_TARGET_RAM)
+		while (STAT_REG & STATF_BUSY);
+
+	value = *from;
+
+	switch (target)
+	{
+		case IMAGE2GB_TARGET_TILES:
+			if (++from == IMAGE2GB_VRAM_TILES_END)
+				from = IMAGE2GB_VRAM_TILES_WRAP;
+			break;
+
+		case IMAGE2GB_TARGET_MAP:
+			if (++from_col == area_w)
+			{
+				from_col = 0U;
+				from_row += 32U;
+				if (from_row == map_start + IMAGE2GB_VRAM_MAP_SIZE)
+					from_row = map_start;
+			}
+			from = from_row + ((area_x + from_col) & 31U);
+			break;
+
+		default:
+			from++;
+	}
+
+	return value;
+}
+
+/** Points the copy source to the given number of bytes back in the output.
+ */
+static void seek_back(uint16_t distance)
+{
+	uint16_t rows;
+	uint16_t col;
+
+	switch (target)
+	{
+		case IMAGE2GB_TARGET_TILES:
+			from = out - distance;
+			if (wrapped && (from < IMAGE2GB_VRAM_TILES_WRAP))
+				from += 0x1000U; // Back into the 0x9000 block.
+			break;
+
+		case IMAGE2GB_TARGET_MAP:
+			rows = distance / area_w;
+			col = out_col;
+			if ((distance % area_w) > col)
+			{
+				col += area_w;
+				rows++;
+			}
+			from_col = (uint8_t) (col - (distance % area_w));
+			from_row = map_start + ((uint16_t) ((uint16_t) (out_row - map_start) - (rows << 5)) & (IMAGE2GB_VRAM_MAP_SIZE - 1U));
+			from = from_row + ((area_x + from_col) & 31U);
+			break;
+
+		default:
+			from = out - distance;
+	}
+}
+
+/** Decompresses the data to the output set up by the caller.
+ */
+static void decode(const uint8_t* src, uint8_t compression)
+{
+	uint8_t control;
+	uint8_t count;
+	uint8_t value;
+	uint16_t distance;
+
+	written = 0U;
+
+	while ((control = *src++) != 0U)
+	{
+		if (!(control & 0x80U)) // Literal bytes.
+		{
+			count = control;
+			do
+				put(*src++);
+			while (--count);
+		}
+		else if (compression == IMAGE2GB_COMPRESSION_RLE) // Run of a byte.
+		{
+			count = control & 0x7FU;
+			value = *src++;
+			do
+				put(value);
+			while (--count);
+		}
+		else // Copy of earlier output.
+		{
+			if (control & 0x40U)
+			{
+				count = (control & 0x3FU) + 4U;
+				distance = src[0] | ((uint16_t) src[1] << 8);
+				src += 2;
+			}
+			else
+			{
+				count = (control & 0x3FU) + 3U;
+				distance = *src++;
+			}
+
+			seek_back(distance + 1U);
+			do
+				put(take());
+			while (--count);
+		}
+	}
+}
+
+uint16_t image2gb_decompress(uint8_t* dst, const uint8_t* src, uint8_t compression)
+{
+	target = IMAGE2GB_TARGET_RAM;
+	out = dst;
+
+	decode(src, compression);
+
+	return written;
+}
+
+void image2gb_decompress_bkg_data(uint8_t first_tile, const uint8_t* src, uint8_t compression)
+{
+	target = IMAGE2GB_TARGET_TILES;
+	wrapped = 0U;
+
+	// Same addressing as set_bkg_data(), which follows LCDC bit 4.
+	if (LCDC_REG & LCDCF_BG8000)
+		out = (uint8_t*) (0x8000U + ((uint16_t) first_tile << 4));
+	else if (first_tile & 0x80U)
+		out = (uint8_t*) (0x8800U + ((uint16_t) (first_tile & 0x7FU) << 4));
+	else
+		out = (uint8_t*) (0x9000U + ((uint16_t) first_tile << 4));
+
+	decode(src, compression);
+}
+
+void image2gb_decompress_bkg_tiles(uint8_t x, uint8_t y, uint8_t w, const uint8_t* src, uint8_t compression)
+{
+	target = IMAGE2GB_TARGET_MAP;
+	map_start = (LCDC_REG & LCDCF_BG9C00) ? (uint8_t*) 0x9C00U : (uint8_t*) 0x9800U;
+	area_x = x;
+	area_w = w;
+
+	out_col = 0U;
+	out_row = map_start + ((uint16_t) (y & 31U) << 5);
+	out = out_row + (x & 31U);
+
+	decode(src, compression);
+}
@@ -0,0 +1,44 @@
+/**
+ * @file  image2gb_decompress.h
+ * @brief Decompressors for the assets exported by Image2GB with compression, for use with GBDK-2020 - header.
+ *
+ * Copy this file and image2gb_decompress.c to your project. The data of an
+ * asset tells how it was compressed (GAME_BACKGROUNDS_NAME_COMPRESSION), for
+ * example:
+ *
+ *     image2gb_decompress_bkg_data(GAME_BACKGROUNDS_NAME_TILE_BASE, BackgroundDataName, GAME_BACKGROUNDS_NAME_COMPRESSION);
+ *     image2gb_decompress_bkg_tiles(0U, 0U, GAME_BACKGROUNDS_NAME_SIZE_X, BackgroundMapName, GAME_BACKGROUNDS_NAME_COMPRESSION);
+ */
+
+#pragma once
+
+#include <gb/gb.h>
+#include <stdint.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_COMPRESSION_NONE 0U /**< Raw bytes (not for these functions). */
+#define IMAGE2GB_COMPRESSION_RLE  1U /**< Literals and runs of a repeated byte. */
+#define IMAGE2GB_COMPRESSION_LZ   2U /**< Literals and copies of earlier output. */
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Decompresses the data into RAM, at dst. Returns the number of bytes
+ *  written.
+ */
+uint16_t image2gb_decompress(uint8_t* dst, const uint8_t* src, uint8_t compression);
+
+/** Decompresses tile data straight into the background tiles in VRAM, from
+ *  the given tile on (like set_bkg_data()). It works with the display on, but
+ *  it is faster with it off.
+ */
+void image2gb_decompress_bkg_data(uint8_t first_tile, const uint8_t* src, uint8_t compression);
+
+/** Decompresses a tilemap (of 8-bit entries) straight into the background map
+ *  in VRAM, at the given position in tiles, w tiles wide (like set_bkg_tiles(),
+ *  the height is in the data). It works with the display on, but it is faster
+ *  with it off. The map must be laid out in rows: maps in VRAM rows take a w
+ *  of 32, and maps in columns or with 16-bit entries (above 256 tiles) have to
+ *  be decompressed to RAM with image2gb_decompress() instead.
+ */
+void image2gb_decompress_bkg_tiles(uint8_t x, uint8_t y, uint8_t w, const uint8_t* src, uint8_t compression);
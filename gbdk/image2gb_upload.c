@@ -0,0 +1,30 @@
+/**
+ * @file  image2gb_upload.c
+ * @brief Loader that copies the tiles of an asset exported by Image2GB with an upload budget to VRAM, one chunk per frame, for use with GBDK-2020 - implementation.
+ */
+
+#include "image2gb_upload.h"
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+void image2gb_upload_start(image2gb_upload_t* upload, const uint8_t* data, const uint8_t* table, uint16_t chunks)
+{
+	upload->data = data;
+	upload->next = table;
+	upload->left = chunks;
+}
+
+uint16_t image2gb_upload_step(image2gb_upload_t* upload)
+{
+	const uint8_t* entry = upload->next;
+
+	if (upload->left == 0U)
+		return 0U;
+
+	// set_bkg_data() follows LCDC bit 4, like the tile base does.
+	set_bkg_data(entry[2], entry[3], upload->data + (entry[0] | ((uint16_t) entry[1] << 8)));
+
+	upload->next += IMAGE2GB_UPLOAD_ENTRY_SIZE;
+
+	return --upload->left;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file  image2gb_upload.h
+ * @brief Loader that copies the tiles of an asset exported by Image2GB with an upload budget to VRAM, one chunk per frame, for use with GBDK-2020 - header.
+ *
+ * Copy this file and image2gb_upload.c to your project. A full set of tiles
+ * takes longer to copy than a VBlank lasts, so the upload table of the asset
+ * splits it in chunks that do fit, and the loader copies one per frame (with
+ * the display on, and no flicker), for example:
+ *
+ *     image2gb_upload_t upload;
+ *
+ *     image2gb_upload_start(& upload, BackgroundDataName, BackgroundUploadsName, GAME_BACKGROUNDS_NAME_UPLOAD_CHUNKS);
+ *
+ *     while (image2gb_upload_step(& upload))
+ *     {
+ *         vsync();
+ *         // Game logic...
+ *     }
+ *
+ * Call image2gb_upload_step() right after vsync() (or from a VBlank interrupt
+ * handler), so the chunk is copied while VRAM is free. The data must be in the
+ * current ROM bank.
+ */
+
+#pragma once
+
+#include <gb/gb.h>
+#include <stdint.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_UPLOAD_ENTRY_SIZE 4U /**< Bytes of every entry of the upload table (offset low, offset high, first tile, tiles). */
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** State of an upload in progress.
+ */
+typedef struct image2gb_upload_t
+{
+	const uint8_t* data; /**< Tile data of the asset. */
+	const uint8_t* next; /**< Entry of the upload table of the next chunk. */
+	uint16_t left; /**< Chunks not copied yet. */
+} image2gb_upload_t;
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Prepares the upload of the given tile data, following its upload table of
+ *  the given number of chunks. Nothing is copied yet.
+ */
+void image2gb_upload_start(image2gb_upload_t* upload, const uint8_t* data, const uint8_t* table, uint16_t chunks);
+
+/** Copies the next chunk of tiles to VRAM. Returns the number of chunks left
+ *  (0 once the upload is complete, then it does nothing).
+ */
+uint16_t image2gb_upload_step(image2gb_upload_t* upload);
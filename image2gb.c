@@ -6,6 +6,8 @@
 #include "image2gb.h"
 
 #include "image_export.h" // This one contains all export functionality.
+#include "image_benchmark.h"
+#include "image_batch.h"
 
 // VARIABLES ///////////////////////////////////////////////////////////////////
 
@@ -36,6 +38,31 @@ GtkWidget* WbuttonFolder;
  */
 GtkWidget* WspinBank;
 
+/** GTK combo box for choosing the output format. It is global so we can read
+ *  the value anywhere.
+ */
+GtkWidget* WcomboFormat;
+
+/** GTK spin button for choosing the VRAM tile base. It is global so we can
+ *  read the value anywhere.
+ */
+GtkWidget* WspinTileBase;
+
+/** GTK combo box for choosing the compression. It is global so we can read
+ *  the value anywhere.
+ */
+GtkWidget* WcomboCompression;
+
+/** GTK spin button for choosing the upload budget. It is global so we can read
+ *  the value anywhere.
+ */
+GtkWidget* WspinUploadBudget;
+
+/** GTK combo box for choosing the map layout. It is global so we can read the
+ *  value anywhere.
+ */
+GtkWidget* WcomboLayout;
+
 // FUNCTIONS ///////////////////////////////////////////////////////////////////
 
 MAIN() // GIMP macro that declares a proper main() and initializes everything.
@@ -50,7 +77,12 @@ image2gb_query(void)
 		{GIMP_PDB_DRAWABLE, "drawable", "Drawable to save"},
 		{GIMP_PDB_STRING, "filename", "The name of the file to save the image in"},
 		{GIMP_PDB_STRING, "raw-filename", "The name of the file to save the image in"},
-		{GIMP_PDB_INT32, "bank", "The ROM bank number to store the asset in (optional, default 0)"}
+		{GIMP_PDB_INT32, "bank", "The ROM bank number to store the asset in (optional, default 0)"},
+		{GIMP_PDB_INT32, "format", "Output format: 0 = C source (.c), 1 = binary (.2bpp + .tilemap) (optional, default 0)"},
+		{GIMP_PDB_INT32, "tile-base", "VRAM tile slot the tiles will be loaded at, added to the tilemap (optional, default 0)"},
+		{GIMP_PDB_INT32, "compression", "Compression of the tile data and map: 0 = none, 1 = RLE, 2 = LZ (optional, default 0)"},
+		{GIMP_PDB_INT32, "upload-budget", "Bytes of tile data copied to VRAM per frame, for an upload table (optional, default 0 = no table)"},
+		{GIMP_PDB_INT32, "map-layout", "Order of the tilemap entries: 0 = rows, 1 = columns, 2 = rows padded to the VRAM map, 32 wide (optional, default 0)"}
 	};
 
 	// Install the procedures in the PDB (Procedure DB). The same procedure can
@@ -78,6 +110,69 @@ image2gb_query(void)
 	                       G_N_ELEMENTS(Gparams), 0,
 	                       Gparams, NULL);
 
+	// Parameters of the benchmark procedure (no menu entry, call it from the
+	// Script-Fu or Python console).
+	static GimpParamDef GparamsBenchmark[] = {{GIMP_PDB_INT32, "run-mode", "The run mode"},
+		{GIMP_PDB_IMAGE, "image", "Input image"},
+		{GIMP_PDB_DRAWABLE, "drawable", "Drawable to read"},
+		{GIMP_PDB_INT32, "iterations", "How many times each reader is run (0 for the default)"}
+	};
+
+	gimp_install_procedure(IMAGE2GB_PROCEDURE_BENCHMARK,
+	                       "Benchmark the Image2GB image readers",
+	                       "Reads the drawable with every available strategy and reports how long each one takes.",
+	                       IMAGE2GB_AUTHOR,
+	                       IMAGE2GB_COPYRIGHT,
+	                       IMAGE2GB_DATE,
+	                       NULL,
+	                       IMAGE2GB_IMAGE_TYPES,
+	                       GIMP_PLUGIN,
+	                       G_N_ELEMENTS(GparamsBenchmark), 0,
+	                       GparamsBenchmark, NULL);
+
+	// Parameters of the batch procedure (no menu entry either), for exporting
+	// many assets without running the plugin once per asset.
+	static GimpParamDef GparamsBatch[] = {{GIMP_PDB_INT32, "run-mode", "The run mode"},
+		{GIMP_PDB_IMAGE, "image", "Image whose layers are exported (with source 1)"},
+		{GIMP_PDB_INT32, "source", "What to export: 0 = every open image, 1 = every visible layer of the image"},
+		{GIMP_PDB_STRING, "folder", "Folder to save to (empty for the one every image was last exported to, or else the folder of its file)"},
+		{GIMP_PDB_INT32, "bank", "The ROM bank number to store the assets in (optional, default 0)"},
+		{GIMP_PDB_INT32, "format", "Output format: 0 = C source (.c), 1 = binary (.2bpp + .tilemap) (optional, default 0)"},
+		{GIMP_PDB_INT32, "compression", "Compression of the tile data and map: 0 = none, 1 = RLE, 2 = LZ (optional, default 0)"}
+	};
+
+	gimp_install_procedure(IMAGE2GB_PROCEDURE_BATCH,
+	                       "Export several images to Game Boy data",
+	                       "Exports every open image, or every visible layer of an image, as separate assets (converted in parallel), and reports a single summary.",
+	                       IMAGE2GB_AUTHOR,
+	                       IMAGE2GB_COPYRIGHT,
+	                       IMAGE2GB_DATE,
+	                       NULL,
+	                       IMAGE2GB_IMAGE_TYPES,
+	                       GIMP_PLUGIN,
+	                       G_N_ELEMENTS(GparamsBatch), 0,
+	                       GparamsBatch, NULL);
+
+	// Parameters of the animation procedure (no menu entry either), for
+	// exporting the layers of an image as the frames of an animation.
+	static GimpParamDef GparamsAnimation[] = {{GIMP_PDB_INT32, "run-mode", "The run mode"},
+		{GIMP_PDB_IMAGE, "image", "Image whose visible layers are the frames (the bottom one first)"},
+		{GIMP_PDB_STRING, "folder", "Folder to save to (empty for the one the image was last exported to, or else the folder of its file)"},
+		{GIMP_PDB_INT32, "bank", "The ROM bank number to store the asset in (optional, default 0)"}
+	};
+
+	gimp_install_procedure(IMAGE2GB_PROCEDURE_ANIMATION,
+	                       "Export the layers of an image as a Game Boy animation",
+	                       "Exports the visible layers of an image as the frames of a single asset, with one tileset for all of them and the map cells every frame changes.",
+	                       IMAGE2GB_AUTHOR,
+	                       IMAGE2GB_COPYRIGHT,
+	                       IMAGE2GB_DATE,
+	                       NULL,
+	                       IMAGE2GB_IMAGE_TYPES,
+	                       GIMP_PLUGIN,
+	                       G_N_ELEMENTS(GparamsAnimation), 0,
+	                       GparamsAnimation, NULL);
+
 	// Register the plugin, first part: menu entry.
 	gimp_plugin_menu_register(IMAGE2GB_PROCEDURE_MENU, IMAGE2GB_MENU_PATH);
 	// Associate the "text/plain" MIME file type (probably unnecesary?).
@@ -110,14 +205,46 @@ image2gb_run(const gchar* Sname, gint InumParams, const GimpParam* Gparams, gint
 	* GreturnVals = GreturnValues;
 	GreturnValues[0].type = GIMP_PDB_STATUS;
 
+	// Needed for reading the image through its GEGL buffer.
+	gegl_init(NULL, NULL);
+
+	// The benchmark procedure has nothing to do with exporting, run and leave.
+	if (strcmp(Sname, IMAGE2GB_PROCEDURE_BENCHMARK) == 0)
+	{
+		GreturnValues[0].data.d_status = image2gb_benchmark_readers(IimageID, Gparams[2].data.d_drawable,
+		                                                            (InumParams >= 4) ? Gparams[3].data.d_int32 : 0);
+
+		return;
+	}
+
+	// Same for the batch export, it does everything on its own.
+	if (strcmp(Sname, IMAGE2GB_PROCEDURE_BATCH) == 0)
+	{
+		GreturnValues[0].data.d_status = image2gb_batch_export(IimageID, Gparams[2].data.d_int32, Gparams[3].data.d_string,
+		                                                       (InumParams >= 5) ? Gparams[4].data.d_int32 : 0,
+		                                                       (InumParams >= 6) ? Gparams[5].data.d_int32 : IMAGE2GB_FORMAT_SOURCE,
+		                                                       (InumParams >= 7) ? Gparams[6].data.d_int32 : IMAGE2GB_COMPRESSION_NONE);
+
+		return;
+	}
+
+	// And for the animation export.
+	if (strcmp(Sname, IMAGE2GB_PROCEDURE_ANIMATION) == 0)
+	{
+		GreturnValues[0].data.d_status = image2gb_batch_animation(IimageID, Gparams[2].data.d_string,
+		                                                          (InumParams >= 4) ? Gparams[3].data.d_int32 : 0);
+
+		return;
+	}
+
 	// Before doing anything, check the validity of the image.
-	if (! image2gb_check_image(IimageID))
+	if (! image2gb_check_image(IimageID, gimp_image_width(IimageID), gimp_image_height(IimageID)))
 		GreturnStatus = GIMP_PDB_CALLING_ERROR;
 
 	// Try to get the last used export options.
 	if (GreturnStatus == GIMP_PDB_SUCCESS)
 	{
-		if (! image2gb_load_parameters(IimageID))
+		if (! image2gb_load_parameters(IimageID, & StructExportOptions))
 			GrunMode = GIMP_RUN_INTERACTIVE; // Could not read? Force dialog.
 	}
 
@@ -138,8 +265,28 @@ image2gb_run(const gchar* Sname, gint InumParams, const GimpParam* Gparams, gint
 		}
 
 		// If called by a script, get the ROM bank number parameter, if any.
-		if ((GrunMode == GIMP_RUN_NONINTERACTIVE) && (InumParams == 6))
+		if ((GrunMode == GIMP_RUN_NONINTERACTIVE) && (InumParams >= 6))
 			StructExportOptions.bank = Gparams[5].data.d_int32;
+
+		// Same for the output format.
+		if ((GrunMode == GIMP_RUN_NONINTERACTIVE) && (InumParams >= 7))
+			StructExportOptions.format = (Gparams[6].data.d_int32 == IMAGE2GB_FORMAT_BINARY) ? IMAGE2GB_FORMAT_BINARY : IMAGE2GB_FORMAT_SOURCE;
+
+		// And the tile base.
+		if ((GrunMode == GIMP_RUN_NONINTERACTIVE) && (InumParams >= 8))
+			StructExportOptions.tileBase = CLAMP(Gparams[7].data.d_int32, 0, IMAGE2GB_TILE_BASE_MAX);
+
+		// And the compression.
+		if ((GrunMode == GIMP_RUN_NONINTERACTIVE) && (InumParams >= 9))
+			StructExportOptions.compression = CLAMP(Gparams[8].data.d_int32, 0, (IMAGE2GB_COMPRESSION_COUNT - 1));
+
+		// And the upload budget.
+		if ((GrunMode == GIMP_RUN_NONINTERACTIVE) && (InumParams >= 10))
+			StructExportOptions.uploadBudget = CLAMP(Gparams[9].data.d_int32, 0, IMAGE2GB_UPLOAD_BUDGET_MAX);
+
+		// And the map layout.
+		if ((GrunMode == GIMP_RUN_NONINTERACTIVE) && (InumParams >= 11))
+			StructExportOptions.mapLayout = CLAMP(Gparams[10].data.d_int32, 0, (IMAGE2GB_LAYOUT_COUNT - 1));
 	}
 
 	// First time export, or invoked through menu entry? Show a dialog window to
@@ -156,24 +303,21 @@ image2gb_run(const gchar* Sname, gint InumParams, const GimpParam* Gparams, gint
 		GreturnStatus = GIMP_PDB_CALLING_ERROR;
 	}
 
-	// Try to export the image.
+	// Try to export the image (this also saves the parameters for the next
+	// invocation).
 	if (GreturnStatus == GIMP_PDB_SUCCESS)
 		GreturnStatus = image2gb_export_image(IimageID, Gparams[2].data.d_drawable,
 		                                      & StructExportOptions);
 
-	// Save the parameters for the next invocation, using a parasite.
-	if (GreturnStatus == GIMP_PDB_SUCCESS)
-		image2gb_save_parameters(IimageID);
-
 	GreturnValues[0].data.d_status = GreturnStatus;
 }
 
 static gboolean
-image2gb_check_image(gint32 IimageID)
+image2gb_check_image(gint32 IimageID, guint UIwidth, guint UIheight)
 {
-	// Check that size is between 8x8 (1 tile) and 256x256 (32x32 tiles).
-	if (((gimp_image_width(IimageID) < IMAGE2GB_IMAGE_SIZE_MIN) || (gimp_image_width(IimageID) > IMAGE2GB_IMAGE_SIZE_MAX))
-	    || ((gimp_image_height(IimageID) < IMAGE2GB_IMAGE_SIZE_MIN) || (gimp_image_height(IimageID) > IMAGE2GB_IMAGE_SIZE_MAX)))
+	// Check that size is between 8x8 (1 tile) and 32768x32768 (4096x4096 tiles).
+	if (((UIwidth < IMAGE2GB_IMAGE_SIZE_MIN) || (UIwidth > IMAGE2GB_IMAGE_SIZE_MAX))
+	    || ((UIheight < IMAGE2GB_IMAGE_SIZE_MIN) || (UIheight > IMAGE2GB_IMAGE_SIZE_MAX)))
 	{
 		g_message("Image size should be between %dx%d and %dx%d pixels.\n",
 		          IMAGE2GB_IMAGE_SIZE_MIN, IMAGE2GB_IMAGE_SIZE_MIN,
@@ -183,8 +327,7 @@ image2gb_check_image(gint32 IimageID)
 	}
 
 	// Also, size should be a multiple of 8 (whole tiles).
-	if (((gimp_image_width(IimageID) % IMAGE2GB_TILE_SIZE) != 0)
-	    || ((gimp_image_height(IimageID) % IMAGE2GB_TILE_SIZE) != 0))
+	if (((UIwidth % IMAGE2GB_TILE_SIZE) != 0) || ((UIheight % IMAGE2GB_TILE_SIZE) != 0))
 	{
 		g_message("Both width and height should be multiples of %d.\n", IMAGE2GB_TILE_SIZE);
 
@@ -220,6 +363,16 @@ image2gb_show_dialog(void)
 	GtkWidget* WlabelFolder;
 	GtkWidget* WhBoxBank;
 	GtkWidget* WlabelBank;
+	GtkWidget* WhBoxFormat;
+	GtkWidget* WlabelFormat;
+	GtkWidget* WhBoxTileBase;
+	GtkWidget* WlabelTileBase;
+	GtkWidget* WhBoxCompression;
+	GtkWidget* WlabelCompression;
+	GtkWidget* WhBoxUploadBudget;
+	GtkWidget* WlabelUploadBudget;
+	GtkWidget* WhBoxLayout;
+	GtkWidget* WlabelLayout;
 
 	// Initialize GTK, plugin would crash otherwise.
 	gimp_ui_init(IMAGE2GB_BINARY_NAME, FALSE);
@@ -256,7 +409,7 @@ image2gb_show_dialog(void)
 	gtk_widget_show(WlabelFolder);
 
 	WbuttonFolder = gtk_file_chooser_button_new("Select a folder", GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER);
-	gtk_widget_set_tooltip_text(WbuttonFolder, "The .c and .h files will be created in this folder.");
+	gtk_widget_set_tooltip_text(WbuttonFolder, "The output files will be created in this folder.");
 	gtk_file_chooser_set_uri(GTK_FILE_CHOOSER(WbuttonFolder), StructExportOptions.folder);
 
 	gtk_box_pack_start(GTK_BOX(WhBoxFolder), WbuttonFolder, TRUE, TRUE, 5);
@@ -275,6 +428,82 @@ image2gb_show_dialog(void)
 	gtk_box_pack_start(GTK_BOX(WhBoxBank), WspinBank, FALSE, FALSE, 5);
 	gtk_widget_show(WspinBank);
 
+	// Widget controls group: output format.
+	WhBoxFormat = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+
+	WlabelFormat = gtk_label_new("Output format:");
+	gtk_box_pack_start(GTK_BOX(WhBoxFormat), WlabelFormat, FALSE, FALSE, 5);
+	gtk_widget_show(WlabelFormat);
+
+	// Entries must be in the same order as ExportFormat.
+	WcomboFormat = gtk_combo_box_text_new();
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(WcomboFormat), "C source (.h + .c)");
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(WcomboFormat), "Binary (.h + .2bpp + .tilemap)");
+	gtk_widget_set_tooltip_text(WcomboFormat, "Binary files can be included with INCBIN, and are much faster to compile.");
+	gtk_combo_box_set_active(GTK_COMBO_BOX(WcomboFormat), StructExportOptions.format);
+	gtk_box_pack_start(GTK_BOX(WhBoxFormat), WcomboFormat, TRUE, TRUE, 5);
+	gtk_widget_show(WcomboFormat);
+
+	// Widget controls group: VRAM tile base.
+	WhBoxTileBase = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+
+	WlabelTileBase = gtk_label_new("VRAM tile base (optional):");
+	gtk_box_pack_start(GTK_BOX(WhBoxTileBase), WlabelTileBase, FALSE, FALSE, 5);
+	gtk_widget_show(WlabelTileBase);
+
+	WspinTileBase = gtk_spin_button_new_with_range(0, IMAGE2GB_TILE_BASE_MAX, 1);
+	gtk_widget_set_tooltip_text(WspinTileBase, "First VRAM tile the asset will be loaded at. It is added to the tilemap, so it needs no patching.");
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(WspinTileBase), StructExportOptions.tileBase);
+	gtk_box_pack_start(GTK_BOX(WhBoxTileBase), WspinTileBase, FALSE, FALSE, 5);
+	gtk_widget_show(WspinTileBase);
+
+	// Widget controls group: compression.
+	WhBoxCompression = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+
+	WlabelCompression = gtk_label_new("Compression:");
+	gtk_box_pack_start(GTK_BOX(WhBoxCompression), WlabelCompression, FALSE, FALSE, 5);
+	gtk_widget_show(WlabelCompression);
+
+	// Entries must be in the same order as ExportCompression.
+	WcomboCompression = gtk_combo_box_text_new();
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(WcomboCompression), "None");
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(WcomboCompression), "RLE (fastest to decompress)");
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(WcomboCompression), "LZ (smallest)");
+	gtk_widget_set_tooltip_text(WcomboCompression, "Compressed assets take less ROM, load them with gbdk/image2gb_decompress.h.");
+	gtk_combo_box_set_active(GTK_COMBO_BOX(WcomboCompression), StructExportOptions.compression);
+	gtk_box_pack_start(GTK_BOX(WhBoxCompression), WcomboCompression, TRUE, TRUE, 5);
+	gtk_widget_show(WcomboCompression);
+
+	// Widget controls group: upload budget.
+	WhBoxUploadBudget = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+
+	WlabelUploadBudget = gtk_label_new("Upload budget, bytes per frame (optional):");
+	gtk_box_pack_start(GTK_BOX(WhBoxUploadBudget), WlabelUploadBudget, FALSE, FALSE, 5);
+	gtk_widget_show(WlabelUploadBudget);
+
+	WspinUploadBudget = gtk_spin_button_new_with_range(0, IMAGE2GB_UPLOAD_BUDGET_MAX, IMAGE2GB_TILE_BYTES);
+	gtk_widget_set_tooltip_text(WspinUploadBudget, "Splits the tile data in chunks of this size, to load them one per VBlank with gbdk/image2gb_upload.h (0 for none).");
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(WspinUploadBudget), StructExportOptions.uploadBudget);
+	gtk_box_pack_start(GTK_BOX(WhBoxUploadBudget), WspinUploadBudget, FALSE, FALSE, 5);
+	gtk_widget_show(WspinUploadBudget);
+
+	// Widget controls group: map layout.
+	WhBoxLayout = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+
+	WlabelLayout = gtk_label_new("Map layout:");
+	gtk_box_pack_start(GTK_BOX(WhBoxLayout), WlabelLayout, FALSE, FALSE, 5);
+	gtk_widget_show(WlabelLayout);
+
+	// Entries must be in the same order as ExportLayout.
+	WcomboLayout = gtk_combo_box_text_new();
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(WcomboLayout), "Rows (as wide as the image)");
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(WcomboLayout), "Columns (horizontal scrolling)");
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(WcomboLayout), "VRAM rows (padded to 32 tiles)");
+	gtk_widget_set_tooltip_text(WcomboLayout, "Columns are copied to VRAM in one go, VRAM rows (images up to 32 tiles wide) straight to the background map.");
+	gtk_combo_box_set_active(GTK_COMBO_BOX(WcomboLayout), StructExportOptions.mapLayout);
+	gtk_box_pack_start(GTK_BOX(WhBoxLayout), WcomboLayout, TRUE, TRUE, 5);
+	gtk_widget_show(WcomboLayout);
+
 	// Put all boxes inside the dialog box.
 	gtk_box_pack_start(GTK_BOX(WvBoxWindow), WhBoxName, TRUE, TRUE, 5);
 	gtk_widget_show(WhBoxName);
@@ -282,6 +511,16 @@ image2gb_show_dialog(void)
 	gtk_widget_show(WhBoxFolder);
 	gtk_box_pack_start(GTK_BOX(WvBoxWindow), WhBoxBank, TRUE, TRUE, 5);
 	gtk_widget_show(WhBoxBank);
+	gtk_box_pack_start(GTK_BOX(WvBoxWindow), WhBoxFormat, TRUE, TRUE, 5);
+	gtk_widget_show(WhBoxFormat);
+	gtk_box_pack_start(GTK_BOX(WvBoxWindow), WhBoxTileBase, TRUE, TRUE, 5);
+	gtk_widget_show(WhBoxTileBase);
+	gtk_box_pack_start(GTK_BOX(WvBoxWindow), WhBoxCompression, TRUE, TRUE, 5);
+	gtk_widget_show(WhBoxCompression);
+	gtk_box_pack_start(GTK_BOX(WvBoxWindow), WhBoxUploadBudget, TRUE, TRUE, 5);
+	gtk_widget_show(WhBoxUploadBudget);
+	gtk_box_pack_start(GTK_BOX(WvBoxWindow), WhBoxLayout, TRUE, TRUE, 5);
+	gtk_widget_show(WhBoxLayout);
 
 	gtk_widget_show(WdialogWindow);
 
@@ -308,6 +547,11 @@ image2gb_dialog_response(GtkWidget* Wwidget, gint IresponseID, gpointer Pdata)
 			strcpy(StructExportOptions.folder, gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(WbuttonFolder)));
 
 		StructExportOptions.bank = gtk_spin_button_get_value(GTK_SPIN_BUTTON(WspinBank));
+		StructExportOptions.format = gtk_combo_box_get_active(GTK_COMBO_BOX(WcomboFormat));
+		StructExportOptions.tileBase = gtk_spin_button_get_value(GTK_SPIN_BUTTON(WspinTileBase));
+		StructExportOptions.compression = gtk_combo_box_get_active(GTK_COMBO_BOX(WcomboCompression));
+		StructExportOptions.uploadBudget = gtk_spin_button_get_value(GTK_SPIN_BUTTON(WspinUploadBudget));
+		StructExportOptions.mapLayout = gtk_combo_box_get_active(GTK_COMBO_BOX(WcomboLayout));
 	}
 	else (* GreturnStatus) = GIMP_PDB_CANCEL;
 
@@ -316,7 +560,7 @@ image2gb_dialog_response(GtkWidget* Wwidget, gint IresponseID, gpointer Pdata)
 }
 
 static gboolean
-image2gb_load_parameters(gint32 IimageID)
+image2gb_load_parameters(gint32 IimageID, PluginExportOptions* PexportOptions)
 {
 	GimpParasite* Gparasite; /**< Persistent parameters (stored values of previous export). */
 
@@ -327,9 +571,23 @@ image2gb_load_parameters(gint32 IimageID)
 		const PluginExportOptions* StructSavedOptions = gimp_parasite_data(Gparasite);
 
 		// Recover the values.
-		strcpy(StructExportOptions.name, StructSavedOptions->name);
-		strcpy(StructExportOptions.folder, StructSavedOptions->folder);
-		StructExportOptions.bank = StructSavedOptions->bank;
+		strcpy(PexportOptions->name, StructSavedOptions->name);
+		strcpy(PexportOptions->folder, StructSavedOptions->folder);
+		PexportOptions->bank = StructSavedOptions->bank;
+
+		// Parasites saved by older versions do not have the format.
+		if (gimp_parasite_data_size(Gparasite) >= (glong)(G_STRUCT_OFFSET(PluginExportOptions, format) + sizeof(gint)))
+			PexportOptions->format = StructSavedOptions->format;
+
+		// Nor the tile base, the compression, the upload budget and the map
+		// layout (they are only there if a current header follows).
+		if (image2gb_parasite_is_current(Gparasite))
+		{
+			PexportOptions->tileBase = StructSavedOptions->tileBase;
+			PexportOptions->compression = StructSavedOptions->compression;
+			PexportOptions->uploadBudget = StructSavedOptions->uploadBudget;
+			PexportOptions->mapLayout = StructSavedOptions->mapLayout;
+		}
 
 		gimp_parasite_free(Gparasite);
 
@@ -340,14 +598,102 @@ image2gb_load_parameters(gint32 IimageID)
 }
 
 static void
-image2gb_save_parameters(gint32 IimageID)
+image2gb_save_parameters(gint32 IimageID, const ExportContext* Pcontext)
 {
 	GimpParasite* Gparasite; /**< Persistent parameters (stored values for subsequent exports). */
+	GByteArray* Gdata = g_byte_array_new(); /**< Contents of the parasite. */
+
+	ParasiteHeader StructHeader = {IMAGE2GB_PARASITE_MAGIC, IMAGE2GB_PARASITE_VERSION, 0, 0, 0}; /**< Follows the parameters, and starts the state. */
+
+	// The header after the parameters tells they are of the current version.
+	g_byte_array_append(Gdata, (const guint8*) & Pcontext->options, sizeof(PluginExportOptions));
+	g_byte_array_append(Gdata, (const guint8*) & StructHeader, sizeof(StructHeader));
 
 	// Remove the current one.
 	gimp_image_detach_parasite(IimageID, IMAGE2GB_PARASITE);
 
-	Gparasite = gimp_parasite_new(IMAGE2GB_PARASITE, 0, sizeof(StructExportOptions), & StructExportOptions);
+	Gparasite = gimp_parasite_new(IMAGE2GB_PARASITE, GIMP_PARASITE_PERSISTENT, Gdata->len, Gdata->data);
 	gimp_image_attach_parasite(IimageID, Gparasite);
 	gimp_parasite_free(Gparasite);
+
+	// The result of the deduplication goes apart (it can take more than a
+	// megabyte), and only if there was one (there is not in streaming mode,
+	// nor if the output came from the cache), otherwise the old one goes away.
+	gimp_image_detach_parasite(IimageID, IMAGE2GB_STATE_PARASITE);
+
+	if ((Pcontext->hashes != NULL) && (! Pcontext->cacheHit))
+	{
+		guint UItileTotal = (Pcontext->tileWidth * Pcontext->tileHeight); /**< Number of tiles in the image. */
+
+		StructHeader.tileWidth = Pcontext->tileWidth;
+		StructHeader.tileHeight = Pcontext->tileHeight;
+		StructHeader.tileCount = Pcontext->tileCount;
+
+		g_byte_array_set_size(Gdata, 0);
+		g_byte_array_append(Gdata, (const guint8*) & StructHeader, sizeof(StructHeader));
+		g_byte_array_append(Gdata, (const guint8*) Pcontext->hashes, (UItileTotal * sizeof(guint)));
+		g_byte_array_append(Gdata, (const guint8*) Pcontext->map, (UItileTotal * sizeof(guint)));
+
+		for (guint tile = 0; tile < UItileTotal; tile++)
+		{
+			if (! Pcontext->tiles[tile].duplicate)
+				g_byte_array_append(Gdata, (const guint8*) Pcontext->tiles[tile].row, sizeof(Pcontext->tiles[tile].row));
+		}
+
+		Gparasite = gimp_parasite_new(IMAGE2GB_STATE_PARASITE, GIMP_PARASITE_PERSISTENT, Gdata->len, Gdata->data);
+		gimp_image_attach_parasite(IimageID, Gparasite);
+		gimp_parasite_free(Gparasite);
+	}
+
+	g_byte_array_free(Gdata, TRUE);
+}
+
+static gboolean
+image2gb_load_dedupe_state(const GimpParasite* Gparasite, DedupeState* Pstate)
+{
+	const guchar* Pdata = gimp_parasite_data(Gparasite); /**< Contents of the parasite. */
+	gsize UIsize = gimp_parasite_data_size(Gparasite); /**< Size of the contents. */
+	ParasiteHeader StructHeader; /**< What the state starts with. */
+	gsize UItileTotal = 0; /**< Number of tiles in the image. */
+
+	if (UIsize < sizeof(ParasiteHeader))
+		return FALSE;
+
+	memcpy(& StructHeader, Pdata, sizeof(StructHeader));
+
+	// Saved by another version.
+	if ((StructHeader.magic != IMAGE2GB_PARASITE_MAGIC) || (StructHeader.version != IMAGE2GB_PARASITE_VERSION))
+		return FALSE;
+
+	UItileTotal = ((gsize) StructHeader.tileWidth * StructHeader.tileHeight);
+
+	if ((UItileTotal == 0) || (UItileTotal > IMAGE2GB_STREAMING_TILES_MIN) || (StructHeader.tileCount > UItileTotal))
+		return FALSE;
+
+	if (UIsize != (sizeof(ParasiteHeader) + (UItileTotal * 2 * sizeof(guint)) +
+	               (StructHeader.tileCount * sizeof(((DataTile*) NULL)->row))))
+		return FALSE;
+
+	Pstate->tileWidth = StructHeader.tileWidth;
+	Pstate->tileHeight = StructHeader.tileHeight;
+	Pstate->tileCount = StructHeader.tileCount;
+	Pstate->hashes = (const guint*)(Pdata + sizeof(ParasiteHeader));
+	Pstate->map = (Pstate->hashes + UItileTotal);
+	Pstate->tiles = (const uint16_t*)(Pstate->map + UItileTotal);
+
+	return TRUE;
+}
+
+static gboolean
+image2gb_parasite_is_current(const GimpParasite* Gparasite)
+{
+	const guchar* Pdata = gimp_parasite_data(Gparasite); /**< Contents of the parasite. */
+	ParasiteHeader StructHeader; /**< What should follow the parameters. */
+
+	if (gimp_parasite_data_size(Gparasite) < (glong)(sizeof(PluginExportOptions) + sizeof(ParasiteHeader)))
+		return FALSE;
+
+	memcpy(& StructHeader, Pdata + sizeof(PluginExportOptions), sizeof(StructHeader));
+
+	return ((StructHeader.magic == IMAGE2GB_PARASITE_MAGIC) && (StructHeader.version == IMAGE2GB_PARASITE_VERSION));
 }
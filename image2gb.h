@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include "image_convert.h" // For PluginExportOptions.
+
 // Ignore warnings in external libraries (GIMP, GTK...).
 #pragma GCC system_header
 #include <libgimp/gimp.h>
@@ -16,6 +18,9 @@
 #define IMAGE2GB_BINARY_NAME    "image2gb"        /**< Name of the output binary. */
 #define IMAGE2GB_PROCEDURE_MENU "Image2GB-menu"   /**< Name of the procedure registered as menu entry. */
 #define IMAGE2GB_PROCEDURE_SAVE "Image2GB-export" /**< Name of the procedure registered as save handler. */
+#define IMAGE2GB_PROCEDURE_BENCHMARK "Image2GB-benchmark-read" /**< Name of the procedure that benchmarks the image readers. */
+#define IMAGE2GB_PROCEDURE_BATCH "Image2GB-export-batch" /**< Name of the procedure that exports several images (or layers) at once. */
+#define IMAGE2GB_PROCEDURE_ANIMATION "Image2GB-export-animation" /**< Name of the procedure that exports the layers of an image as the frames of an animation. */
 
 #define IMAGE2GB_DESCRIPTION_SHORT "Export image to Game Boy data"
 #define IMAGE2GB_DESCRIPTION_LONG  "Exports an indexed 4-color image to Game Boy data (C code, for use with GBDK-2020)."
@@ -29,20 +34,26 @@
 #define IMAGE2GB_ASSOCIATED_MIME_TYPE "text/plain" /**< MIME file type that will be associated with this plugin. */
 #define IMAGE2GB_ASSOCIATED_EXTENSION "gbdk"       /**< File extension that will be associated with this plugin. */
 
-#define IMAGE2GB_ASSET_NAME_MAX_LENGTH 32 /**< Max characters of the asset name used for the C variable identifier. */
-
-#define IMAGE2GB_PARASITE "gbdk-2020-export-options" /**< Cookie to store export parameters between invocations (persistent data). */
+#define IMAGE2GB_PARASITE       "gbdk-2020-export-options" /**< Cookie to store export parameters between invocations (persistent data). */
+#define IMAGE2GB_STATE_PARASITE "gbdk-2020-export-state"   /**< Cookie to store the result of the last export (persistent data). */
+#define IMAGE2GB_PARASITE_MAGIC   0x42473249 /**< Marks the header that follows the parameters, and starts the result of the last export ("I2GB"). */
+#define IMAGE2GB_PARASITE_VERSION 7          /**< Version of the parasite format (1 only had the parameters, 2 had no tile base, 3 no compression, 4 no upload budget, 5 no map layout, 6 had the result in the same parasite). */
 
 // DEFINITIONS /////////////////////////////////////////////////////////////////
 
-/** Object that stores this plugin's export parameters.
+/** Header stored in the parameters parasite right after the export parameters
+ *  (to tell they are of the current version, its size is always 0x0), and at
+ *  the start of the state parasite, where it is followed by the hash of every
+ *  tile, the tilemap, and the data of the unique tiles (see DedupeState).
  */
-typedef struct PluginExportOptions
+typedef struct ParasiteHeader
 {
-	gchar name[IMAGE2GB_ASSET_NAME_MAX_LENGTH]; /**< Base name of the image asset to export. */
-	gchar folder[PATH_MAX]; /**< Full path of the directory to save to. */
-	gint bank; /**< ROM bank to store the image data in. */
-} PluginExportOptions;
+	guint32 magic; /**< IMAGE2GB_PARASITE_MAGIC. */
+	guint32 version; /**< IMAGE2GB_PARASITE_VERSION. */
+	guint32 tileWidth; /**< Width of the image in Game Boy tiles. */
+	guint32 tileHeight; /**< Height of the image in Game Boy tiles. */
+	guint32 tileCount; /**< Number of unique tiles. */
+} ParasiteHeader;
 
 // FUNCTIONS ///////////////////////////////////////////////////////////////////
 
@@ -56,11 +67,12 @@ image2gb_query(void);
 static void
 image2gb_run(const gchar* Sname, gint InumParams, const GimpParam* Gparams, gint* InumReturnVals, GimpParam** GreturnVals);
 
-/** Checks the validity of the image for being exported to Game Boy. Returns
- *  TRUE if it is valid, FALSE otherwise.
+/** Checks the validity of the image (or one of its layers, of the given size)
+ *  for being exported to Game Boy. Returns TRUE if it is valid, FALSE
+ *  otherwise.
  */
 static gboolean
-image2gb_check_image(gint32 IimageID);
+image2gb_check_image(gint32 IimageID, guint UIwidth, guint UIheight);
 
 /** Opens a dialog window to let the user set the export parameters. Returns
  *  the program status.
@@ -73,13 +85,29 @@ image2gb_show_dialog(void);
 static void
 image2gb_dialog_response(GtkWidget* Wwidget, gint IresponseID, gpointer Pdata);
 
-/** Tries to load existing export parameters from the parasite. Returns TRUE if
- *  success, FALSE otherwise.
+/** Tries to load existing export parameters from the parasite of the image,
+ *  into PexportOptions. Returns TRUE if success, FALSE otherwise.
  */
 static gboolean
-image2gb_load_parameters(gint32 IimageID);
+image2gb_load_parameters(gint32 IimageID, PluginExportOptions* PexportOptions);
 
-/** Saves the current export parameters using a parasite.
+/** Saves the export parameters of the context using a parasite, and the
+ *  result of its deduplication (if it did one) using another, so the next
+ *  export of the image only has to check the tiles that change. Both are
+ *  saved with the image.
  */
 static void
-image2gb_save_parameters(gint32 IimageID);
+image2gb_save_parameters(gint32 IimageID, const ExportContext* Pcontext);
+
+/** Reads the result of the last export from the state parasite into Pstate
+ *  (which then points to the parasite data). Returns TRUE if success, FALSE if
+ *  the parasite is not valid (older versions...).
+ */
+static gboolean
+image2gb_load_dedupe_state(const GimpParasite* Gparasite, DedupeState* Pstate);
+
+/** Returns TRUE if the parasite was saved by this version (its parameters are
+ *  followed by a valid header), FALSE otherwise.
+ */
+static gboolean
+image2gb_parasite_is_current(const GimpParasite* Gparasite);
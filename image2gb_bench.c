@@ -0,0 +1,349 @@
+/**
+ * @file  image2gb_bench.c
+ * @brief Benchmark of the conversion stages (tile reading, packing, deduplication and writing) on synthetic images - implementation.
+ */
+
+#include "image2gb_bench.h"
+
+// VARIABLES ///////////////////////////////////////////////////////////////////
+
+gchar* SoptionSizes = NULL; /**< Image sizes to measure (--sizes), NULL for IMAGE2GB_BENCH_SIZES_DEFAULT. */
+
+gint IoptionIterations = IMAGE2GB_BENCH_ITERATIONS_DEFAULT; /**< Maximum number of runs of every stage (--iterations). */
+
+gchar* SoptionOutput = NULL; /**< JSON file to save the results to (--output), or NULL. */
+
+gchar* SoptionLabel = NULL; /**< Label of the results, e.g. the commit measured (--label), or NULL. */
+
+/** Command line options, for GLib to parse.
+ */
+GOptionEntry ArrayOptions[] = {{"sizes", 's', 0, G_OPTION_ARG_STRING, & SoptionSizes, "Image sizes in pixels, N (for NxN) or WxH, separated by commas (default: " IMAGE2GB_BENCH_SIZES_DEFAULT ")", "SIZES"},
+                               {"iterations", 'i', 0, G_OPTION_ARG_INT, & IoptionIterations, "Maximum number of runs of every stage (default: 10, fewer for slow stages)", "N"},
+                               {"output", 'o', 0, G_OPTION_ARG_FILENAME, & SoptionOutput, "Save the results to this JSON file", "FILE"},
+                               {"label", 'l', 0, G_OPTION_ARG_STRING, & SoptionLabel, "Label saved with the results (e.g. the commit measured)", "LABEL"},
+                               {NULL}
+                              };
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+int
+main(int argc, char* argv[])
+{
+	GOptionContext* Gcontext = NULL; /**< Command line parser. */
+	GError* Gerror = NULL; /**< Error parsing the command line or writing the results, if any. */
+	GArray* GarraySizes = g_array_new(FALSE, FALSE, sizeof(guint)); /**< Sizes to measure (width and height, in pixels). */
+	GString* Sjson = g_string_new(NULL); /**< Results, in JSON format. */
+	gchar* Sfolder = NULL; /**< Temporary folder for the written files. */
+	gboolean Bsuccess = TRUE; /**< Whether every stage could be run. */
+
+	g_set_prgname(IMAGE2GB_BENCH_BINARY_NAME);
+
+	Gcontext = g_option_context_new(NULL);
+	g_option_context_set_summary(Gcontext, IMAGE2GB_BENCH_SUMMARY);
+	g_option_context_add_main_entries(Gcontext, ArrayOptions, NULL);
+
+	if (! g_option_context_parse(Gcontext, & argc, & argv, & Gerror))
+	{
+		g_printerr("%s: %s\n", IMAGE2GB_BENCH_BINARY_NAME, Gerror->message);
+
+		g_clear_error(& Gerror);
+		g_option_context_free(Gcontext);
+
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(Gcontext);
+
+	if (IoptionIterations <= 0)
+	{
+		g_printerr("%s: the number of iterations should be 1 or more.\n", IMAGE2GB_BENCH_BINARY_NAME);
+
+		return EXIT_FAILURE;
+	}
+
+	if (! image2gb_bench_parse_sizes((SoptionSizes != NULL) ? SoptionSizes : IMAGE2GB_BENCH_SIZES_DEFAULT, GarraySizes))
+		return EXIT_FAILURE;
+
+	Sfolder = g_dir_make_tmp(IMAGE2GB_BENCH_BINARY_NAME "-XXXXXX", & Gerror);
+
+	if (Sfolder == NULL)
+	{
+		g_printerr("%s: could not create a temporary folder (%s).\n", IMAGE2GB_BENCH_BINARY_NAME, Gerror->message);
+
+		g_clear_error(& Gerror);
+
+		return EXIT_FAILURE;
+	}
+
+	g_string_append_printf(Sjson, "{\n  \"version\": %d,\n  \"label\": ", IMAGE2GB_BENCH_JSON_VERSION);
+	image2gb_bench_json_string(Sjson, (SoptionLabel != NULL) ? SoptionLabel : "");
+	g_string_append_printf(Sjson, ",\n  \"processors\": %u,\n  \"results\": [", g_get_num_processors());
+
+	for (guint size = 0; size < (GarraySizes->len / 2); size++)
+	{
+		guint UIwidth = g_array_index(GarraySizes, guint, (2 * size)); /**< Width of the image, in pixels. */
+		guint UIheight = g_array_index(GarraySizes, guint, (2 * size) + 1); /**< Height of the image, in pixels. */
+		guchar* Ppixels = g_try_malloc((gsize) UIwidth * UIheight); /**< Pixels of the synthetic image. */
+
+		if (Ppixels == NULL)
+		{
+			g_printerr("%s: not enough memory for a %ux%u image, skipped.\n", IMAGE2GB_BENCH_BINARY_NAME, UIwidth, UIheight);
+
+			Bsuccess = FALSE;
+
+			continue;
+		}
+
+		for (guint pattern = 0; pattern < IMAGE2GB_BENCH_PATTERN_COUNT; pattern++)
+		{
+			ExportContext* Pcontext = image2gb_context_new(NULL); /**< Tiles and tilemap of the image (nothing is exported). */
+			BenchResult ArrayResults[IMAGE2GB_BENCH_STAGE_COUNT] = {{0}}; /**< Measurement of every stage. */
+			guint UItileTotal = 0; /**< Number of tiles in the image. */
+
+			image2gb_context_set_size(Pcontext, UIwidth, UIheight);
+			image2gb_alloc_tiles(Pcontext);
+
+			UItileTotal = (Pcontext->tileWidth * Pcontext->tileHeight);
+
+			image2gb_bench_generate(Ppixels, Pcontext->tileWidth, Pcontext->tileHeight, pattern);
+
+			// The stages run in order, as every one needs the result of the
+			// previous ones (the writers need the duplicates removed).
+			for (guint stage = 0; Bsuccess && (stage < IMAGE2GB_BENCH_STAGE_COUNT); stage++)
+				Bsuccess = image2gb_bench_stage(Pcontext, Ppixels, stage, Sfolder, IoptionIterations, & ArrayResults[stage]);
+
+			if (! Bsuccess)
+			{
+				image2gb_context_free(Pcontext);
+
+				break;
+			}
+
+			g_print("%ux%u %s: %u tiles, %u unique\n", UIwidth, UIheight, ArrayBenchPatternNames[pattern], UItileTotal, Pcontext->tileCount);
+
+			g_string_append_printf(Sjson, "%s\n    {\"width\": %u, \"height\": %u, \"pattern\": \"%s\", \"tiles\": %u, \"unique_tiles\": %u, \"stages\": {",
+			                       ((size == 0) && (pattern == 0)) ? "" : ",", UIwidth, UIheight, ArrayBenchPatternNames[pattern], UItileTotal, Pcontext->tileCount);
+
+			for (guint stage = 0; stage < IMAGE2GB_BENCH_STAGE_COUNT; stage++)
+			{
+				gdouble DnsPerTile = ((ArrayResults[stage].time * 1000.0) / UItileTotal); /**< Nanoseconds per tile. */
+				gdouble DmbPerSecond = (ArrayResults[stage].bytes / MAX(ArrayResults[stage].time, 0.001)); /**< Bytes per microsecond are MB/s. */
+
+				g_print("  %-16s %12.3f ms %10.2f ns/tile %10.2f MB/s (%u runs)\n", ArrayBenchStageNames[stage],
+				        (ArrayResults[stage].time / 1000.0), DnsPerTile, DmbPerSecond, ArrayResults[stage].iterations);
+
+				g_string_append_printf(Sjson, "%s\n      \"%s\": {\"iterations\": %u, \"ms\": %.3f, \"ns_per_tile\": %.3f, \"mb_per_s\": %.3f}",
+				                       (stage == 0) ? "" : ",", ArrayBenchStageNames[stage], ArrayResults[stage].iterations,
+				                       (ArrayResults[stage].time / 1000.0), DnsPerTile, DmbPerSecond);
+			}
+
+			g_string_append(Sjson, "\n    }}");
+
+			image2gb_context_free(Pcontext);
+		}
+
+		g_free(Ppixels);
+
+		if (! Bsuccess)
+			break;
+	}
+
+	g_string_append(Sjson, "\n  ]\n}\n");
+
+	if ((SoptionOutput != NULL) && (! g_file_set_contents(SoptionOutput, Sjson->str, Sjson->len, & Gerror)))
+	{
+		g_printerr("%s: could not write %s (%s).\n", IMAGE2GB_BENCH_BINARY_NAME, SoptionOutput, Gerror->message);
+
+		g_clear_error(& Gerror);
+
+		Bsuccess = FALSE;
+	}
+
+	g_rmdir(Sfolder);
+
+	g_free(Sfolder);
+	g_string_free(Sjson, TRUE);
+	g_array_free(GarraySizes, TRUE);
+
+	return Bsuccess ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static gboolean
+image2gb_bench_parse_sizes(const gchar* Ssizes, GArray* GarraySizes)
+{
+	gchar** ArraySizes = g_strsplit(Ssizes, ",", -1); /**< Every size, as written. */
+	gboolean Bsuccess = TRUE; /**< Return value. */
+
+	for (guint size = 0; Bsuccess && (ArraySizes[size] != NULL); size++)
+	{
+		guint UIwidth = 0; /**< Width of the image, in pixels. */
+		guint UIheight = 0; /**< Height of the image, in pixels. */
+		gchar cExtra = '\0'; /**< Anything after the size (there should be nothing). */
+		gint Ifields = sscanf(ArraySizes[size], "%ux%u%c", & UIwidth, & UIheight, & cExtra); /**< Fields read. */
+
+		// A single number is a square.
+		if (Ifields == 1)
+			UIheight = UIwidth;
+
+		// There is no upper limit: sizes beyond the export limit can be
+		// measured too, as long as they fit in memory.
+		if (((Ifields != 1) && (Ifields != 2)) || (UIwidth == 0) || (UIheight == 0)
+		    || ((UIwidth % IMAGE2GB_TILE_SIZE) != 0) || ((UIheight % IMAGE2GB_TILE_SIZE) != 0)
+		    || (((guint64) UIwidth * UIheight / (IMAGE2GB_TILE_SIZE * IMAGE2GB_TILE_SIZE)) > G_MAXINT))
+		{
+			g_printerr("%s: invalid size %s (it should be N or WxH, multiples of %d).\n", IMAGE2GB_BENCH_BINARY_NAME, ArraySizes[size], IMAGE2GB_TILE_SIZE);
+
+			Bsuccess = FALSE;
+		}
+		else
+		{
+			g_array_append_val(GarraySizes, UIwidth);
+			g_array_append_val(GarraySizes, UIheight);
+		}
+	}
+
+	g_strfreev(ArraySizes);
+
+	return Bsuccess;
+}
+
+static void
+image2gb_bench_generate(guchar* Ppixels, guint UItileWidth, guint UItileHeight, BenchPattern Epattern)
+{
+	gsize UIrowstride = ((gsize) UItileWidth * IMAGE2GB_TILE_SIZE); /**< Width of the image, in pixels. */
+
+	// Every tile is drawn from a seed: its own position (unique), the position
+	// of a random earlier tile for every other tile (half), or always the same.
+	// The 64 pixels of 2 bits are the 128 bits of 2 random numbers, so
+	// different seeds give different tiles.
+	for (guint tile = 0; tile < (UItileWidth * UItileHeight); tile++)
+	{
+		guint64 ULseed = 0; /**< Seed of the tile. */
+		guint64 ArrayBits[2] = {0}; /**< Pixels of the tile, 2 bits each. */
+		guchar* PtilePixels = Ppixels + ((tile / UItileWidth) * IMAGE2GB_TILE_SIZE * UIrowstride) + ((tile % UItileWidth) * IMAGE2GB_TILE_SIZE); /**< First pixel of the tile. */
+
+		if (Epattern == IMAGE2GB_BENCH_UNIQUE)
+			ULseed = tile;
+		else if (Epattern == IMAGE2GB_BENCH_HALF)
+			ULseed = ((tile % 2) == 0) ? tile : (2 * (image2gb_bench_random(tile) % ((tile + 1) / 2)));
+
+		ArrayBits[0] = image2gb_bench_random(2 * ULseed);
+		ArrayBits[1] = image2gb_bench_random((2 * ULseed) + 1);
+
+		for (guint pixel = 0; pixel < (IMAGE2GB_TILE_SIZE * IMAGE2GB_TILE_SIZE); pixel++)
+			PtilePixels[((pixel / IMAGE2GB_TILE_SIZE) * UIrowstride) + (pixel % IMAGE2GB_TILE_SIZE)] = ((ArrayBits[pixel / 32] >> (2 * (pixel % 32))) & 3);
+	}
+}
+
+static guint64
+image2gb_bench_random(guint64 ULseed)
+{
+	// SplitMix64.
+	guint64 ULvalue = (ULseed + G_GUINT64_CONSTANT(0x9E3779B97F4A7C15)); /**< Return value. */
+
+	ULvalue = ((ULvalue ^ (ULvalue >> 30)) * G_GUINT64_CONSTANT(0xBF58476D1CE4E5B9));
+	ULvalue = ((ULvalue ^ (ULvalue >> 27)) * G_GUINT64_CONSTANT(0x94D049BB133111EB));
+
+	return (ULvalue ^ (ULvalue >> 31));
+}
+
+static gboolean
+image2gb_bench_stage(ExportContext* Pcontext, const guchar* Ppixels, BenchStage Estage, const gchar* Sfolder, guint UIiterations, BenchResult* Presult)
+{
+	gchar* SfileName = g_build_filename(Sfolder, ArrayBenchStageNames[Estage], NULL); /**< File written by the stage, if any. */
+	gint64 ItimeTotal = 0; /**< Time spent by all the runs, in microseconds. */
+
+	// Slow stages (big images) are not run that many times.
+	memset(Presult, 0, sizeof(BenchResult));
+
+	while ((Presult->iterations < UIiterations) && ((Presult->iterations == 0) || (ItimeTotal < IMAGE2GB_BENCH_TIME_MIN)))
+	{
+		gint64 ItimeStart = g_get_monotonic_time(); /**< When the run started. */
+
+		Presult->bytes = image2gb_bench_stage_once(Pcontext, Ppixels, Estage, SfileName);
+
+		ItimeTotal += (g_get_monotonic_time() - ItimeStart);
+		Presult->iterations++;
+
+		// The file is deleted, so the next run writes it again (instead of
+		// comparing the output with it).
+		g_remove(SfileName);
+
+		if (Presult->bytes == 0)
+		{
+			g_free(SfileName);
+
+			return FALSE;
+		}
+	}
+
+	Presult->time = ((gdouble) ItimeTotal / Presult->iterations);
+
+	g_free(SfileName);
+
+	return TRUE;
+}
+
+static guint64
+image2gb_bench_stage_once(ExportContext* Pcontext, const guchar* Ppixels, BenchStage Estage, const gchar* SfileName)
+{
+	guint UItileTotal = (Pcontext->tileWidth * Pcontext->tileHeight); /**< Number of tiles in the image. */
+	guint UIrowstride = (Pcontext->tileWidth * IMAGE2GB_TILE_SIZE); /**< Width of the image, in pixels. */
+	guint64 ULwrittenBefore = Pcontext->stats.bytesWritten; /**< Bytes written by the previous runs. */
+	OutputWriter StructWriter = {0}; /**< Buffers the contents of the file being written. */
+
+	switch (Estage)
+	{
+		case IMAGE2GB_BENCH_READ_TILE:
+			for (guint tile = 0; tile < UItileTotal; tile++)
+				image2gb_read_tile(Ppixels + ((gsize)(tile / Pcontext->tileWidth) * IMAGE2GB_TILE_SIZE * UIrowstride) + ((tile % Pcontext->tileWidth) * IMAGE2GB_TILE_SIZE),
+				                   UIrowstride, Pcontext->tiles + tile);
+
+			return ((guint64) UItileTotal * IMAGE2GB_TILE_SIZE * IMAGE2GB_TILE_SIZE);
+
+		case IMAGE2GB_BENCH_PACK:
+			image2gb_pack_tiles(Ppixels, UIrowstride, Pcontext->tileWidth, Pcontext->tileHeight, Pcontext->tiles);
+
+			return ((guint64) UItileTotal * IMAGE2GB_TILE_SIZE * IMAGE2GB_TILE_SIZE);
+
+		case IMAGE2GB_BENCH_DEDUPE:
+			image2gb_check_duplicates(Pcontext, NULL);
+
+			return ((guint64) UItileTotal * IMAGE2GB_TILE_BYTES);
+
+		default:
+			if (! image2gb_writer_open(& StructWriter, SfileName, FALSE, & Pcontext->stats))
+				return 0;
+
+			if (Estage == IMAGE2GB_BENCH_WRITE_TILE_DATA)
+				image2gb_write_tile_data(Pcontext, & StructWriter);
+			else if (! image2gb_write_tilemap(Pcontext, & StructWriter))
+			{
+				image2gb_writer_close(& StructWriter);
+				return 0;
+			}
+
+			if (! image2gb_writer_close(& StructWriter))
+				return 0;
+
+			return (Pcontext->stats.bytesWritten - ULwrittenBefore);
+	}
+}
+
+static void
+image2gb_bench_json_string(GString* Sjson, const gchar* Stext)
+{
+	g_string_append_c(Sjson, '"');
+
+	// Quotes and backslashes are escaped, control characters dropped.
+	for (const gchar* Pchar = Stext; (* Pchar) != '\0'; Pchar++)
+	{
+		if (((* Pchar) == '"') || ((* Pchar) == '\\'))
+			g_string_append_c(Sjson, '\\');
+
+		if ((guchar)(* Pchar) >= ' ')
+			g_string_append_c(Sjson, (* Pchar));
+	}
+
+	g_string_append_c(Sjson, '"');
+}
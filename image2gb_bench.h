@@ -0,0 +1,112 @@
+/**
+ * @file  image2gb_bench.h
+ * @brief Benchmark of the conversion stages (tile reading, packing, deduplication and writing) on synthetic images - header.
+ */
+
+#pragma once
+
+#include "image_convert.h" // The conversion being measured.
+
+// Ignore warnings in external libraries (GLib...).
+#pragma GCC system_header
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_BENCH_BINARY_NAME "image2gb-bench" /**< Name of the output binary. */
+#define IMAGE2GB_BENCH_SUMMARY     "Times the stages of the conversion (tile reading, packing, deduplication and writing) on\n" \
+                                   "synthetic indexed images of several sizes, with all tiles unique, half of them repeated,\n" \
+                                   "or a single tile repeated all over. Reports ns per tile and MB/s, and saves them as JSON."
+
+#define IMAGE2GB_BENCH_SIZES_DEFAULT      "8,64,512,2048,8192,32768" /**< Image sizes measured, unless told otherwise (up to the export limit). */
+#define IMAGE2GB_BENCH_ITERATIONS_DEFAULT 10                         /**< Maximum number of times each stage is run, unless told otherwise. */
+#define IMAGE2GB_BENCH_TIME_MIN           250000                     /**< A stage is run again until it took this long in total (microseconds), or the iterations are done. */
+#define IMAGE2GB_BENCH_JSON_VERSION       1                          /**< Version of the JSON results format. */
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** Stages of the conversion that are timed, in order.
+ */
+typedef enum BenchStage
+{
+	IMAGE2GB_BENCH_READ_TILE, /**< image2gb_read_tile() on every tile, in a single thread. */
+	IMAGE2GB_BENCH_PACK, /**< image2gb_pack_tiles(), in parallel (what the export does). */
+	IMAGE2GB_BENCH_DEDUPE, /**< image2gb_check_duplicates(). */
+	IMAGE2GB_BENCH_WRITE_TILE_DATA, /**< image2gb_write_tile_data(), to a temporary file. */
+	IMAGE2GB_BENCH_WRITE_TILEMAP, /**< image2gb_write_tilemap(), to a temporary file. */
+	IMAGE2GB_BENCH_STAGE_COUNT /**< Number of stages. */
+} BenchStage;
+
+/** How the tiles of a synthetic image repeat.
+ */
+typedef enum BenchPattern
+{
+	IMAGE2GB_BENCH_UNIQUE, /**< All tiles are different. */
+	IMAGE2GB_BENCH_HALF, /**< Every other tile is a copy of an earlier one. */
+	IMAGE2GB_BENCH_SINGLE, /**< The same tile everywhere. */
+	IMAGE2GB_BENCH_PATTERN_COUNT /**< Number of patterns. */
+} BenchPattern;
+
+/** Object that stores the measurement of a stage.
+ */
+typedef struct BenchResult
+{
+	guint iterations; /**< Times the stage was run. */
+	gdouble time; /**< Average time of a run, in microseconds. */
+	guint64 bytes; /**< Bytes processed by a run (pixels read, tiles deduplicated or output written). */
+} BenchResult;
+
+// VARIABLES ///////////////////////////////////////////////////////////////////
+
+/** Names of the stages, as they appear in the report and the JSON results.
+ */
+static const gchar* const ArrayBenchStageNames[IMAGE2GB_BENCH_STAGE_COUNT] = {"read_tile", "pack", "dedupe", "write_tile_data", "write_tilemap"};
+
+/** Names of the patterns, as they appear in the report and the JSON results.
+ */
+static const gchar* const ArrayBenchPatternNames[IMAGE2GB_BENCH_PATTERN_COUNT] = {"unique", "half", "single"};
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Entry point: parses the options, runs the benchmark and reports it.
+ */
+int
+main(int argc, char* argv[]);
+
+/** Parses a comma separated list of image sizes ("N" for NxN, or "WxH", in
+ *  pixels, multiples of 8) into GarraySizes (pairs of guint). Returns TRUE if
+ *  success, FALSE otherwise (the error is reported).
+ */
+static gboolean
+image2gb_bench_parse_sizes(const gchar* Ssizes, GArray* GarraySizes);
+
+/** Fills the pixels of a synthetic image of UItileWidth x UItileHeight tiles
+ *  (one byte per pixel, values 0 to 3) with the given pattern.
+ */
+static void
+image2gb_bench_generate(guchar* Ppixels, guint UItileWidth, guint UItileHeight, BenchPattern Epattern);
+
+/** Returns a pseudorandom number, always the same for the same seed.
+ */
+static guint64
+image2gb_bench_random(guint64 ULseed);
+
+/** Runs a stage on the image in the context (its pixels being Ppixels) up to
+ *  UIiterations times, writing to files in Sfolder, and stores the average in
+ *  Presult. Returns TRUE if success, FALSE otherwise (the error is reported).
+ */
+static gboolean
+image2gb_bench_stage(ExportContext* Pcontext, const guchar* Ppixels, BenchStage Estage, const gchar* Sfolder, guint UIiterations, BenchResult* Presult);
+
+/** Runs a stage once (writers write to SfileName). Returns the bytes it
+ *  processed (see BenchResult), or 0 if it failed.
+ */
+static guint64
+image2gb_bench_stage_once(ExportContext* Pcontext, const guchar* Ppixels, BenchStage Estage, const gchar* SfileName);
+
+/** Appends the given text to Sjson as a JSON string (quoted and escaped).
+ */
+static void
+image2gb_bench_json_string(GString* Sjson, const gchar* Stext);
@@ -0,0 +1,931 @@
+/**
+ * @file  image2gb_cli.c
+ * @brief Command line tool to export images to Game Boy data without GIMP (same output as the plugin) - implementation.
+ */
+
+#include "image2gb_cli.h"
+
+// VARIABLES ///////////////////////////////////////////////////////////////////
+
+gchar* SoptionOutput = NULL; /**< Folder to save to (--output), NULL for the folder of every image. */
+
+gchar* SoptionName = NULL; /**< Asset name (--name), NULL for using the file name. */
+
+gint IoptionBank = 0; /**< ROM bank number (--bank). */
+
+gchar* SoptionFormat = NULL; /**< Output format (--format), "source" or "binary". */
+
+gint IoptionTileBase = 0; /**< VRAM tile slot the tiles are loaded at (--tile-base). */
+
+gchar* SoptionCompression = NULL; /**< Compression of the tile data and map (--compression), "none", "rle" or "lz". */
+
+gint IoptionUploadBudget = 0; /**< Bytes of tile data copied to VRAM per frame, for the upload table (--upload-budget), 0 for none. */
+
+gchar* SoptionLayout = NULL; /**< Order of the tilemap entries (--layout), "rows", "columns" or "vram". */
+
+gboolean BoptionAnimation = FALSE; /**< Export all the images as the frames of one animation (--animation). */
+
+gchar** ArrayInputs = NULL; /**< Images to export (the rest of the command line). */
+
+gchar* SoptionProject = NULL; /**< Project manifest to build (--project), NULL for exporting the images given. */
+
+gboolean BoptionForce = FALSE; /**< Build all the assets of the project, changed or not (--force). */
+
+gint IoptionJobs = 0; /**< Assets of the project built at once (--jobs), 0 for one per processor. */
+
+gboolean BoptionDepfile = FALSE; /**< Write a depfile and a stamp file along with every asset (--depfile). */
+
+/** Group of the asset the current thread is building, for the messages (NULL
+ *  outside of a project build).
+ */
+static GPrivate PprojectGroup = G_PRIVATE_INIT(NULL);
+
+/** Command line options, for GLib to parse.
+ */
+GOptionEntry ArrayOptions[] = {{"output", 'o', 0, G_OPTION_ARG_FILENAME, & SoptionOutput, "Folder to save to (default: the folder of every image)", "FOLDER"},
+                               {"name", 'n', 0, G_OPTION_ARG_STRING, & SoptionName, "Asset name (default: the file name); only with a single image", "NAME"},
+                               {"bank", 'b', 0, G_OPTION_ARG_INT, & IoptionBank, "ROM bank number to store the asset in (default: 0)", "BANK"},
+                               {"format", 'f', 0, G_OPTION_ARG_STRING, & SoptionFormat, "Output format: source (.c, default) or binary (.2bpp and .tilemap)", "FORMAT"},
+                               {"tile-base", 't', 0, G_OPTION_ARG_INT, & IoptionTileBase, "VRAM tile slot the tiles are loaded at, added to the map (default: 0)", "TILE"},
+                               {"compression", 'c', 0, G_OPTION_ARG_STRING, & SoptionCompression, "Compress the tile data and map: none (default), rle or lz", "METHOD"},
+                               {"upload-budget", 'u', 0, G_OPTION_ARG_INT, & IoptionUploadBudget, "Also write a table that uploads the tiles in chunks of up to BYTES per frame", "BYTES"},
+                               {"layout", 'l', 0, G_OPTION_ARG_STRING, & SoptionLayout, "Order of the map entries: rows (default), columns or vram (rows padded to 32 tiles)", "LAYOUT"},
+                               {"animation", 'a', 0, G_OPTION_ARG_NONE, & BoptionAnimation, "Export all the images as the frames of one animation, named after the first one", NULL},
+                               {"project", 'p', 0, G_OPTION_ARG_FILENAME, & SoptionProject, "Build the assets of a project manifest that changed since the last build", "MANIFEST"},
+                               {"force", 'B', 0, G_OPTION_ARG_NONE, & BoptionForce, "With --project, build all the assets, changed or not", NULL},
+                               {"jobs", 'j', 0, G_OPTION_ARG_INT, & IoptionJobs, "With --project, assets built at once (default: one per processor)", "JOBS"},
+                               {"depfile", 'd', 0, G_OPTION_ARG_NONE, & BoptionDepfile, "Also write a make/ninja depfile (.d) and a stamp file (.stamp) for every asset", NULL},
+                               {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, & ArrayInputs, NULL, IMAGE2GB_CLI_PARAMETERS},
+                               {NULL}
+                              };
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+int
+main(int argc, char* argv[])
+{
+	GOptionContext* Gcontext = NULL; /**< Command line parser. */
+	GError* Gerror = NULL; /**< Error parsing the command line, if any. */
+	PluginExportOptions StructExportOptions = {0}; /**< Export parameters of the current image. */
+	guint UIfailures = 0; /**< Images that could not be exported. */
+
+	g_set_prgname(IMAGE2GB_CLI_BINARY_NAME);
+	g_log_set_handler(NULL, G_LOG_LEVEL_MESSAGE, image2gb_cli_log, NULL);
+
+	Gcontext = g_option_context_new(NULL); // The images are described by the last entry of ArrayOptions.
+	g_option_context_set_summary(Gcontext, IMAGE2GB_CLI_SUMMARY);
+	g_option_context_add_main_entries(Gcontext, ArrayOptions, NULL);
+
+	if (! g_option_context_parse(Gcontext, & argc, & argv, & Gerror))
+	{
+		g_printerr("%s: %s\n", IMAGE2GB_CLI_BINARY_NAME, Gerror->message);
+
+		g_clear_error(& Gerror);
+		g_option_context_free(Gcontext);
+
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(Gcontext);
+
+	// A project takes its images and options from the manifest.
+	if (SoptionProject != NULL)
+	{
+		if ((ArrayInputs != NULL) || (SoptionOutput != NULL) || (SoptionName != NULL) || (IoptionBank != 0) || (SoptionFormat != NULL) ||
+		    (IoptionTileBase != 0) || (SoptionCompression != NULL) || (IoptionUploadBudget != 0) || (SoptionLayout != NULL) || BoptionAnimation)
+		{
+			g_printerr("%s: --project takes the images and their options from the manifest.\n", IMAGE2GB_CLI_BINARY_NAME);
+
+			return EXIT_FAILURE;
+		}
+
+		if (IoptionJobs < 0)
+		{
+			g_printerr("%s: the number of jobs should be 0 (one per processor) or more.\n", IMAGE2GB_CLI_BINARY_NAME);
+
+			return EXIT_FAILURE;
+		}
+
+		return image2gb_cli_project(SoptionProject) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Check the options before exporting anything.
+	if ((ArrayInputs == NULL) || (ArrayInputs[0] == NULL))
+	{
+		g_printerr("%s: no images given (see --help).\n", IMAGE2GB_CLI_BINARY_NAME);
+
+		return EXIT_FAILURE;
+	}
+
+	if ((SoptionName != NULL) && (ArrayInputs[1] != NULL) && (! BoptionAnimation))
+	{
+		g_printerr("%s: --name can only be used with a single image.\n", IMAGE2GB_CLI_BINARY_NAME);
+
+		return EXIT_FAILURE;
+	}
+
+	if ((SoptionName != NULL) && ((SoptionName[0] == '\0') || (strlen(SoptionName) > (IMAGE2GB_ASSET_NAME_MAX_LENGTH - 4))))
+	{
+		g_printerr("%s: the asset name should have between 1 and %d characters.\n",
+		           IMAGE2GB_CLI_BINARY_NAME, (IMAGE2GB_ASSET_NAME_MAX_LENGTH - 4));
+
+		return EXIT_FAILURE;
+	}
+
+	if ((IoptionBank < 0) || (IoptionBank > IMAGE2GB_CLI_BANK_MAX))
+	{
+		g_printerr("%s: the ROM bank number should be between 0 and %d.\n", IMAGE2GB_CLI_BINARY_NAME, IMAGE2GB_CLI_BANK_MAX);
+
+		return EXIT_FAILURE;
+	}
+
+	if ((IoptionTileBase < 0) || (IoptionTileBase > IMAGE2GB_TILE_BASE_MAX))
+	{
+		g_printerr("%s: the tile base should be between 0 and %d.\n", IMAGE2GB_CLI_BINARY_NAME, IMAGE2GB_TILE_BASE_MAX);
+
+		return EXIT_FAILURE;
+	}
+
+	if ((IoptionUploadBudget < 0) || (IoptionUploadBudget > IMAGE2GB_UPLOAD_BUDGET_MAX))
+	{
+		g_printerr("%s: the upload budget should be between 0 and %d bytes.\n", IMAGE2GB_CLI_BINARY_NAME, IMAGE2GB_UPLOAD_BUDGET_MAX);
+
+		return EXIT_FAILURE;
+	}
+
+	if ((SoptionFormat != NULL) && (strcmp(SoptionFormat, "source") != 0) && (strcmp(SoptionFormat, "binary") != 0))
+	{
+		g_printerr("%s: unknown format %s (it should be source or binary).\n", IMAGE2GB_CLI_BINARY_NAME, SoptionFormat);
+
+		return EXIT_FAILURE;
+	}
+
+	if ((SoptionCompression != NULL) && (image2gb_compression_from_name(SoptionCompression) < 0))
+	{
+		g_printerr("%s: unknown compression %s (it should be none, rle or lz).\n", IMAGE2GB_CLI_BINARY_NAME, SoptionCompression);
+
+		return EXIT_FAILURE;
+	}
+
+	if ((SoptionLayout != NULL) && (image2gb_layout_from_name(SoptionLayout) < 0))
+	{
+		g_printerr("%s: unknown layout %s (it should be rows, columns or vram).\n", IMAGE2GB_CLI_BINARY_NAME, SoptionLayout);
+
+		return EXIT_FAILURE;
+	}
+
+	// Frames only change part of the map, which the compressed and binary
+	// outputs do not describe.
+	if (BoptionAnimation && (((SoptionFormat != NULL) && (strcmp(SoptionFormat, "source") != 0)) ||
+	                         ((SoptionCompression != NULL) && (strcmp(SoptionCompression, "none") != 0)) || (IoptionUploadBudget != 0) ||
+	                         ((SoptionLayout != NULL) && (strcmp(SoptionLayout, "rows") != 0))))
+	{
+		g_printerr("%s: --animation is always exported as uncompressed source, without an upload table, with the map in rows.\n", IMAGE2GB_CLI_BINARY_NAME);
+
+		return EXIT_FAILURE;
+	}
+
+	if ((SoptionOutput != NULL) && (g_mkdir_with_parents(SoptionOutput, 0755) != 0))
+	{
+		g_printerr("%s: could not create folder %s (%s).\n", IMAGE2GB_CLI_BINARY_NAME, SoptionOutput, g_strerror(errno));
+
+		return EXIT_FAILURE;
+	}
+
+	// All the images make one asset, named after the first one.
+	if (BoptionAnimation)
+	{
+		if (! image2gb_cli_options(ArrayInputs[0], & StructExportOptions))
+			return EXIT_FAILURE;
+
+		return image2gb_cli_animation(ArrayInputs, & StructExportOptions) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// A failed image does not stop the rest, but it is reported at the end.
+	for (guint input = 0; ArrayInputs[input] != NULL; input++)
+	{
+		memset(& StructExportOptions, 0, sizeof(StructExportOptions));
+
+		if ((! image2gb_cli_options(ArrayInputs[input], & StructExportOptions))
+		    || (! image2gb_cli_export(ArrayInputs[input], & StructExportOptions, NULL)))
+			UIfailures++;
+	}
+
+	if (UIfailures > 0)
+		g_printerr("%s: %u of %u images could not be exported.\n",
+		           IMAGE2GB_CLI_BINARY_NAME, UIfailures, g_strv_length(ArrayInputs));
+
+	return (UIfailures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static gboolean
+image2gb_cli_options(const gchar* SfileName, PluginExportOptions* PexportOptions)
+{
+	gchar* Sfolder = NULL; /**< Folder to save to. */
+
+	// Same parameters the plugin would get from its dialog.
+	if (SoptionName != NULL)
+		strcpy(PexportOptions->name, SoptionName);
+	else
+		image2gb_make_asset_name(SfileName, PexportOptions->name);
+
+	Sfolder = (SoptionOutput != NULL) ? g_strdup(SoptionOutput) : g_path_get_dirname(SfileName);
+
+	if (strlen(Sfolder) >= sizeof(PexportOptions->folder))
+	{
+		g_message("%s: the output folder name is too long.\n", SfileName);
+
+		g_free(Sfolder);
+
+		return FALSE;
+	}
+
+	strcpy(PexportOptions->folder, Sfolder);
+	PexportOptions->bank = IoptionBank;
+	PexportOptions->format = ((SoptionFormat != NULL) && (strcmp(SoptionFormat, "binary") == 0)) ? IMAGE2GB_FORMAT_BINARY : IMAGE2GB_FORMAT_SOURCE;
+	PexportOptions->tileBase = IoptionTileBase;
+	PexportOptions->compression = (SoptionCompression != NULL) ? image2gb_compression_from_name(SoptionCompression) : IMAGE2GB_COMPRESSION_NONE;
+	PexportOptions->uploadBudget = IoptionUploadBudget;
+	PexportOptions->mapLayout = (SoptionLayout != NULL) ? image2gb_layout_from_name(SoptionLayout) : IMAGE2GB_LAYOUT_ROWS;
+
+	g_free(Sfolder);
+
+	return TRUE;
+}
+
+static gboolean
+image2gb_cli_export(const gchar* SfileName, const PluginExportOptions* PexportOptions, gchar** ArrayDependencies)
+{
+	IndexedImage StructImage = {0}; /**< Pixels of the image. */
+	ExportContext* Pcontext = NULL; /**< State of this export. */
+	gint64 ItimeStart = 0; /**< When the stage being timed started. */
+	gboolean Bsuccess = TRUE; /**< Return value. */
+
+	// Load, convert and write, like image2gb_export_image() does.
+	Pcontext = image2gb_context_new(PexportOptions);
+
+	if (BoptionDepfile)
+	{
+		image2gb_context_add_dependency(Pcontext, SfileName);
+
+		for (guint file = 0; (ArrayDependencies != NULL) && (ArrayDependencies[file] != NULL); file++)
+			image2gb_context_add_dependency(Pcontext, ArrayDependencies[file]);
+	}
+
+	ItimeStart = g_get_monotonic_time();
+
+	Bsuccess = image2gb_load_image(SfileName, & StructImage, & Pcontext->stats);
+
+	image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_READ, ItimeStart);
+
+	if (Bsuccess)
+		Bsuccess = image2gb_cli_check_image(SfileName, & StructImage);
+
+	if (Bsuccess)
+		Bsuccess = image2gb_context_convert(Pcontext, StructImage.pixels, StructImage.width, StructImage.height, StructImage.width);
+
+	image2gb_free_image(& StructImage);
+
+	if (Bsuccess)
+		Bsuccess = image2gb_context_emit(Pcontext);
+
+	image2gb_context_free(Pcontext);
+
+	return Bsuccess;
+}
+
+static gboolean
+image2gb_cli_animation(gchar** ArrayFrames, const PluginExportOptions* PexportOptions)
+{
+	guint UIframes = g_strv_length(ArrayFrames); /**< Number of frames. */
+	IndexedImage StructFrame = {0}; /**< Pixels of the frame being loaded. */
+	guint UIwidth = 0; /**< Width of the frames, in pixels. */
+	guint UIheight = 0; /**< Height of the frames, in pixels. */
+	guchar* Ppixels = NULL; /**< Pixels of all frames, one after another. */
+	ExportContext* Pcontext = NULL; /**< State of this export. */
+	gint64 ItimeStart = 0; /**< When the stage being timed started. */
+	gboolean Bsuccess = TRUE; /**< Return value. */
+
+	Pcontext = image2gb_animation_new(PexportOptions);
+
+	ItimeStart = g_get_monotonic_time();
+
+	// Every frame should be a valid image of the same size as the first one.
+	for (guint frame = 0; Bsuccess && (frame < UIframes); frame++)
+	{
+		if (BoptionDepfile)
+			image2gb_context_add_dependency(Pcontext, ArrayFrames[frame]);
+
+		Bsuccess = image2gb_load_image(ArrayFrames[frame], & StructFrame, & Pcontext->stats);
+
+		if (Bsuccess)
+			Bsuccess = image2gb_cli_check_image(ArrayFrames[frame], & StructFrame);
+
+		if (Bsuccess && (frame == 0))
+		{
+			UIwidth = StructFrame.width;
+			UIheight = StructFrame.height;
+			Bsuccess = image2gb_animation_check(ArrayFrames[0], UIwidth, UIheight, UIframes);
+
+			if (Bsuccess)
+				Ppixels = g_new(guchar, ((gsize) UIwidth * UIheight * UIframes));
+		}
+		else if (Bsuccess && ((StructFrame.width != UIwidth) || (StructFrame.height != UIheight)))
+		{
+			g_message("%s: all frames should have the same size as the first one (%ux%u pixels).\n", ArrayFrames[frame], UIwidth, UIheight);
+
+			Bsuccess = FALSE;
+		}
+
+		if (Bsuccess)
+			memcpy((Ppixels + ((gsize) UIwidth * UIheight * frame)), StructFrame.pixels, ((gsize) UIwidth * UIheight));
+
+		image2gb_free_image(& StructFrame);
+	}
+
+	image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_READ, ItimeStart);
+
+	if (Bsuccess)
+		Bsuccess = image2gb_animation_convert(Pcontext, Ppixels, UIwidth, UIheight, UIframes);
+
+	g_free(Ppixels);
+
+	if (Bsuccess)
+		Bsuccess = image2gb_animation_emit(Pcontext, UIframes);
+
+	image2gb_context_free(Pcontext);
+
+	return Bsuccess;
+}
+
+static gboolean
+image2gb_cli_check_image(const gchar* SfileName, const IndexedImage* Pimage)
+{
+	// Check that size is between 8x8 (1 tile) and 32768x32768 (4096x4096 tiles).
+	if ((Pimage->width < IMAGE2GB_IMAGE_SIZE_MIN) || (Pimage->width > IMAGE2GB_IMAGE_SIZE_MAX)
+	    || (Pimage->height < IMAGE2GB_IMAGE_SIZE_MIN) || (Pimage->height > IMAGE2GB_IMAGE_SIZE_MAX))
+	{
+		g_message("%s: image size should be between %dx%d and %dx%d pixels.\n", SfileName,
+		          IMAGE2GB_IMAGE_SIZE_MIN, IMAGE2GB_IMAGE_SIZE_MIN,
+		          IMAGE2GB_IMAGE_SIZE_MAX, IMAGE2GB_IMAGE_SIZE_MAX);
+
+		return FALSE;
+	}
+
+	// Also, size should be a multiple of 8 (whole tiles).
+	if (((Pimage->width % IMAGE2GB_TILE_SIZE) != 0) || ((Pimage->height % IMAGE2GB_TILE_SIZE) != 0))
+	{
+		g_message("%s: both width and height should be multiples of %d.\n", SfileName, IMAGE2GB_TILE_SIZE);
+
+		return FALSE;
+	}
+
+	// There is no colormap to check, so check the pixels themselves.
+	for (gsize p = 0; p < ((gsize) Pimage->width * Pimage->height); p++)
+	{
+		if (Pimage->pixels[p] > IMAGE2GB_COLOR_MAX)
+		{
+			g_message("%s: the image should be 4-color only, but pixel (%u, %u) has color %u.\n", SfileName,
+			          (guint)(p % Pimage->width), (guint)(p / Pimage->width), Pimage->pixels[p]);
+
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+image2gb_cli_project(const gchar* SmanifestName)
+{
+	GKeyFile* Gmanifest = g_key_file_new(); /**< Assets to build. */
+	GKeyFile* Gstate = g_key_file_new(); /**< Hashes of the last build (read first, then replaced by those of this one). */
+	GHashTable* GfileTable = g_hash_table_new(g_str_hash, g_str_equal); /**< Input files by path (ProjectFile, owned by GarrayFiles). */
+	GHashTable* GoutputTable = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL); /**< Asset (group) writing every output file name, without extension. */
+	GPtrArray* GarrayFiles = g_ptr_array_new_with_free_func(image2gb_cli_project_free_file); /**< Input files of all assets, once each. */
+	GPtrArray* GarrayAssets = g_ptr_array_new_with_free_func(image2gb_cli_project_free_asset); /**< Assets of the manifest. */
+	GPtrArray* GarrayBuild = g_ptr_array_new(); /**< Assets that have to be built (owned by GarrayAssets). */
+	gchar** ArrayGroups = NULL; /**< Groups of the manifest. */
+	gchar* Sfolder = g_path_get_dirname(SmanifestName); /**< Folder that the paths of the manifest are relative to. */
+	gchar* SstateName = g_strconcat(SmanifestName, IMAGE2GB_CLI_STATE_EXTENSION, NULL); /**< File that stores the last build. */
+	GError* Gerror = NULL; /**< Error reading the manifest or writing the state, if any. */
+	guint UIbuilt = 0; /**< Assets built. */
+	guint UIupToDate = 0; /**< Assets that did not have to be built. */
+	guint UIfailed = 0; /**< Assets that could not be built. */
+	gboolean Bsuccess = TRUE; /**< Return value. */
+
+	if (! g_key_file_load_from_file(Gmanifest, SmanifestName, G_KEY_FILE_NONE, & Gerror))
+	{
+		g_message("%s: %s\n", SmanifestName, Gerror->message);
+
+		g_clear_error(& Gerror);
+		Bsuccess = FALSE;
+	}
+
+	// Every group is an asset, except the one with the defaults. A broken
+	// manifest builds nothing, but all of its errors are reported.
+	if (Bsuccess)
+	{
+		ArrayGroups = g_key_file_get_groups(Gmanifest, NULL);
+
+		for (guint group = 0; ArrayGroups[group] != NULL; group++)
+		{
+			ProjectAsset* Passet = NULL; /**< Asset of this group. */
+			gchar* SoutputName = NULL; /**< Output files of the asset, without extension. */
+			gchar* SnameLowercase = NULL; /**< Asset name, all lowercase (as in the output file names). */
+
+			if (strcmp(ArrayGroups[group], IMAGE2GB_CLI_PROJECT_GROUP) == 0)
+				continue;
+
+			Passet = image2gb_cli_project_asset(Gmanifest, ArrayGroups[group], Sfolder, GfileTable, GarrayFiles);
+
+			if (Passet == NULL)
+			{
+				Bsuccess = FALSE;
+
+				continue;
+			}
+
+			g_ptr_array_add(GarrayAssets, Passet);
+
+			// Two assets writing the same files would overwrite each other
+			// (and maybe at the same time).
+			SnameLowercase = g_ascii_strdown(Passet->options.name, -1);
+			SoutputName = g_strdup_printf("%s/%s", Passet->options.folder, SnameLowercase);
+
+			g_free(SnameLowercase);
+
+			if (g_hash_table_contains(GoutputTable, SoutputName))
+			{
+				g_message("%s: assets %s and %s would both write %s.*\n", SmanifestName,
+				          (const gchar*) g_hash_table_lookup(GoutputTable, SoutputName), Passet->group, SoutputName);
+
+				g_free(SoutputName);
+				Bsuccess = FALSE;
+			}
+			else
+				g_hash_table_insert(GoutputTable, SoutputName, Passet->group);
+		}
+	}
+
+	if (Bsuccess)
+	{
+		// With no last build (or a broken one), everything is built.
+		g_key_file_load_from_file(Gstate, SstateName, G_KEY_FILE_NONE, NULL);
+
+		for (guint asset = 0; asset < GarrayAssets->len; asset++)
+		{
+			ProjectAsset* Passet = g_ptr_array_index(GarrayAssets, asset); /**< Asset to look up. */
+
+			Passet->oldHash = g_key_file_get_string(Gstate, Passet->group, "hash", NULL);
+		}
+
+		g_key_file_free(Gstate);
+		Gstate = g_key_file_new();
+
+		// The input files are hashed first, once each however many assets
+		// depend on them; then every asset whose hash changed is built. The
+		// assets do not depend on each other, so all of them can be built at
+		// the same time.
+		image2gb_cli_project_run(image2gb_cli_project_hash_file, GarrayFiles);
+
+		for (guint asset = 0; asset < GarrayAssets->len; asset++)
+		{
+			ProjectAsset* Passet = g_ptr_array_index(GarrayAssets, asset); /**< Asset to check. */
+
+			if (! image2gb_cli_project_hash(Passet))
+				Passet->status = IMAGE2GB_ASSET_FAILED;
+			else if ((! BoptionForce) && (g_strcmp0(Passet->oldHash, Passet->hash) == 0)
+			         && image2gb_cli_project_outputs_exist(& Passet->options))
+				Passet->status = IMAGE2GB_ASSET_UP_TO_DATE;
+			else
+				g_ptr_array_add(GarrayBuild, Passet);
+		}
+
+		image2gb_cli_project_run(image2gb_cli_project_build, GarrayBuild);
+
+		// Only the assets that are up to date go into the state, so the
+		// failed ones are tried again next time.
+		for (guint asset = 0; asset < GarrayAssets->len; asset++)
+		{
+			ProjectAsset* Passet = g_ptr_array_index(GarrayAssets, asset); /**< Asset to count. */
+
+			if (Passet->status == IMAGE2GB_ASSET_BUILT)
+				UIbuilt++;
+			else if (Passet->status == IMAGE2GB_ASSET_UP_TO_DATE)
+				UIupToDate++;
+			else
+				UIfailed++;
+
+			if ((Passet->status == IMAGE2GB_ASSET_BUILT) || (Passet->status == IMAGE2GB_ASSET_UP_TO_DATE))
+				g_key_file_set_string(Gstate, Passet->group, "hash", Passet->hash);
+		}
+
+		if (! g_key_file_save_to_file(Gstate, SstateName, & Gerror))
+		{
+			g_message("%s: %s\n", SstateName, Gerror->message);
+
+			g_clear_error(& Gerror);
+			Bsuccess = FALSE;
+		}
+
+		g_printerr("%s: %u assets: %u built, %u up to date, %u failed.\n",
+		           IMAGE2GB_CLI_BINARY_NAME, GarrayAssets->len, UIbuilt, UIupToDate, UIfailed);
+	}
+
+	g_strfreev(ArrayGroups);
+	g_free(Sfolder);
+	g_free(SstateName);
+	g_ptr_array_free(GarrayBuild, TRUE);
+	g_ptr_array_free(GarrayAssets, TRUE);
+	g_ptr_array_free(GarrayFiles, TRUE);
+	g_hash_table_destroy(GoutputTable);
+	g_hash_table_destroy(GfileTable);
+	g_key_file_free(Gstate);
+	g_key_file_free(Gmanifest);
+
+	return (Bsuccess && (UIfailed == 0));
+}
+
+static ProjectAsset*
+image2gb_cli_project_asset(GKeyFile* Gmanifest, const gchar* Sgroup, const gchar* Sfolder, GHashTable* GfileTable, GPtrArray* GarrayFiles)
+{
+	ProjectAsset* Passet = g_new0(ProjectAsset, 1); /**< Return value. */
+	gchar* Simage = g_key_file_get_string(Gmanifest, Sgroup, "image", NULL); /**< Image to export (only in the asset group). */
+	gchar* Sname = image2gb_cli_project_value(Gmanifest, Sgroup, "name"); /**< Asset name, or NULL for the group name. */
+	gchar* Soutput = image2gb_cli_project_value(Gmanifest, Sgroup, "output"); /**< Folder to save to, or NULL for the folder of the manifest. */
+	gchar* Sbank = image2gb_cli_project_value(Gmanifest, Sgroup, "bank"); /**< ROM bank number, or NULL for 0. */
+	gchar* Sformat = image2gb_cli_project_value(Gmanifest, Sgroup, "format"); /**< Output format, or NULL for source. */
+	gchar* StileBase = image2gb_cli_project_value(Gmanifest, Sgroup, "tile_base"); /**< VRAM tile slot of the tiles, or NULL for 0. */
+	gchar* Scompression = image2gb_cli_project_value(Gmanifest, Sgroup, "compression"); /**< Compression of the data and map, or NULL for none. */
+	gchar* SuploadBudget = image2gb_cli_project_value(Gmanifest, Sgroup, "upload_budget"); /**< Bytes uploaded per frame, or NULL for no upload table. */
+	gchar* Slayout = image2gb_cli_project_value(Gmanifest, Sgroup, "layout"); /**< Order of the map entries, or NULL for rows. */
+	gchar* Sinputs = image2gb_cli_project_value(Gmanifest, Sgroup, "inputs"); /**< Other files the asset depends on (separated by ';'), or NULL. */
+	gchar** ArrayPaths = NULL; /**< Files the asset depends on, as written in the manifest. */
+	gchar* SoutputFolder = NULL; /**< Folder to save to, resolved. */
+	gchar* Send = NULL; /**< End of the ROM bank number (or the tile base, or the upload budget). */
+	gint64 Ibank = 0; /**< ROM bank number. */
+	gint64 ItileBase = 0; /**< VRAM tile slot of the tiles. */
+	gint64 IuploadBudget = 0; /**< Bytes uploaded per frame. */
+	gboolean Bsuccess = TRUE; /**< Whether the group is valid. */
+
+	Passet->group = g_strdup(Sgroup);
+	Passet->files = g_ptr_array_new();
+
+	// Same checks as the options of the command line.
+	if ((Simage == NULL) || (Simage[0] == '\0'))
+	{
+		g_message("asset %s: no image given.\n", Sgroup);
+
+		Bsuccess = FALSE;
+	}
+
+	if (Sname == NULL)
+		image2gb_make_asset_name(Sgroup, Passet->options.name);
+	else if ((Sname[0] != '\0') && (strlen(Sname) <= (IMAGE2GB_ASSET_NAME_MAX_LENGTH - 4)))
+		strcpy(Passet->options.name, Sname);
+	else
+	{
+		g_message("asset %s: the asset name should have between 1 and %d characters.\n", Sgroup, (IMAGE2GB_ASSET_NAME_MAX_LENGTH - 4));
+
+		Bsuccess = FALSE;
+	}
+
+	SoutputFolder = (Soutput != NULL) ? image2gb_cli_project_path(Sfolder, Soutput) : g_strdup(Sfolder);
+
+	if (strlen(SoutputFolder) < sizeof(Passet->options.folder))
+		strcpy(Passet->options.folder, SoutputFolder);
+	else
+	{
+		g_message("asset %s: the output folder name is too long.\n", Sgroup);
+
+		Bsuccess = FALSE;
+	}
+
+	if (Sbank != NULL)
+		Ibank = g_ascii_strtoll(Sbank, & Send, 10);
+
+	if ((Sbank != NULL) && ((Send == Sbank) || (*Send != '\0') || (Ibank < 0) || (Ibank > IMAGE2GB_CLI_BANK_MAX)))
+	{
+		g_message("asset %s: the ROM bank number should be between 0 and %d.\n", Sgroup, IMAGE2GB_CLI_BANK_MAX);
+
+		Bsuccess = FALSE;
+	}
+
+	Passet->options.bank = (gint) Ibank;
+
+	if (StileBase != NULL)
+		ItileBase = g_ascii_strtoll(StileBase, & Send, 10);
+
+	if ((StileBase != NULL) && ((Send == StileBase) || (*Send != '\0') || (ItileBase < 0) || (ItileBase > IMAGE2GB_TILE_BASE_MAX)))
+	{
+		g_message("asset %s: the tile base should be between 0 and %d.\n", Sgroup, IMAGE2GB_TILE_BASE_MAX);
+
+		Bsuccess = FALSE;
+	}
+
+	Passet->options.tileBase = (gint) ItileBase;
+
+	if (SuploadBudget != NULL)
+		IuploadBudget = g_ascii_strtoll(SuploadBudget, & Send, 10);
+
+	if ((SuploadBudget != NULL) && ((Send == SuploadBudget) || (*Send != '\0') || (IuploadBudget < 0) || (IuploadBudget > IMAGE2GB_UPLOAD_BUDGET_MAX)))
+	{
+		g_message("asset %s: the upload budget should be between 0 and %d bytes.\n", Sgroup, IMAGE2GB_UPLOAD_BUDGET_MAX);
+
+		Bsuccess = FALSE;
+	}
+
+	Passet->options.uploadBudget = (gint) IuploadBudget;
+
+	if ((Sformat == NULL) || (strcmp(Sformat, "source") == 0))
+		Passet->options.format = IMAGE2GB_FORMAT_SOURCE;
+	else if (strcmp(Sformat, "binary") == 0)
+		Passet->options.format = IMAGE2GB_FORMAT_BINARY;
+	else
+	{
+		g_message("asset %s: unknown format %s (it should be source or binary).\n", Sgroup, Sformat);
+
+		Bsuccess = FALSE;
+	}
+
+	if (Scompression == NULL)
+		Passet->options.compression = IMAGE2GB_COMPRESSION_NONE;
+	else if (image2gb_compression_from_name(Scompression) >= 0)
+		Passet->options.compression = image2gb_compression_from_name(Scompression);
+	else
+	{
+		g_message("asset %s: unknown compression %s (it should be none, rle or lz).\n", Sgroup, Scompression);
+
+		Bsuccess = FALSE;
+	}
+
+	if (Slayout == NULL)
+		Passet->options.mapLayout = IMAGE2GB_LAYOUT_ROWS;
+	else if (image2gb_layout_from_name(Slayout) >= 0)
+		Passet->options.mapLayout = image2gb_layout_from_name(Slayout);
+	else
+	{
+		g_message("asset %s: unknown layout %s (it should be rows, columns or vram).\n", Sgroup, Slayout);
+
+		Bsuccess = FALSE;
+	}
+
+	// The image is the first file, the one that gets exported.
+	if (Bsuccess)
+	{
+		gchar* SallPaths = (Sinputs != NULL) ? g_strconcat(Simage, ";", Sinputs, NULL) : g_strdup(Simage); /**< All the files, separated by ';'. */
+
+		ArrayPaths = g_strsplit(SallPaths, ";", -1);
+
+		g_free(SallPaths);
+
+		for (guint path = 0; ArrayPaths[path] != NULL; path++)
+		{
+			gchar* SfileName = NULL; /**< Path of the file, resolved. */
+			ProjectFile* Pfile = NULL; /**< The file, shared with other assets. */
+
+			if (g_strstrip(ArrayPaths[path])[0] == '\0')
+				continue;
+
+			SfileName = image2gb_cli_project_path(Sfolder, ArrayPaths[path]);
+			Pfile = g_hash_table_lookup(GfileTable, SfileName);
+
+			if (Pfile == NULL)
+			{
+				Pfile = g_new0(ProjectFile, 1);
+				Pfile->path = SfileName;
+
+				g_hash_table_insert(GfileTable, Pfile->path, Pfile);
+				g_ptr_array_add(GarrayFiles, Pfile);
+			}
+			else
+				g_free(SfileName);
+
+			g_ptr_array_add(Passet->files, Pfile);
+		}
+	}
+
+	g_strfreev(ArrayPaths);
+	g_free(SoutputFolder);
+	g_free(Sinputs);
+	g_free(Slayout);
+	g_free(SuploadBudget);
+	g_free(Scompression);
+	g_free(StileBase);
+	g_free(Sformat);
+	g_free(Sbank);
+	g_free(Soutput);
+	g_free(Sname);
+	g_free(Simage);
+
+	if (! Bsuccess)
+	{
+		image2gb_cli_project_free_asset(Passet);
+
+		return NULL;
+	}
+
+	return Passet;
+}
+
+static gchar*
+image2gb_cli_project_value(GKeyFile* Gmanifest, const gchar* Sgroup, const gchar* Skey)
+{
+	if (g_key_file_has_key(Gmanifest, Sgroup, Skey, NULL))
+		return g_key_file_get_string(Gmanifest, Sgroup, Skey, NULL);
+
+	return g_key_file_get_string(Gmanifest, IMAGE2GB_CLI_PROJECT_GROUP, Skey, NULL);
+}
+
+static gchar*
+image2gb_cli_project_path(const gchar* Sfolder, const gchar* Spath)
+{
+	if (g_path_is_absolute(Spath))
+		return g_strdup(Spath);
+
+	return g_build_filename(Sfolder, Spath, NULL);
+}
+
+static gboolean
+image2gb_cli_project_hash(ProjectAsset* Passet)
+{
+	GChecksum* Gchecksum = g_checksum_new(G_CHECKSUM_SHA256); /**< Hash of the asset. */
+
+	// The parameters are hashed as they are in memory: the struct was zeroed
+	// when allocated, so its unused bytes are the same from one build to the
+	// next.
+	g_checksum_update(Gchecksum, (const guchar*) IMAGE2GB_CLI_STATE_VERSION, -1);
+	g_checksum_update(Gchecksum, (const guchar*) & Passet->options, sizeof(Passet->options));
+
+	for (guint file = 0; file < Passet->files->len; file++)
+	{
+		const ProjectFile* Pfile = g_ptr_array_index(Passet->files, file); /**< File the asset depends on. */
+
+		if (Pfile->hash == NULL)
+		{
+			g_message("asset %s: could not read %s.\n", Passet->group, Pfile->path);
+
+			g_checksum_free(Gchecksum);
+
+			return FALSE;
+		}
+
+		// The path also counts, with its '\0' so that it can not run into the
+		// hash.
+		g_checksum_update(Gchecksum, (const guchar*) Pfile->path, (strlen(Pfile->path) + 1));
+		g_checksum_update(Gchecksum, (const guchar*) Pfile->hash, -1);
+	}
+
+	Passet->hash = g_strdup(g_checksum_get_string(Gchecksum));
+
+	g_checksum_free(Gchecksum);
+
+	return TRUE;
+}
+
+static gboolean
+image2gb_cli_project_outputs_exist(const PluginExportOptions* PexportOptions)
+{
+	gchar* SfileName = NULL; /**< Output file to look for. */
+	gboolean Bexist = TRUE; /**< Return value. */
+
+	for (guint file = 0; Bexist && ((SfileName = image2gb_output_file(PexportOptions, file)) != NULL); file++)
+	{
+		gchar* SoutputName = g_build_filename(PexportOptions->folder, SfileName, NULL); /**< The output file, in its folder. */
+
+		Bexist = g_file_test(SoutputName, G_FILE_TEST_EXISTS);
+
+		g_free(SoutputName);
+		g_free(SfileName);
+	}
+
+	// With --depfile, the stamp file too (the depfile is written before it).
+	if (Bexist && BoptionDepfile)
+	{
+		gchar* SnameLowercase = g_ascii_strdown(PexportOptions->name, -1); /**< Asset name, all lowercase (as in the file names). */
+		gchar* SstampName = g_strdup_printf("%s/%s.%s", PexportOptions->folder, SnameLowercase, IMAGE2GB_STAMP_EXTENSION); /**< The stamp file, in its folder. */
+
+		Bexist = g_file_test(SstampName, G_FILE_TEST_EXISTS);
+
+		g_free(SstampName);
+		g_free(SnameLowercase);
+	}
+
+	return Bexist;
+}
+
+static void
+image2gb_cli_project_run(GFunc Pwork, GPtrArray* GarrayItems)
+{
+	guint UIthreads = (IoptionJobs > 0) ? (guint) IoptionJobs : g_get_num_processors(); /**< Threads of the pool. */
+	GThreadPool* Gpool = NULL; /**< Worker threads. */
+
+	// Like image2gb_run_jobs(), but with the number of threads fixed by the
+	// user, not by the number of items.
+	if ((UIthreads > 1) && (GarrayItems->len > 1))
+		Gpool = g_thread_pool_new(Pwork, NULL, MIN(UIthreads, GarrayItems->len), FALSE, NULL);
+
+	for (guint item = 0; item < GarrayItems->len; item++)
+	{
+		if ((Gpool == NULL) || (! g_thread_pool_push(Gpool, g_ptr_array_index(GarrayItems, item), NULL)))
+			Pwork(g_ptr_array_index(GarrayItems, item), NULL);
+	}
+
+	// Waits for all the items to be done.
+	if (Gpool != NULL)
+		g_thread_pool_free(Gpool, FALSE, TRUE);
+}
+
+static void
+image2gb_cli_project_hash_file(gpointer Pfile, gpointer Pdata)
+{
+	ProjectFile* PprojectFile = Pfile; /**< File to hash. */
+	FILE* PinputFile = fopen(PprojectFile->path, "rb"); /**< The file itself. */
+	GChecksum* Gchecksum = NULL; /**< Hash of its contents. */
+	guchar* Pbuffer = NULL; /**< Piece of the file being hashed. */
+	gsize UIread = 0; /**< Bytes in Pbuffer. */
+
+	// The error is reported by every asset that depends on the file.
+	if (PinputFile == NULL)
+		return;
+
+	Gchecksum = g_checksum_new(G_CHECKSUM_SHA256);
+	Pbuffer = g_malloc(IMAGE2GB_CLI_HASH_BUFFER_SIZE);
+
+	while ((UIread = fread(Pbuffer, 1, IMAGE2GB_CLI_HASH_BUFFER_SIZE, PinputFile)) > 0)
+		g_checksum_update(Gchecksum, Pbuffer, UIread);
+
+	if (! ferror(PinputFile))
+		PprojectFile->hash = g_strdup(g_checksum_get_string(Gchecksum));
+
+	g_free(Pbuffer);
+	g_checksum_free(Gchecksum);
+	fclose(PinputFile);
+}
+
+static void
+image2gb_cli_project_build(gpointer Passet, gpointer Pdata)
+{
+	ProjectAsset* PprojectAsset = Passet; /**< Asset to build. */
+	const ProjectFile* Pimage = g_ptr_array_index(PprojectAsset->files, 0); /**< Image to export. */
+	gchar** ArrayDependencies = g_new0(gchar*, (PprojectAsset->files->len + 1)); /**< Other files the output depends on (not owned). */
+
+	// Besides the image, the extra inputs and the manifest (that has the
+	// options).
+	for (guint file = 1; file < PprojectAsset->files->len; file++)
+		ArrayDependencies[file - 1] = ((ProjectFile*) g_ptr_array_index(PprojectAsset->files, file))->path;
+
+	ArrayDependencies[PprojectAsset->files->len - 1] = SoptionProject;
+
+	g_private_set(& PprojectGroup, PprojectAsset->group);
+
+	if (g_mkdir_with_parents(PprojectAsset->options.folder, 0755) != 0)
+	{
+		g_message("could not create folder %s (%s).\n", PprojectAsset->options.folder, g_strerror(errno));
+
+		PprojectAsset->status = IMAGE2GB_ASSET_FAILED;
+	}
+	else if (image2gb_cli_export(Pimage->path, & PprojectAsset->options, ArrayDependencies))
+		PprojectAsset->status = IMAGE2GB_ASSET_BUILT;
+	else
+		PprojectAsset->status = IMAGE2GB_ASSET_FAILED;
+
+	g_private_set(& PprojectGroup, NULL);
+
+	g_free(ArrayDependencies);
+}
+
+static void
+image2gb_cli_project_free_file(gpointer Pfile)
+{
+	ProjectFile* PprojectFile = Pfile; /**< File to free. */
+
+	g_free(PprojectFile->path);
+	g_free(PprojectFile->hash);
+	g_free(PprojectFile);
+}
+
+static void
+image2gb_cli_project_free_asset(gpointer Passet)
+{
+	ProjectAsset* PprojectAsset = Passet; /**< Asset to free. */
+
+	g_free(PprojectAsset->group);
+	g_ptr_array_free(PprojectAsset->files, TRUE);
+	g_free(PprojectAsset->oldHash);
+	g_free(PprojectAsset->hash);
+	g_free(PprojectAsset);
+}
+
+static void
+image2gb_cli_log(const gchar* Sdomain, GLogLevelFlags Glevel, const gchar* Smessage, gpointer Pdata)
+{
+	const gchar* Sgroup = g_private_get(& PprojectGroup); /**< Asset being built by this thread, if any. */
+
+	// Messages are written for GIMP's message box, most already end in '\n'.
+	if (Sgroup != NULL)
+		g_printerr("%s: asset %s: %s%s", IMAGE2GB_CLI_BINARY_NAME, Sgroup, Smessage, g_str_has_suffix(Smessage, "\n") ? "" : "\n");
+	else
+		g_printerr("%s: %s%s", IMAGE2GB_CLI_BINARY_NAME, Smessage, g_str_has_suffix(Smessage, "\n") ? "" : "\n");
+}
@@ -0,0 +1,172 @@
+/**
+ * @file  image2gb_cli.h
+ * @brief Command line tool to export images to Game Boy data without GIMP (same output as the plugin) - header.
+ */
+
+#pragma once
+
+#include "image_convert.h" // The same conversion the plugin uses.
+#include "image_animation.h" // For exporting the images as the frames of an animation.
+#include "image_load.h"
+
+// Ignore warnings in external libraries (GLib...).
+#pragma GCC system_header
+#include <glib.h>
+#include <stdlib.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_CLI_BINARY_NAME "image2gb-cli" /**< Name of the output binary. */
+#define IMAGE2GB_CLI_PARAMETERS  "IMAGE..."     /**< What goes after the options, for the help text. */
+#define IMAGE2GB_CLI_SUMMARY     "Exports indexed 4-color PNG, BMP or PGM images to Game Boy data (for use with GBDK-2020),\n" \
+                                 "the same way the GIMP plugin does. Pixel values 0 to 3 are the 4 colors (lightest to\n" \
+                                 "darkest); grayscale images are converted, white being color 0."
+
+#define IMAGE2GB_CLI_BANK_MAX 127 /**< Highest ROM bank number accepted (same as the plugin dialog). */
+
+#define IMAGE2GB_CLI_PROJECT_GROUP     "project" /**< Manifest group with the default options of all assets (not an asset itself). */
+#define IMAGE2GB_CLI_STATE_EXTENSION   ".state"  /**< Appended to the manifest file name to get the file that stores the last build. */
+#define IMAGE2GB_CLI_STATE_VERSION     "2"       /**< Goes into every asset hash; change it when the output for the same inputs changes. */
+#define IMAGE2GB_CLI_HASH_BUFFER_SIZE  65536     /**< Bytes read at a time when hashing an input file. */
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** Possible states of an asset of a project build.
+ */
+typedef enum ProjectStatus
+{
+	IMAGE2GB_ASSET_PENDING, /**< Its inputs or options changed (or it was never built), so it has to be built. */
+	IMAGE2GB_ASSET_UP_TO_DATE, /**< Same inputs and options as the last successful build, and its outputs are still there. */
+	IMAGE2GB_ASSET_BUILT, /**< Built right now. */
+	IMAGE2GB_ASSET_FAILED /**< Could not be built (the error is reported). */
+} ProjectStatus;
+
+/** Object that stores an input file of a project, shared by all the assets
+ *  that depend on it, so that it is only hashed once.
+ */
+typedef struct ProjectFile
+{
+	gchar* path; /**< Path of the file (as resolved from the manifest folder). */
+	gchar* hash; /**< SHA-256 of its contents, or NULL if it could not be read. */
+} ProjectFile;
+
+/** Object that stores an asset of a project, as given by its manifest group.
+ */
+typedef struct ProjectAsset
+{
+	gchar* group; /**< Name of its group in the manifest. */
+	PluginExportOptions options; /**< Export parameters. */
+	GPtrArray* files; /**< Files it depends on (ProjectFile, not owned): the image first, then the extra inputs. */
+	gchar* oldHash; /**< Hash of its last successful build, or NULL if there is none. */
+	gchar* hash; /**< Hash of its inputs and options now. */
+	ProjectStatus status; /**< Whether it has to be built, and how it went. */
+} ProjectAsset;
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Entry point: parses the options and exports every image given (or builds
+ *  the project given).
+ */
+int
+main(int argc, char* argv[]);
+
+/** Fills in the export parameters of an image given in the command line,
+ *  from the options. Returns TRUE if success, FALSE otherwise (the error is
+ *  reported).
+ */
+static gboolean
+image2gb_cli_options(const gchar* SfileName, PluginExportOptions* PexportOptions);
+
+/** Loads, checks and exports one image with the given parameters. With
+ *  --depfile, the output depends on the image plus ArrayDependencies (NULL
+ *  terminated, or NULL). Returns TRUE if success, FALSE otherwise (the error
+ *  is reported).
+ */
+static gboolean
+image2gb_cli_export(const gchar* SfileName, const PluginExportOptions* PexportOptions, gchar** ArrayDependencies);
+
+/** Loads, checks and exports the images (NULL terminated) as the frames of a
+ *  single animation, with the given parameters. Returns TRUE if success, FALSE
+ *  otherwise (the error is reported).
+ */
+static gboolean
+image2gb_cli_animation(gchar** ArrayFrames, const PluginExportOptions* PexportOptions);
+
+/** Checks the validity of the image for being exported to Game Boy (same rules
+ *  as the plugin). Returns TRUE if it is valid, FALSE otherwise.
+ */
+static gboolean
+image2gb_cli_check_image(const gchar* SfileName, const IndexedImage* Pimage);
+
+/** Builds the assets of a project manifest whose inputs or options changed
+ *  since the last build, in parallel. Returns TRUE if all of them are up to
+ *  date in the end, FALSE otherwise (the errors are reported).
+ */
+static gboolean
+image2gb_cli_project(const gchar* SmanifestName);
+
+/** Reads the asset described by the given manifest group (Sfolder being the
+ *  folder of the manifest). The files it depends on are looked up in
+ *  GfileTable (path -> ProjectFile), and added to it and to GarrayFiles if
+ *  they are new. Returns the asset, or NULL if the group is not valid (the
+ *  error is reported).
+ */
+static ProjectAsset*
+image2gb_cli_project_asset(GKeyFile* Gmanifest, const gchar* Sgroup, const gchar* Sfolder, GHashTable* GfileTable, GPtrArray* GarrayFiles);
+
+/** Returns the value of the given key for an asset (free it with g_free()):
+ *  the one in its own group, else the one in the project group, else NULL.
+ */
+static gchar*
+image2gb_cli_project_value(GKeyFile* Gmanifest, const gchar* Sgroup, const gchar* Skey);
+
+/** Returns the given manifest path, relative to Sfolder unless it is absolute
+ *  (free it with g_free()).
+ */
+static gchar*
+image2gb_cli_project_path(const gchar* Sfolder, const gchar* Spath);
+
+/** Computes the hash of an asset: its options plus the hashes of its files.
+ *  Returns FALSE if one of the files could not be read (the error is
+ *  reported).
+ */
+static gboolean
+image2gb_cli_project_hash(ProjectAsset* Passet);
+
+/** Returns TRUE if all the output files of the given parameters exist (and
+ *  the stamp file, with --depfile).
+ */
+static gboolean
+image2gb_cli_project_outputs_exist(const PluginExportOptions* PexportOptions);
+
+/** Runs Pwork on every element of GarrayItems, in a thread pool with as many
+ *  threads as --jobs says, and waits until all of them are done.
+ */
+static void
+image2gb_cli_project_run(GFunc Pwork, GPtrArray* GarrayItems);
+
+/** Thread pool function: hashes the contents of one input file (ProjectFile).
+ */
+static void
+image2gb_cli_project_hash_file(gpointer Pfile, gpointer Pdata);
+
+/** Thread pool function: builds one asset (ProjectAsset).
+ */
+static void
+image2gb_cli_project_build(gpointer Passet, gpointer Pdata);
+
+/** Frees a ProjectFile.
+ */
+static void
+image2gb_cli_project_free_file(gpointer Pfile);
+
+/** Frees a ProjectAsset.
+ */
+static void
+image2gb_cli_project_free_asset(gpointer Passet);
+
+/** Prints the messages of the export functions (g_message()) to stderr,
+ *  after the name of the asset being built, if any.
+ */
+static void
+image2gb_cli_log(const gchar* Sdomain, GLogLevelFlags Glevel, const gchar* Smessage, gpointer Pdata);
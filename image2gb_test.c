@@ -0,0 +1,101 @@
+/**
+ * @file  image2gb_test.c
+ * @brief Tests of the conversion limits, on synthetic images - implementation.
+ */
+
+#include "image2gb_test.h"
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+int
+main(int argc, char* argv[])
+{
+	g_set_prgname(IMAGE2GB_TEST_BINARY_NAME);
+	g_test_init(& argc, & argv, NULL);
+
+	g_test_add_func("/map/too-many-tiles", image2gb_test_map_too_many_tiles);
+	g_test_add_func("/map/too-many-tiles-base", image2gb_test_map_too_many_tiles_base);
+	g_test_add_func("/map/16bit-limit", image2gb_test_map_16bit_limit);
+
+	return g_test_run();
+}
+
+static gboolean
+image2gb_test_export_unique(guint UItileWidth, guint UItileHeight, gint ItileBase)
+{
+	PluginExportOptions StructExportOptions = {0}; /**< Export parameters. */
+	gsize UIrowstride = ((gsize) UItileWidth * IMAGE2GB_TILE_SIZE); /**< Width of the image, in pixels. */
+	guchar* Ppixels = g_new0(guchar, (UIrowstride * UItileHeight * IMAGE2GB_TILE_SIZE)); /**< Pixels of the image. */
+	gchar* Sfolder = g_dir_make_tmp(IMAGE2GB_TEST_BINARY_NAME "-XXXXXX", NULL); /**< Where the files go. */
+	ExportContext* Pcontext = NULL; /**< State of the export. */
+	const gchar* SfileName = NULL; /**< File written to the folder. */
+	GDir* Gdir = NULL; /**< Contents of the folder, for removing them. */
+	gboolean Bsuccess = TRUE; /**< Return value. */
+
+	g_assert_nonnull(Sfolder);
+
+	// The number of every tile, 2 bits per pixel, goes in its first 2 rows (16
+	// pixels, 32 bits), so all tiles are different.
+	for (guint tile = 0; tile < (UItileWidth * UItileHeight); tile++)
+	{
+		guchar* PtilePixels = Ppixels + ((tile / UItileWidth) * IMAGE2GB_TILE_SIZE * UIrowstride) + ((tile % UItileWidth) * IMAGE2GB_TILE_SIZE); /**< First pixel of the tile. */
+
+		for (guint pixel = 0; pixel < (2 * IMAGE2GB_TILE_SIZE); pixel++)
+			PtilePixels[((pixel / IMAGE2GB_TILE_SIZE) * UIrowstride) + (pixel % IMAGE2GB_TILE_SIZE)] = ((tile >> (2 * pixel)) & 3);
+	}
+
+	// Binary format, the fastest to write.
+	strcpy(StructExportOptions.name, "Test");
+	g_strlcpy(StructExportOptions.folder, Sfolder, sizeof(StructExportOptions.folder));
+	StructExportOptions.format = IMAGE2GB_FORMAT_BINARY;
+	StructExportOptions.tileBase = ItileBase;
+
+	Pcontext = image2gb_context_new(NULL);
+	Pcontext->options = StructExportOptions;
+
+	g_assert_true(image2gb_context_convert(Pcontext, Ppixels, (UItileWidth * IMAGE2GB_TILE_SIZE), (UItileHeight * IMAGE2GB_TILE_SIZE), UIrowstride));
+	g_assert_cmpuint(Pcontext->tileCount, ==, (UItileWidth * UItileHeight));
+
+	Bsuccess = image2gb_context_emit(Pcontext);
+
+	image2gb_context_free(Pcontext);
+	g_free(Ppixels);
+
+	Gdir = g_dir_open(Sfolder, 0, NULL);
+
+	while ((Gdir != NULL) && ((SfileName = g_dir_read_name(Gdir)) != NULL))
+	{
+		gchar* SfilePath = g_build_filename(Sfolder, SfileName, NULL); /**< Full name of the file. */
+
+		g_remove(SfilePath);
+
+		g_free(SfilePath);
+	}
+
+	if (Gdir != NULL)
+		g_dir_close(Gdir);
+
+	g_rmdir(Sfolder);
+	g_free(Sfolder);
+
+	return Bsuccess;
+}
+
+static void
+image2gb_test_map_too_many_tiles(void)
+{
+	// 257 x 256 = 65792 tiles (also in streaming mode).
+	g_assert_false(image2gb_test_export_unique(257, 256, 0));
+}
+
+static void
+image2gb_test_map_too_many_tiles_base(void)
+{
+	g_assert_false(image2gb_test_export_unique(256, 256, 1));
+}
+
+static void
+image2gb_test_map_16bit_limit(void)
+{
+	g_assert_true(image2gb_test_export_unique(256, 256, 0));
+}
@@ -0,0 +1,47 @@
+/**
+ * @file  image2gb_test.h
+ * @brief Tests of the conversion limits, on synthetic images - header.
+ */
+
+#pragma once
+
+#include "image_convert.h" // The conversion being tested.
+
+// Ignore warnings in external libraries (GLib...).
+#pragma GCC system_header
+#include <glib.h>
+#include <glib/gstdio.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_TEST_BINARY_NAME "image2gb-test" /**< Name of the output binary. */
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Entry point: runs all the tests (see g_test_run()).
+ */
+int
+main(int argc, char* argv[]);
+
+/** Converts and exports a synthetic image of UItileWidth x UItileHeight tiles,
+ *  all of them different, with the given tile base (to a temporary folder,
+ *  removed afterwards). Returns what image2gb_context_emit() returned.
+ */
+static gboolean
+image2gb_test_export_unique(guint UItileWidth, guint UItileHeight, gint ItileBase);
+
+/** A map with more tiles than 16-bit entries can number is refused.
+ */
+static void
+image2gb_test_map_too_many_tiles(void);
+
+/** A map that needs 16-bit entries only because of the tile base is refused
+ *  just the same.
+ */
+static void
+image2gb_test_map_too_many_tiles_base(void);
+
+/** The biggest map 16-bit entries can number is still exported.
+ */
+static void
+image2gb_test_map_16bit_limit(void);
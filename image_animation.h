@@ -0,0 +1,305 @@
+/**
+ * @file  image_animation.h
+ * @brief Export of an animation (several frames of the same size) as a single asset, with one tileset for all frames and the changes between them - header + implementation.
+ */
+
+#pragma once
+
+#include "image_convert.h" // The conversion itself, this file only adds the frames.
+
+// Ignore warnings in external libraries (GLib...).
+#pragma GCC system_header
+#include <glib.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_ANIMATION_FRAMES_MAX 64  /**< Most frames an animation can have (so all of them together are never streamed). */
+#define IMAGE2GB_ANIMATION_SIZE_MAX   256 /**< Maximum frame size, in pixels (any dimension): the 32x32 tiles of the background map. */
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** Object that stores what a frame of an animation changes from the previous
+ *  one (the last one, for the first frame, as the animation loops).
+ */
+typedef struct AnimationFrame
+{
+	guint firstTile; /**< First of the unique tiles that appear in this frame for the first time. */
+	guint tileCount; /**< Number of unique tiles that appear in this frame for the first time. */
+	guint cellCount; /**< Number of map cells that differ from the previous frame. */
+} AnimationFrame;
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Creates the context for converting an animation with the given export
+ *  parameters. Animations are always exported as C source, with neither
+ *  compression nor upload table, and the map row by row (the changed cells say
+ *  where they go); they do not use the cache. Free it with
+ *  image2gb_context_free().
+ */
+static ExportContext*
+image2gb_animation_new(const PluginExportOptions* PexportOptions);
+
+/** Checks that an animation of UIframes frames of UIwidth x UIheight pixels
+ *  can be exported (Sname being the asset name, for the message). Returns TRUE
+ *  if it can, FALSE otherwise (the error is reported).
+ */
+static gboolean
+image2gb_animation_check(const gchar* Sname, guint UIwidth, guint UIheight, guint UIframes);
+
+/** Converts an animation in memory: UIframes frames of UIwidth x UIheight
+ *  pixels (whole tiles), one after another, as if they were a single image
+ *  UIframes times taller (one byte per pixel, with values from 0 to 3). All
+ *  frames share a single tileset. Returns TRUE if success, FALSE otherwise
+ *  (the error is reported).
+ */
+static gboolean
+image2gb_animation_convert(ExportContext* Pcontext, const guchar* Ppixels, guint UIwidth, guint UIheight, guint UIframes);
+
+/** Writes the output files of the converted animation of UIframes frames: the
+ *  .h header and the .c source, with the tiles of all frames, the map of the
+ *  first frame, and what every frame changes (see image2gb_animation_frames()).
+ *  Returns TRUE if success, FALSE otherwise (the error is reported).
+ */
+static gboolean
+image2gb_animation_emit(ExportContext* Pcontext, guint UIframes);
+
+/** Finds what every frame of the animation changes (ArrayFrames has UIframes
+ *  entries). The map cells that change are written to Sdeltas, 3 bytes each
+ *  (column, row and tile, as in VRAM), frame after frame, in hexadecimal.
+ */
+static void
+image2gb_animation_frames(const ExportContext* Pcontext, guint UIframes, AnimationFrame* ArrayFrames, GString* Sdeltas);
+
+////////////////////////////////////////////////////////////////////////////////
+
+static ExportContext*
+image2gb_animation_new(const PluginExportOptions* PexportOptions)
+{
+	ExportContext* Pcontext = image2gb_context_new(NULL); /**< Return value. */
+	
+	// The cache keeps the output of images, not of animations.
+	Pcontext->options = * PexportOptions;
+	Pcontext->options.format = IMAGE2GB_FORMAT_SOURCE;
+	Pcontext->options.compression = IMAGE2GB_COMPRESSION_NONE;
+	Pcontext->options.uploadBudget = 0;
+	Pcontext->options.mapLayout = IMAGE2GB_LAYOUT_ROWS;
+	
+	return Pcontext;
+}
+
+static gboolean
+image2gb_animation_check(const gchar* Sname, guint UIwidth, guint UIheight, guint UIframes)
+{
+	if ((UIframes < 1) || (UIframes > IMAGE2GB_ANIMATION_FRAMES_MAX))
+	{
+		g_message("%s: an animation should have between 1 and %d frames.\n", Sname, IMAGE2GB_ANIMATION_FRAMES_MAX);
+		
+		return FALSE;
+	}
+	
+	if ((UIwidth > IMAGE2GB_ANIMATION_SIZE_MAX) || (UIheight > IMAGE2GB_ANIMATION_SIZE_MAX))
+	{
+		g_message("%s: the frames of an animation should be %dx%d pixels at most (the background map).\n",
+		          Sname, IMAGE2GB_ANIMATION_SIZE_MAX, IMAGE2GB_ANIMATION_SIZE_MAX);
+		          
+		return FALSE;
+	}
+	
+	return TRUE;
+}
+
+static gboolean
+image2gb_animation_convert(ExportContext* Pcontext, const guchar* Ppixels, guint UIwidth, guint UIheight, guint UIframes)
+{
+	if (! image2gb_animation_check(Pcontext->options.name, UIwidth, UIheight, UIframes))
+		return FALSE;
+		
+	// Frames are deduplicated together, so a tile is numbered after the first
+	// frame it appears in: the new tiles of every frame come one after another
+	// in the tile data.
+	return image2gb_context_convert(Pcontext, Ppixels, UIwidth, (UIheight * UIframes), UIwidth);
+}
+
+static gboolean
+image2gb_animation_emit(ExportContext* Pcontext, guint UIframes)
+{
+	const PluginExportOptions* PexportOptions = & Pcontext->options; /**< Export parameters. */
+	gchar SfileName[PATH_MAX] = {0}; /**< Auxiliary string for composing the full file names. */
+	gchar SnameLowercase[IMAGE2GB_ASSET_NAME_MAX_LENGTH] = {0}; /**< Asset name, all lowercase. */
+	gchar SnameUppercase[IMAGE2GB_ASSET_NAME_MAX_LENGTH] = {0}; /**< Asset name, all UPPERCASE. */
+	guint UIframeHeight = (Pcontext->tileHeight / UIframes); /**< Height of a frame, in tiles. */
+	AnimationFrame* ArrayFrames = g_new0(AnimationFrame, UIframes); /**< What every frame changes. */
+	GString* Sdeltas = g_string_new(NULL); /**< Map cells every frame changes, as written. */
+	GString* SframeTable = g_string_new(NULL); /**< Table of frames, as written. */
+	ExportContext StructFirstFrame = * Pcontext; /**< The context, as if the image was only the first frame. */
+	OutputWriter StructWriter = {0}; /**< Buffers the contents of the file being written. */
+	guint UInewTiles = 0; /**< Tiles loaded after the first frame. */
+	guint UIchangedCells = 0; /**< Map cells changed after the first frame. */
+	guint UItilesMax = 0; /**< Most tiles a frame loads (after the first one). */
+	guint UIcellsMax = 0; /**< Most map cells a frame changes. */
+	gint64 ItimeStart = g_get_monotonic_time(); /**< When the stage being timed started. */
+	gboolean Bsuccess = TRUE; /**< Return value. */
+	
+	for (guint c = 0; c < strlen(PexportOptions->name); c++)
+		SnameLowercase[c] = tolower(PexportOptions->name[c]);
+		
+	for (guint c = 0; c < strlen(PexportOptions->name); c++)
+		SnameUppercase[c] = toupper(PexportOptions->name[c]);
+		
+	// Frames only load the tiles they add, so all of them have to fit in VRAM
+	// at the same time.
+	if ((PexportOptions->tileBase + Pcontext->tileCount) > IMAGE2GB_IMAGE_TILES_VRAM_LIMIT)
+	{
+		g_message("%s: the animation has %u unique tiles, they do not fit in the Game Boy video memory starting at tile %d.\n",
+		          PexportOptions->name, Pcontext->tileCount, PexportOptions->tileBase);
+		          
+		Bsuccess = FALSE;
+	}
+	
+	if (Bsuccess)
+	{
+		image2gb_animation_frames(Pcontext, UIframes, ArrayFrames, Sdeltas);
+		
+		// Every frame: its first new tile (as in VRAM, meaningless if it has no
+		// new tiles), the number of new tiles and the number of map cells it
+		// changes (both 16-bit, little-endian).
+		for (guint frame = 0; frame < UIframes; frame++)
+		{
+			g_string_append_printf(SframeTable, "\t0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X%s",
+			                       ((PexportOptions->tileBase + ArrayFrames[frame].firstTile) & 0xFF),
+			                       (ArrayFrames[frame].tileCount & 0xFF), (ArrayFrames[frame].tileCount >> 8),
+			                       (ArrayFrames[frame].cellCount & 0xFF), (ArrayFrames[frame].cellCount >> 8),
+			                       (frame < (UIframes - 1)) ? ",\n" : "");
+			                       
+			UIcellsMax = MAX(UIcellsMax, ArrayFrames[frame].cellCount);
+			
+			if (frame == 0)
+				continue;
+				
+			UInewTiles += ArrayFrames[frame].tileCount;
+			UIchangedCells += ArrayFrames[frame].cellCount;
+			UItilesMax = MAX(UItilesMax, ArrayFrames[frame].tileCount);
+		}
+		
+		// Frames that change nothing still need an array.
+		if (Sdeltas->len == 0)
+			g_string_append(Sdeltas, "\t0x00 // No frame changes anything.");
+			
+		// First, write the .h header.
+		sprintf(SfileName, "%s/%s.h", PexportOptions->folder, SnameLowercase);
+		
+		Bsuccess = image2gb_writer_open(& StructWriter, SfileName, FALSE, & Pcontext->stats);
+	}
+	
+	if (Bsuccess)
+	{
+		// Check "source_strings.h" to see what we're printing here.
+		g_string_append_printf(StructWriter.buffer, IMAGE2GB_SOURCE_STRING_H_ANIMATION,
+		                       SnameLowercase, PexportOptions->name,
+		                       UIframes, Pcontext->tileCount, Pcontext->tileWidth, UIframeHeight,
+		                       (Pcontext->tileWidth * IMAGE2GB_TILE_SIZE), (UIframeHeight * IMAGE2GB_TILE_SIZE),
+		                       PexportOptions->bank, UInewTiles, UIchangedCells, ((UIframes - 1) * Pcontext->tileWidth * UIframeHeight),
+		                       (PexportOptions->bank == 0) ? "//" : "", // If bank = 0, line is commented out.
+		                       (PexportOptions->bank == 0) ? "//" : "", SnameUppercase, // If bank = 0, line is commented out.
+		                       SnameUppercase, Pcontext->tileCount, SnameUppercase, PexportOptions->tileBase,
+		                       SnameUppercase, Pcontext->tileWidth, SnameUppercase, UIframeHeight,
+		                       SnameUppercase, UIframes, SnameUppercase, UItilesMax, SnameUppercase, UIcellsMax,
+		                       PexportOptions->name, PexportOptions->name, PexportOptions->name, PexportOptions->name,
+		                       PexportOptions->name, PexportOptions->name, PexportOptions->name, PexportOptions->name);
+		                       
+		Bsuccess = image2gb_writer_close(& StructWriter);
+		
+		ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_WRITE_HEADER, ItimeStart);
+	}
+	
+	// Now, write the .c source.
+	if (Bsuccess)
+	{
+		memset(SfileName, 0, sizeof(SfileName));
+		sprintf(SfileName, "%s/%s.c", PexportOptions->folder, SnameLowercase);
+		
+		Bsuccess = image2gb_writer_open(& StructWriter, SfileName, FALSE, & Pcontext->stats);
+	}
+	
+	if (Bsuccess)
+	{
+		g_string_append_printf(StructWriter.buffer, IMAGE2GB_SOURCE_STRING_C_1,
+		                       SnameLowercase, PexportOptions->name,
+		                       Pcontext->tileCount, (Pcontext->tileWidth * Pcontext->tileHeight), Pcontext->tileWidth, UIframeHeight,
+		                       (Pcontext->tileWidth * IMAGE2GB_TILE_SIZE), (UIframeHeight * IMAGE2GB_TILE_SIZE),
+		                       PexportOptions->bank,
+		                       SnameLowercase,
+		                       (PexportOptions->bank == 0) ? "//" : "", // If bank = 0, line is commented out.
+		                       (PexportOptions->bank == 0) ? "//" : "", SnameUppercase, // If bank = 0, line is commented out.
+		                       PexportOptions->name);
+		                       
+		image2gb_write_tile_data(Pcontext, & StructWriter);
+		
+		// The map of the first frame is the first rows of the map.
+		StructFirstFrame.tileHeight = UIframeHeight;
+		
+		g_string_append_printf(StructWriter.buffer, IMAGE2GB_SOURCE_STRING_C_2, "unsigned char", PexportOptions->name);
+		Bsuccess = image2gb_write_tilemap(& StructFirstFrame, & StructWriter);
+		image2gb_writer_append(& StructWriter, "\n};", 3);
+		
+		g_string_append_printf(StructWriter.buffer, IMAGE2GB_SOURCE_STRING_C_ANIMATION,
+		                       PexportOptions->name, SframeTable->str, PexportOptions->name, Sdeltas->str);
+		                       
+		// Always close the writer, so a failed map does not leave the temporary file.
+		Bsuccess = (image2gb_writer_close(& StructWriter) && Bsuccess);
+		
+		image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_WRITE_SOURCE, ItimeStart);
+	}
+	
+	if (Bsuccess && (Pcontext->dependencies != NULL))
+		Bsuccess = image2gb_write_depfile(Pcontext);
+		
+	if (Bsuccess)
+		image2gb_trace_report(& Pcontext->stats, PexportOptions->name);
+		
+	g_string_free(SframeTable, TRUE);
+	g_string_free(Sdeltas, TRUE);
+	g_free(ArrayFrames);
+	
+	return Bsuccess;
+}
+
+static void
+image2gb_animation_frames(const ExportContext* Pcontext, guint UIframes, AnimationFrame* ArrayFrames, GString* Sdeltas)
+{
+	guint UIframeHeight = (Pcontext->tileHeight / UIframes); /**< Height of a frame, in tiles. */
+	guint UIframeTiles = (Pcontext->tileWidth * UIframeHeight); /**< Tiles in a frame. */
+	guint UInextTile = 0; /**< First unique tile not seen in the frames so far. */
+	
+	for (guint frame = 0; frame < UIframes; frame++)
+	{
+		const guint* Pmap = (Pcontext->map + (frame * UIframeTiles)); /**< Map of this frame. */
+		const guint* PpreviousMap = (Pcontext->map + (((frame + UIframes - 1) % UIframes) * UIframeTiles)); /**< Map of the previous frame. */
+		
+		// Unique tiles are numbered in order of appearance, so the new ones are
+		// those above every number seen before this frame.
+		ArrayFrames[frame].firstTile = UInextTile;
+		
+		for (guint cell = 0; cell < UIframeTiles; cell++)
+			UInextTile = MAX(UInextTile, (Pmap[cell] + 1));
+			
+		ArrayFrames[frame].tileCount = (UInextTile - ArrayFrames[frame].firstTile);
+		ArrayFrames[frame].cellCount = 0;
+		
+		// The first frame is written whole, its changes are only for looping
+		// back to it from the last one.
+		for (guint cell = 0; cell < UIframeTiles; cell++)
+		{
+			if (Pmap[cell] == PpreviousMap[cell])
+				continue;
+				
+			if (Sdeltas->len > 0)
+				g_string_append(Sdeltas, ",\n");
+				
+			g_string_append_printf(Sdeltas, "\t0x%02X, 0x%02X, 0x%02X", (cell % Pcontext->tileWidth), (cell / Pcontext->tileWidth),
+			                       (Pmap[cell] + Pcontext->options.tileBase));
+			                       
+			ArrayFrames[frame].cellCount++;
+		}
+	}
+}
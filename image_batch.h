@@ -0,0 +1,568 @@
+/**
+ * @file  image_batch.h
+ * @brief Export of several images (or layers) in a single run of the plugin - header + implementation.
+ */
+
+#pragma once
+
+#include "image2gb.h" // For checking the images and loading their saved parameters.
+#include "image_export.h" // For the export context.
+#include "image_animation.h" // For exporting the layers as an animation.
+
+// Ignore warnings in external libraries (GIMP, GTK...).
+#pragma GCC system_header
+#include <libgimp/gimp.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_BATCH_IMAGES 0 /**< Batch source: every open image (its active drawable). */
+#define IMAGE2GB_BATCH_LAYERS 1 /**< Batch source: every visible layer of the given image. */
+
+#define IMAGE2GB_BATCH_PENDING_PER_WORKER 2 /**< Assets read ahead of the conversion, per worker thread (bounds memory usage). */
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** Object that stores one asset of a batch: read by the main thread (the only
+ *  one that can talk to GIMP), then converted and written by a worker thread.
+ */
+typedef struct BatchJob
+{
+	ExportContext* context; /**< State of the export, with the options of this asset. */
+	guchar* pixels; /**< Pixels of the image (one byte per pixel), NULL once converted. */
+	guint width; /**< Width of the image, in pixels. */
+	guint height; /**< Height of the image, in pixels. */
+	GString* log; /**< Messages about this asset, shown in the final summary. */
+	guint tileCount; /**< Number of unique tiles, once converted. */
+	gboolean success; /**< TRUE if the asset was exported. */
+} BatchJob;
+
+/** Object that stores the state of a batch export.
+ */
+typedef struct ExportBatch
+{
+	GThreadPool* pool; /**< Worker threads that convert the assets, NULL if they could not be created. */
+	GPtrArray* jobs; /**< All assets of the batch (BatchJob), in order. */
+	GHashTable* files; /**< Output files (folder and lowercase name) already taken, so assets do not overwrite each other. */
+	GMutex lock; /**< Protects pending. */
+	GCond done; /**< Signaled every time an asset is finished. */
+	guint pending; /**< Assets read but not finished yet. */
+	guint pendingMax; /**< How many assets can be pending before the main thread waits. */
+} ExportBatch;
+
+// VARIABLES ///////////////////////////////////////////////////////////////////
+
+/** Messages about the asset the current thread is working on (a GString), or
+ *  NULL. Worker threads can not send messages to GIMP, so during a batch all of
+ *  them are kept for the summary instead.
+ */
+static GPrivate PbatchLog = G_PRIVATE_INIT(NULL);
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Exports every open image (IMAGE2GB_BATCH_IMAGES) or every visible layer of
+ *  the given image (IMAGE2GB_BATCH_LAYERS) as separate assets, converting them
+ *  in parallel, and reports a single summary at the end. Sfolder is where to
+ *  save them (NULL or empty for the folder every image was last exported to,
+ *  or else the folder of its file). Returns the program status.
+ */
+static GimpPDBStatusType
+image2gb_batch_export(gint32 IimageID, gint Isource, const gchar* Sfolder, gint Ibank, gint Iformat, gint Icompression);
+
+/** Exports the visible layers of the image as the frames of a single animation
+ *  asset (the bottom layer is the first frame), with the name, folder and tile
+ *  base the image was last exported with. Sfolder is where to save it (NULL or
+ *  empty for that folder, or else the folder of the image file). Returns the
+ *  program status.
+ */
+static GimpPDBStatusType
+image2gb_batch_animation(gint32 IimageID, const gchar* Sfolder, gint Ibank);
+
+/** Reads one image or layer (in the main thread) and hands it over to the
+ *  worker threads. SlayerName is the name of the layer, or NULL for a whole
+ *  image (then it keeps the name it was last exported with, if any).
+ */
+static void
+image2gb_batch_add(ExportBatch* Pbatch, gint32 IimageID, gint32 IdrawableID, const gchar* SlayerName,
+                   const gchar* Sfolder, gint Ibank, gint Iformat, gint Icompression);
+
+/** Reads the pixels of the drawable (palette indices, one byte each, the alpha
+ *  channel is dropped). Returns a newly allocated buffer.
+ */
+static guchar*
+image2gb_batch_read(gint32 IdrawableID, guint UIwidth, guint UIheight, ExportStats* Pstats);
+
+/** Worker function: converts and writes one asset, Pjob being a BatchJob and
+ *  Pdata the ExportBatch.
+ */
+static void
+image2gb_batch_convert(gpointer Pjob, gpointer Pdata);
+
+/** Frees the memory of a BatchJob.
+ */
+static void
+image2gb_batch_free_job(BatchJob* Pjob);
+
+/** Log handler used during the batch: keeps the messages about the asset the
+ *  current thread is working on (see PbatchLog), or sends them to GIMP.
+ */
+static void
+image2gb_batch_log(const gchar* Sdomain, GLogLevelFlags Glevel, const gchar* Smessage, gpointer Pdata);
+
+////////////////////////////////////////////////////////////////////////////////
+
+static GimpPDBStatusType
+image2gb_batch_export(gint32 IimageID, gint Isource, const gchar* Sfolder, gint Ibank, gint Iformat, gint Icompression)
+{
+	ExportBatch StructBatch = {0}; /**< State of the batch. */
+	guint UIworkers = CLAMP(g_get_num_processors(), 1, IMAGE2GB_PARALLEL_WORKERS_MAX); /**< Number of worker threads. */
+	guint UIlogHandler = 0; /**< Our log handler, while it is installed. */
+	guint UIexported = 0; /**< Assets exported successfully. */
+	gint64 ItimeStart = g_get_monotonic_time(); /**< When the batch started. */
+	GString* Sreport = NULL; /**< Text of the final summary. */
+	gint32* ArrayItems = NULL; /**< Images or layers to export. */
+	gint IitemCount = 0; /**< Number of images or layers. */
+	GimpPDBStatusType GreturnStatus = GIMP_PDB_SUCCESS; /**< Return value. */
+	
+	if ((Isource != IMAGE2GB_BATCH_IMAGES) && (Isource != IMAGE2GB_BATCH_LAYERS))
+	{
+		g_message("Unknown batch source %d (it should be %d for all open images, or %d for all visible layers).\n",
+		          Isource, IMAGE2GB_BATCH_IMAGES, IMAGE2GB_BATCH_LAYERS);
+		          
+		return GIMP_PDB_CALLING_ERROR;
+	}
+	
+	StructBatch.jobs = g_ptr_array_new();
+	StructBatch.files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	StructBatch.pendingMax = (UIworkers * IMAGE2GB_BATCH_PENDING_PER_WORKER);
+	g_mutex_init(& StructBatch.lock);
+	g_cond_init(& StructBatch.done);
+	
+	// If the pool can not be created, every asset is converted right after it
+	// is read (see image2gb_batch_add()).
+	StructBatch.pool = g_thread_pool_new(image2gb_batch_convert, & StructBatch, UIworkers, FALSE, NULL);
+	
+	// Until the end, messages are kept for the summary, instead of every one of
+	// them opening its own message box.
+	UIlogHandler = g_log_set_handler(NULL, G_LOG_LEVEL_MESSAGE, image2gb_batch_log, NULL);
+	
+	if (Isource == IMAGE2GB_BATCH_IMAGES)
+	{
+		ArrayItems = gimp_image_list(& IitemCount);
+		
+		for (gint item = 0; item < IitemCount; item++)
+			image2gb_batch_add(& StructBatch, ArrayItems[item], gimp_image_get_active_drawable(ArrayItems[item]), NULL,
+			                   Sfolder, Ibank, Iformat, Icompression);
+	}
+	else
+	{
+		ArrayItems = gimp_image_get_layers(IimageID, & IitemCount);
+		
+		for (gint item = 0; item < IitemCount; item++)
+		{
+			gchar* SlayerName = NULL; /**< Name of the layer, it becomes the asset name. */
+			
+			// Layer groups have no pixels of their own.
+			if ((! gimp_item_get_visible(ArrayItems[item])) || gimp_item_is_group(ArrayItems[item]))
+				continue;
+				
+			SlayerName = gimp_item_get_name(ArrayItems[item]);
+			
+			image2gb_batch_add(& StructBatch, IimageID, ArrayItems[item], SlayerName, Sfolder, Ibank, Iformat, Icompression);
+			
+			g_free(SlayerName);
+		}
+	}
+	
+	// Wait for all conversions to finish.
+	if (StructBatch.pool != NULL)
+		g_thread_pool_free(StructBatch.pool, FALSE, TRUE);
+		
+	g_log_remove_handler(NULL, UIlogHandler);
+	
+	// Everything is reported at once, in the same order the assets were read.
+	for (guint job = 0; job < StructBatch.jobs->len; job++)
+	{
+		if (((BatchJob*) g_ptr_array_index(StructBatch.jobs, job))->success)
+			UIexported++;
+	}
+	
+	Sreport = g_string_new(NULL);
+	g_string_append_printf(Sreport, "Image2GB batch export: %u of %u assets exported in %.3f ms.\n",
+	                       UIexported, StructBatch.jobs->len, ((g_get_monotonic_time() - ItimeStart) / 1000.0));
+	                       
+	for (guint job = 0; job < StructBatch.jobs->len; job++)
+	{
+		BatchJob* Pjob = g_ptr_array_index(StructBatch.jobs, job); /**< Asset to report. */
+		gchar** ArrayLines = g_strsplit(Pjob->log->str, "\n", -1); /**< Messages about the asset, one line each. */
+		
+		if (Pjob->success)
+			g_string_append_printf(Sreport, "  %s: %ux%u pixels, %u unique tiles.\n",
+			                       Pjob->context->options.name, Pjob->width, Pjob->height, Pjob->tileCount);
+		else
+			g_string_append_printf(Sreport, "  %s: FAILED.\n", Pjob->context->options.name);
+			
+		// Then whatever the export had to say about it.
+		for (guint line = 0; ArrayLines[line] != NULL; line++)
+		{
+			if (ArrayLines[line][0] != '\0')
+				g_string_append_printf(Sreport, "    %s\n", ArrayLines[line]);
+		}
+		
+		g_strfreev(ArrayLines);
+	}
+	
+	g_message("%s", Sreport->str);
+	
+	if (UIexported < StructBatch.jobs->len)
+		GreturnStatus = GIMP_PDB_EXECUTION_ERROR;
+		
+	for (guint job = 0; job < StructBatch.jobs->len; job++)
+		image2gb_batch_free_job(g_ptr_array_index(StructBatch.jobs, job));
+		
+	g_string_free(Sreport, TRUE);
+	g_free(ArrayItems);
+	g_ptr_array_free(StructBatch.jobs, TRUE);
+	g_hash_table_destroy(StructBatch.files);
+	g_mutex_clear(& StructBatch.lock);
+	g_cond_clear(& StructBatch.done);
+	
+	return GreturnStatus;
+}
+
+static GimpPDBStatusType
+image2gb_batch_animation(gint32 IimageID, const gchar* Sfolder, gint Ibank)
+{
+	PluginExportOptions StructExportOptions = {0}; /**< Export parameters of the animation. */
+	gchar* SimageFile = gimp_image_get_filename(IimageID); /**< File of the image, NULL if it was never saved. */
+	gint32* ArrayLayers = NULL; /**< All layers of the image, top to bottom. */
+	gint IlayerCount = 0; /**< Number of layers. */
+	GArray* GarrayFrames = g_array_new(FALSE, FALSE, sizeof(gint32)); /**< Layers that are frames, in order. */
+	guint UIwidth = 0; /**< Width of the frames, in pixels. */
+	guint UIheight = 0; /**< Height of the frames, in pixels. */
+	guchar* Ppixels = NULL; /**< Pixels of all frames, one after another. */
+	ExportContext* Pcontext = NULL; /**< State of the export. */
+	gint64 ItimeStart = 0; /**< When the stage being timed started. */
+	GimpPDBStatusType GreturnStatus = GIMP_PDB_SUCCESS; /**< Return value. */
+	
+	// Same name and folder rules as a whole image of a batch.
+	if ((! image2gb_load_parameters(IimageID, & StructExportOptions)) || (StructExportOptions.name[0] == '\0'))
+	{
+		gchar* SimageName = gimp_image_get_name(IimageID); /**< Name of the image, for the ones never saved. */
+		
+		image2gb_make_asset_name((SimageFile != NULL) ? SimageFile : SimageName, StructExportOptions.name);
+		
+		g_free(SimageName);
+	}
+	
+	if ((Sfolder != NULL) && (Sfolder[0] != '\0'))
+		g_strlcpy(StructExportOptions.folder, Sfolder, sizeof(StructExportOptions.folder));
+	else if ((StructExportOptions.folder[0] == '\0') && (SimageFile != NULL))
+	{
+		gchar* SimageFolder = g_path_get_dirname(SimageFile); /**< Folder of the image file. */
+		
+		g_strlcpy(StructExportOptions.folder, SimageFolder, sizeof(StructExportOptions.folder));
+		
+		g_free(SimageFolder);
+	}
+	
+	StructExportOptions.bank = Ibank;
+	
+	g_free(SimageFile);
+	
+	if (StructExportOptions.folder[0] == '\0')
+	{
+		g_message("There is no folder to save to (the image was never saved nor exported).\n");
+		
+		GreturnStatus = GIMP_PDB_CALLING_ERROR;
+	}
+	
+	// Like GIF animations, frames go from the bottom layer to the top one.
+	ArrayLayers = gimp_image_get_layers(IimageID, & IlayerCount);
+	
+	for (gint layer = (IlayerCount - 1); layer >= 0; layer--)
+	{
+		// Layer groups have no pixels of their own.
+		if (gimp_item_get_visible(ArrayLayers[layer]) && (! gimp_item_is_group(ArrayLayers[layer])))
+			g_array_append_val(GarrayFrames, ArrayLayers[layer]);
+	}
+	
+	g_free(ArrayLayers);
+	
+	if ((GreturnStatus == GIMP_PDB_SUCCESS) && (GarrayFrames->len == 0))
+	{
+		g_message("The image has no visible layers to export.\n");
+		
+		GreturnStatus = GIMP_PDB_CALLING_ERROR;
+	}
+	
+	if (GreturnStatus == GIMP_PDB_SUCCESS)
+	{
+		UIwidth = gimp_drawable_width(g_array_index(GarrayFrames, gint32, 0));
+		UIheight = gimp_drawable_height(g_array_index(GarrayFrames, gint32, 0));
+		
+		for (guint frame = 1; frame < GarrayFrames->len; frame++)
+		{
+			if ((gimp_drawable_width(g_array_index(GarrayFrames, gint32, frame)) != (gint) UIwidth) ||
+			    (gimp_drawable_height(g_array_index(GarrayFrames, gint32, frame)) != (gint) UIheight))
+			{
+				g_message("All layers of an animation should have the same size (the bottom one is %ux%u pixels).\n", UIwidth, UIheight);
+				
+				GreturnStatus = GIMP_PDB_CALLING_ERROR;
+				
+				break;
+			}
+		}
+	}
+	
+	if ((GreturnStatus == GIMP_PDB_SUCCESS) && ((! image2gb_check_image(IimageID, UIwidth, UIheight))
+	                                            || (! image2gb_animation_check(StructExportOptions.name, UIwidth, UIheight, GarrayFrames->len))))
+		GreturnStatus = GIMP_PDB_CALLING_ERROR;
+		
+	if (GreturnStatus != GIMP_PDB_SUCCESS)
+	{
+		g_array_free(GarrayFrames, TRUE);
+		
+		return GreturnStatus;
+	}
+	
+	Pcontext = image2gb_animation_new(& StructExportOptions);
+	Ppixels = g_new(guchar, ((gsize) UIwidth * UIheight * GarrayFrames->len));
+	
+	ItimeStart = g_get_monotonic_time();
+	
+	for (guint frame = 0; frame < GarrayFrames->len; frame++)
+	{
+		guchar* Pframe = image2gb_batch_read(g_array_index(GarrayFrames, gint32, frame), UIwidth, UIheight, & Pcontext->stats); /**< Pixels of this frame. */
+		
+		memcpy((Ppixels + ((gsize) UIwidth * UIheight * frame)), Pframe, ((gsize) UIwidth * UIheight));
+		
+		g_free(Pframe);
+	}
+	
+	image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_READ, ItimeStart);
+	
+	if ((! image2gb_animation_convert(Pcontext, Ppixels, UIwidth, UIheight, GarrayFrames->len))
+	    || (! image2gb_animation_emit(Pcontext, GarrayFrames->len)))
+		GreturnStatus = GIMP_PDB_EXECUTION_ERROR;
+		
+	image2gb_context_free(Pcontext);
+	g_free(Ppixels);
+	g_array_free(GarrayFrames, TRUE);
+	
+	return GreturnStatus;
+}
+
+static void
+image2gb_batch_add(ExportBatch* Pbatch, gint32 IimageID, gint32 IdrawableID, const gchar* SlayerName,
+                   const gchar* Sfolder, gint Ibank, gint Iformat, gint Icompression)
+{
+	BatchJob* Pjob = g_new0(BatchJob, 1); /**< The new asset. */
+	PluginExportOptions StructExportOptions = {0}; /**< Export parameters of the asset. */
+	gchar* SimageFile = gimp_image_get_filename(IimageID); /**< File of the image, NULL if it was never saved. */
+	gchar* SimageName = gimp_image_get_name(IimageID); /**< Name of the image, for the ones never saved. */
+	gchar* SfileKey = NULL; /**< Folder and lowercase asset name, to find repeated ones. */
+	gboolean Bvalid = TRUE; /**< FALSE as soon as something is wrong with this asset. */
+	gint64 ItimeStart = 0; /**< When the stage being timed started. */
+	
+	Pjob->log = g_string_new(NULL);
+	g_ptr_array_add(Pbatch->jobs, Pjob);
+	
+	// Messages about this asset (from this thread too) go to its log.
+	g_private_set(& PbatchLog, Pjob->log);
+	
+	// Whole images keep the name they were last exported with, if any, layers
+	// are named after themselves. The folder given wins over the saved one, and
+	// the folder of the image file is the last resort. The ROM bank, the format
+	// and the compression are the same for the whole batch. Whole images also
+	// keep their tile base, layers start at tile 0 (both keep the upload budget
+	// and the map layout of the image).
+	if ((! image2gb_load_parameters(IimageID, & StructExportOptions)) || (SlayerName != NULL)
+	    || (StructExportOptions.name[0] == '\0'))
+		image2gb_make_asset_name((SlayerName != NULL) ? SlayerName : ((SimageFile != NULL) ? SimageFile : SimageName),
+		                         StructExportOptions.name);
+		                         
+	if ((Sfolder != NULL) && (Sfolder[0] != '\0'))
+		g_strlcpy(StructExportOptions.folder, Sfolder, sizeof(StructExportOptions.folder));
+	else if ((StructExportOptions.folder[0] == '\0') && (SimageFile != NULL))
+	{
+		gchar* SimageFolder = g_path_get_dirname(SimageFile); /**< Folder of the image file. */
+		
+		g_strlcpy(StructExportOptions.folder, SimageFolder, sizeof(StructExportOptions.folder));
+		
+		g_free(SimageFolder);
+	}
+	
+	StructExportOptions.bank = Ibank;
+	StructExportOptions.format = (Iformat == IMAGE2GB_FORMAT_BINARY) ? IMAGE2GB_FORMAT_BINARY : IMAGE2GB_FORMAT_SOURCE;
+	StructExportOptions.compression = CLAMP(Icompression, 0, (IMAGE2GB_COMPRESSION_COUNT - 1));
+	
+	if (SlayerName != NULL)
+		StructExportOptions.tileBase = 0;
+		
+	Pjob->context = image2gb_context_new(& StructExportOptions);
+	
+	// Whole images are exported at the size of the image, like the plugin does,
+	// layers at their own size.
+	Pjob->width = (SlayerName != NULL) ? gimp_drawable_width(IdrawableID) : gimp_image_width(IimageID);
+	Pjob->height = (SlayerName != NULL) ? gimp_drawable_height(IdrawableID) : gimp_image_height(IimageID);
+	
+	if (StructExportOptions.folder[0] == '\0')
+	{
+		g_message("There is no folder to save to (the image was never saved nor exported).\n");
+		
+		Bvalid = FALSE;
+	}
+	
+	if (Bvalid && (IdrawableID == -1))
+	{
+		g_message("The image has nothing to export.\n");
+		
+		Bvalid = FALSE;
+	}
+	
+	if (Bvalid)
+		Bvalid = image2gb_check_image(IimageID, Pjob->width, Pjob->height);
+		
+	// Two assets of the batch must not write the same files (they are named
+	// after the lowercase asset name).
+	if (Bvalid)
+	{
+		gchar* SnameLowercase = g_ascii_strdown(StructExportOptions.name, -1); /**< Asset name, all lowercase. */
+		
+		SfileKey = g_build_filename(StructExportOptions.folder, SnameLowercase, NULL);
+		
+		g_free(SnameLowercase);
+		
+		if (g_hash_table_contains(Pbatch->files, SfileKey))
+		{
+			g_message("Another asset of this batch is saved with the same name to the same folder.\n");
+			
+			g_free(SfileKey);
+			
+			Bvalid = FALSE;
+		}
+		else
+			g_hash_table_insert(Pbatch->files, SfileKey, NULL);
+	}
+	
+	g_free(SimageFile);
+	g_free(SimageName);
+	
+	if (! Bvalid)
+	{
+		g_private_set(& PbatchLog, NULL);
+		
+		return;
+	}
+	
+	// Wait if too many assets are already waiting to be converted, so the
+	// memory used by their pixels stays bounded.
+	g_mutex_lock(& Pbatch->lock);
+	
+	while (Pbatch->pending >= Pbatch->pendingMax)
+		g_cond_wait(& Pbatch->done, & Pbatch->lock);
+		
+	Pbatch->pending++;
+	
+	g_mutex_unlock(& Pbatch->lock);
+	
+	ItimeStart = g_get_monotonic_time();
+	
+	Pjob->pixels = image2gb_batch_read(IdrawableID, Pjob->width, Pjob->height, & Pjob->context->stats);
+	
+	image2gb_trace_stage(& Pjob->context->stats, IMAGE2GB_STAGE_READ, ItimeStart);
+	
+	g_private_set(& PbatchLog, NULL);
+	
+	if (Pbatch->pool != NULL)
+		g_thread_pool_push(Pbatch->pool, Pjob, NULL);
+	else
+		image2gb_batch_convert(Pjob, Pbatch);
+}
+
+static guchar*
+image2gb_batch_read(gint32 IdrawableID, guint UIwidth, guint UIheight, ExportStats* Pstats)
+{
+	GeglBuffer* Gbuffer = gimp_drawable_get_buffer(IdrawableID); /**< GEGL buffer that holds the pixels of the drawable. */
+	const Babl* Gformat = gimp_drawable_get_format(IdrawableID); /**< Native format of the drawable (palette indices, maybe with alpha). */
+	gsize UIpixelBytes = babl_format_get_bytes_per_pixel(Gformat); /**< Size of a pixel in that format. */
+	gsize UIpixelCount = ((gsize) UIwidth * UIheight); /**< Number of pixels to read. */
+	guchar* Ppixels = g_new(guchar, (UIpixelCount * UIpixelBytes)); /**< Return value. */
+	
+	// Same as image2gb_read_image_gegl(), but the whole image at once, as the
+	// conversion happens later, in another thread.
+	gegl_buffer_get(Gbuffer, GEGL_RECTANGLE(0, 0, UIwidth, UIheight),
+	                1.0, Gformat, Ppixels, (UIwidth * UIpixelBytes), GEGL_ABYSS_NONE);
+	                
+	Pstats->pdbCalls += 2;
+	Pstats->pixelTransfers++;
+	Pstats->bytesRead += (UIpixelCount * UIpixelBytes);
+	
+	// Layers usually have an alpha channel: keep only the palette index, the
+	// first byte of every pixel.
+	if (UIpixelBytes > 1)
+	{
+		for (gsize p = 0; p < UIpixelCount; p++)
+			Ppixels[p] = Ppixels[p * UIpixelBytes];
+	}
+	
+	g_object_unref(Gbuffer);
+	
+	return Ppixels;
+}
+
+static void
+image2gb_batch_convert(gpointer Pjob, gpointer Pdata)
+{
+	BatchJob* PbatchJob = Pjob; /**< Asset to convert. */
+	ExportBatch* Pbatch = Pdata; /**< Batch it belongs to. */
+	
+	g_private_set(& PbatchLog, PbatchJob->log);
+	
+	PbatchJob->success = image2gb_context_convert(PbatchJob->context, PbatchJob->pixels,
+	                                              PbatchJob->width, PbatchJob->height, PbatchJob->width);
+	                                              
+	g_free(PbatchJob->pixels);
+	PbatchJob->pixels = NULL;
+	
+	if (PbatchJob->success)
+		PbatchJob->success = image2gb_context_emit(PbatchJob->context);
+		
+	// Only the numbers are needed for the summary.
+	PbatchJob->tileCount = PbatchJob->context->tileCount;
+	image2gb_free_tiles(PbatchJob->context);
+	
+	g_private_set(& PbatchLog, NULL);
+	
+	g_mutex_lock(& Pbatch->lock);
+	
+	Pbatch->pending--;
+	g_cond_signal(& Pbatch->done);
+	
+	g_mutex_unlock(& Pbatch->lock);
+}
+
+static void
+image2gb_batch_free_job(BatchJob* Pjob)
+{
+	image2gb_context_free(Pjob->context);
+	g_string_free(Pjob->log, TRUE);
+	g_free(Pjob->pixels);
+	g_free(Pjob);
+}
+
+static void
+image2gb_batch_log(const gchar* Sdomain, GLogLevelFlags Glevel, const gchar* Smessage, gpointer Pdata)
+{
+	GString* Slog = g_private_get(& PbatchLog); /**< Messages about the asset of this thread, if any. */
+	
+	if (Slog != NULL)
+	{
+		g_string_append(Slog, Smessage);
+		
+		if (! g_str_has_suffix(Smessage, "\n"))
+			g_string_append_c(Slog, '\n');
+	}
+	else
+		gimp_message(Smessage);
+}
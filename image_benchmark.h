@@ -0,0 +1,115 @@
+/**
+ * @file  image_benchmark.h
+ * @brief Benchmark of the strategies for reading a GIMP image - header + implementation.
+ */
+
+#pragma once
+
+#include "image_export.h" // For the image readers.
+
+// Ignore warnings in external libraries (GIMP, GTK...).
+#pragma GCC system_header
+#include <libgimp/gimp.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_BENCHMARK_ITERATIONS_DEFAULT 10 /**< How many times each reader is run, unless told otherwise. */
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** Object that describes one of the image readers being compared.
+ */
+typedef struct BenchmarkReader
+{
+	ImageReadMethod method; /**< Strategy to pass to image2gb_read_image_tiles(). */
+	const gchar* name; /**< Human readable name, for the report. */
+} BenchmarkReader;
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Times every image reading strategy on the given drawable, and reports the
+ *  results. Returns the program status.
+ */
+static GimpPDBStatusType
+image2gb_benchmark_readers(gint32 IimageID, gint32 IdrawableID, gint Iiterations);
+
+////////////////////////////////////////////////////////////////////////////////
+
+static GimpPDBStatusType
+image2gb_benchmark_readers(gint32 IimageID, gint32 IdrawableID, gint Iiterations)
+{
+	const BenchmarkReader ArrayReaders[] = {{IMAGE2GB_READ_BANDS, "GimpPixelRgn (bands of rows)"},
+		{IMAGE2GB_READ_NATIVE, "GimpPixelRgn (storage tiles)"},
+		{IMAGE2GB_READ_GEGL, "GeglBuffer (bands of rows)"}
+	};
+	
+	GString* Sreport = NULL; /**< Text of the final report. */
+	DataTile* PreferenceTiles = NULL; /**< Tiles produced by the first reader, the others must match them. */
+	DataTile* PdataTiles = NULL; /**< Tiles produced by the reader being timed. */
+	guint UItileTotal = 0; /**< Number of tiles in the image. */
+	ExportContext* Pcontext = NULL; /**< Gives the readers the size of the image (nothing is exported). */
+	
+	// This procedure is not bound by the export size limit (so readers can be
+	// compared on big images too), but the tiles must still be whole.
+	if (((gimp_image_width(IimageID) % IMAGE2GB_TILE_SIZE) != 0)
+	    || ((gimp_image_height(IimageID) % IMAGE2GB_TILE_SIZE) != 0))
+	{
+		g_message("Both width and height should be multiples of %d.\n", IMAGE2GB_TILE_SIZE);
+		
+		return GIMP_PDB_CALLING_ERROR;
+	}
+	
+	if (Iiterations <= 0)
+		Iiterations = IMAGE2GB_BENCHMARK_ITERATIONS_DEFAULT;
+		
+	// The readers use its size to walk the image.
+	Pcontext = image2gb_context_new(NULL);
+	image2gb_context_set_size(Pcontext, gimp_image_width(IimageID), gimp_image_height(IimageID));
+	UItileTotal = (Pcontext->tileWidth * Pcontext->tileHeight);
+	
+	// Our own arrays, so the export ones are left alone.
+	PreferenceTiles = g_new0(DataTile, UItileTotal);
+	PdataTiles = g_new(DataTile, UItileTotal);
+	
+	Sreport = g_string_new(NULL);
+	g_string_append_printf(Sreport, "Image2GB read benchmark: %ux%u pixels (%u tiles), %d iterations.\n",
+	                       (Pcontext->tileWidth * IMAGE2GB_TILE_SIZE), (Pcontext->tileHeight * IMAGE2GB_TILE_SIZE),
+	                       UItileTotal, Iiterations);
+	                       
+	image2gb_read_image_tiles(IimageID, IdrawableID, ArrayReaders[0].method, Pcontext, PreferenceTiles);
+	
+	for (guint reader = 0; reader < G_N_ELEMENTS(ArrayReaders); reader++)
+	{
+		gint64 ItimeStart = 0; /**< Monotonic time before running the reader, in microseconds. */
+		gint64 ItimeTotal = 0; /**< Time spent by all the iterations, in microseconds. */
+		gdouble DtimeAverage = 0; /**< Time spent by a single iteration, in microseconds. */
+		
+		for (gint iteration = 0; iteration < Iiterations; iteration++)
+		{
+			// The tiles are built with OR operations, they must start empty.
+			memset(PdataTiles, 0, (UItileTotal * sizeof(DataTile)));
+			
+			ItimeStart = g_get_monotonic_time();
+			image2gb_read_image_tiles(IimageID, IdrawableID, ArrayReaders[reader].method, Pcontext, PdataTiles);
+			ItimeTotal += (g_get_monotonic_time() - ItimeStart);
+		}
+		
+		DtimeAverage = ((gdouble) ItimeTotal / Iiterations);
+		
+		g_string_append_printf(Sreport, "  %-30s %10.3f ms/read %10.1f ns/tile %8.2f MB/s%s\n",
+		                       ArrayReaders[reader].name,
+		                       (DtimeAverage / 1000.0),
+		                       ((DtimeAverage * 1000.0) / UItileTotal),
+		                       ((UItileTotal * IMAGE2GB_TILE_SIZE * IMAGE2GB_TILE_SIZE) / DtimeAverage),
+		                       (memcmp(PdataTiles, PreferenceTiles, (UItileTotal * sizeof(DataTile))) == 0) ? "" : " (MISMATCH!)");
+	}
+	
+	g_message("%s", Sreport->str);
+	
+	g_string_free(Sreport, TRUE);
+	g_free(PdataTiles);
+	g_free(PreferenceTiles);
+	image2gb_context_free(Pcontext);
+	
+	return GIMP_PDB_SUCCESS;
+}
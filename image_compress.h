@@ -0,0 +1,431 @@
+/**
+ * @file  image_compress.h
+ * @brief Compression of the exported data (RLE and LZ), in the formats the decompressors in gbdk/ read - header + implementation.
+ */
+
+#pragma once
+
+// Ignore warnings in external libraries (GLib...).
+#pragma GCC system_header
+#include <glib.h>
+#include <string.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_RLE_COUNT_MAX 127 /**< Longest literal or run of a RLE token. */
+
+#define IMAGE2GB_LZ_LITERAL_MAX   127   /**< Longest literal of a LZ token. */
+#define IMAGE2GB_LZ_NEAR_MIN      3     /**< Shortest near match (1 byte of distance, up to 256 back). */
+#define IMAGE2GB_LZ_NEAR_MAX      66    /**< Longest near match. */
+#define IMAGE2GB_LZ_NEAR_DISTANCE 256   /**< Farthest back a near match can start. */
+#define IMAGE2GB_LZ_FAR_MIN       4     /**< Shortest far match (2 bytes of distance). */
+#define IMAGE2GB_LZ_FAR_MAX       67    /**< Longest far match. */
+#define IMAGE2GB_LZ_FAR_DISTANCE  65535 /**< Farthest back a far match can start. */
+#define IMAGE2GB_LZ_HASH_BITS     16    /**< Size of the table of 3-byte prefixes that starts every hash chain (log2). */
+#define IMAGE2GB_LZ_CHAIN_MAX     256   /**< Earlier positions looked at for every match (more compress better, but slower). */
+
+// Estimated CPU cycles (at 4.19 MHz, 70224 per frame) the decompressors in
+// gbdk/ take, as compiled by SDCC, when writing into VRAM with the display on
+// (every access waits for the video memory to be free).
+#define IMAGE2GB_CYCLES_TOKEN        52 /**< Reading a control byte and telling what it is. */
+#define IMAGE2GB_CYCLES_LITERAL_BYTE 64 /**< Copying a byte from ROM into VRAM. */
+#define IMAGE2GB_CYCLES_RUN_BYTE     48 /**< Writing the repeated byte of a run into VRAM. */
+#define IMAGE2GB_CYCLES_MATCH        96 /**< Reading the distance of a match, and finding where it starts. */
+#define IMAGE2GB_CYCLES_MATCH_BYTE   88 /**< Copying a byte from VRAM into VRAM. */
+#define IMAGE2GB_CYCLES_FRAME        70224 /**< CPU cycles of a whole frame (the screen is drawn 59.7 times per second). */
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** Ways the tile data and the map can be compressed. The values are the ones
+ *  the header of the asset and the decompressors in gbdk/ use.
+ */
+typedef enum ExportCompression
+{
+	IMAGE2GB_COMPRESSION_NONE = 0, /**< Raw bytes. */
+	IMAGE2GB_COMPRESSION_RLE = 1,  /**< Literals and runs of a repeated byte, fastest to decode. */
+	IMAGE2GB_COMPRESSION_LZ = 2,   /**< Literals and copies of earlier output, smallest (runs are copies 1 byte back). */
+	IMAGE2GB_COMPRESSION_COUNT     /**< Number of ways (not one of them). */
+} ExportCompression;
+
+// VARIABLES ///////////////////////////////////////////////////////////////////
+
+/** Names of the compression methods, as the command line tool and the headers
+ *  of the assets call them.
+ */
+static const gchar* const ArrayCompressionNames[IMAGE2GB_COMPRESSION_COUNT] = {"none", "rle", "lz"};
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Returns the compression method with the given name (see
+ *  ArrayCompressionNames), or -1 if there is none.
+ */
+static gint
+image2gb_compression_from_name(const gchar* Sname);
+
+/** Compresses UIlength bytes with the given method, appending the result to
+ *  Gpacked (always ending with the end marker, a 0 byte).
+ *
+ *  Both formats are made of tokens that start with a control byte C:
+ *   - 0x00: end of the data.
+ *   - 0x01 to 0x7F: C literal bytes follow, copied as they are.
+ *   - RLE, 0x81 to 0xFF: a byte follows, repeated (C & 0x7F) times.
+ *   - LZ, 0x80 to 0xBF: a byte D follows, (C & 0x3F) + 3 bytes are copied from
+ *     D + 1 bytes back in the output (the copy may overlap what it writes).
+ *   - LZ, 0xC0 to 0xFF: 2 bytes follow (D, little-endian), (C & 0x3F) + 4 bytes
+ *     are copied from D + 1 bytes back in the output.
+ */
+static void
+image2gb_compress(ExportCompression Ecompression, const guint8* Pdata, gsize UIlength, GByteArray* Gpacked);
+
+/** Compresses with RLE (see image2gb_compress()): runs of 3 or more bytes are
+ *  runs, the rest literals.
+ */
+static void
+image2gb_compress_rle(const guint8* Pdata, gsize UIlength, GByteArray* Gpacked);
+
+/** Compresses with LZ (see image2gb_compress()). Matches are searched through
+ *  hash chains, and the tokens are chosen for the smallest output (not the
+ *  longest match every time): ROM space is what matters on the Game Boy.
+ */
+static void
+image2gb_compress_lz(const guint8* Pdata, gsize UIlength, GByteArray* Gpacked);
+
+/** Appends literal bytes to Gpacked, in as many tokens as needed.
+ */
+static void
+image2gb_compress_literals(const guint8* Pdata, gsize UIlength, guint UImax, GByteArray* Gpacked);
+
+/** Decompresses the data (the way the decompressors in gbdk/ do), appending it
+ *  to Gdata, and adds the CPU cycles it would take on the Game Boy to
+ *  Pcycles. Returns TRUE if success, FALSE if the data is damaged.
+ */
+static gboolean
+image2gb_decompress(ExportCompression Ecompression, const guint8* Ppacked, gsize UIlength, GByteArray* Gdata, guint64* Pcycles);
+
+////////////////////////////////////////////////////////////////////////////////
+
+static gint
+image2gb_compression_from_name(const gchar* Sname)
+{
+	for (gint compression = 0; compression < IMAGE2GB_COMPRESSION_COUNT; compression++)
+	{
+		if (g_ascii_strcasecmp(Sname, ArrayCompressionNames[compression]) == 0)
+			return compression;
+	}
+	
+	return -1;
+}
+
+static void
+image2gb_compress(ExportCompression Ecompression, const guint8* Pdata, gsize UIlength, GByteArray* Gpacked)
+{
+	if (Ecompression == IMAGE2GB_COMPRESSION_RLE)
+		image2gb_compress_rle(Pdata, UIlength, Gpacked);
+	else
+		image2gb_compress_lz(Pdata, UIlength, Gpacked);
+		
+	g_byte_array_append(Gpacked, (const guint8*) "", 1);
+}
+
+static void
+image2gb_compress_rle(const guint8* Pdata, gsize UIlength, GByteArray* Gpacked)
+{
+	gsize UIliteral = 0; /**< Start of the bytes not written yet (a literal, unless a run follows). */
+	gsize UIposition = 0; /**< Byte being looked at. */
+	
+	while (UIposition < UIlength)
+	{
+		gsize UIrun = 1; /**< Times the byte at UIposition repeats. */
+		guint8 ArrayToken[2]; /**< The run. */
+		
+		while (((UIposition + UIrun) < UIlength) && (Pdata[UIposition + UIrun] == Pdata[UIposition])
+		       && (UIrun < IMAGE2GB_RLE_COUNT_MAX))
+			UIrun++;
+			
+		// Shorter runs take no less room than the bytes themselves.
+		if (UIrun < 3)
+		{
+			UIposition += UIrun;
+			
+			continue;
+		}
+		
+		image2gb_compress_literals(Pdata + UIliteral, (UIposition - UIliteral), IMAGE2GB_RLE_COUNT_MAX, Gpacked);
+		
+		ArrayToken[0] = (0x80 | UIrun);
+		ArrayToken[1] = Pdata[UIposition];
+		
+		g_byte_array_append(Gpacked, ArrayToken, 2);
+		
+		UIposition += UIrun;
+		UIliteral = UIposition;
+	}
+	
+	image2gb_compress_literals(Pdata + UIliteral, (UIlength - UIliteral), IMAGE2GB_RLE_COUNT_MAX, Gpacked);
+}
+
+static void
+image2gb_compress_lz(const guint8* Pdata, gsize UIlength, GByteArray* Gpacked)
+{
+	guint32* ArrayHeads = NULL; /**< Last position every 3-byte prefix was seen at (+1, 0 for none). */
+	guint32* ArrayChains = NULL; /**< Previous position with the same prefix as every position (+1, 0 for none). */
+	guint8* ArrayNearLength = NULL; /**< Longest near match at every position (0 for none). */
+	guint8* ArrayNearDistance = NULL; /**< Its distance, minus 1. */
+	guint8* ArrayFarLength = NULL; /**< Longest far match at every position (0 for none). */
+	guint16* ArrayFarDistance = NULL; /**< Its distance, minus 1. */
+	guint32* ArrayCost = NULL; /**< Smallest output for the rest of the data, from every position, when a literal did not come right before. */
+	guint32* ArrayCostAfterLiteral = NULL; /**< Same, when a literal came right before (it can go on for 1 byte each). */
+	guint8* ArrayChoice = NULL; /**< Length of the match chosen at every position (0 for a literal byte). */
+	guint8* ArrayChoiceAfterLiteral = NULL; /**< Same, when a literal came right before. */
+	gsize UIliteral = 0; /**< Start of the literal being gathered. */
+	gboolean BafterLiteral = FALSE; /**< Whether the last token chosen was a literal. */
+	
+	if (UIlength == 0)
+		return;
+		
+	ArrayHeads = g_new0(guint32, (1 << IMAGE2GB_LZ_HASH_BITS));
+	ArrayChains = g_new0(guint32, UIlength);
+	ArrayNearLength = g_new0(guint8, UIlength);
+	ArrayNearDistance = g_new0(guint8, UIlength);
+	ArrayFarLength = g_new0(guint8, UIlength);
+	ArrayFarDistance = g_new0(guint16, UIlength);
+	ArrayCost = g_new(guint32, (UIlength + 1));
+	ArrayCostAfterLiteral = g_new(guint32, (UIlength + 1));
+	ArrayChoice = g_new(guint8, UIlength);
+	ArrayChoiceAfterLiteral = g_new(guint8, UIlength);
+	
+	// First, the longest matches (near and far) at every position, looking at
+	// the closest earlier positions with the same first 3 bytes (the first one
+	// found of every length is the closest).
+	for (gsize position = 0; (position + IMAGE2GB_LZ_NEAR_MIN) <= UIlength; position++)
+	{
+		guint UIhash = (((Pdata[position] << 16) | (Pdata[position + 1] << 8) | Pdata[position + 2]) * 2654435761U)
+		               >> (32 - IMAGE2GB_LZ_HASH_BITS); /**< Slot of the prefix in ArrayHeads. */
+		gsize UImaxLength = MIN(IMAGE2GB_LZ_FAR_MAX, (UIlength - position)); /**< Longest match possible here. */
+		guint32 UIcandidate = ArrayHeads[UIhash]; /**< Earlier position being looked at (+1). */
+		
+		ArrayChains[position] = UIcandidate;
+		ArrayHeads[UIhash] = (position + 1);
+		
+		for (guint step = 0; (UIcandidate != 0) && (step < IMAGE2GB_LZ_CHAIN_MAX); step++, UIcandidate = ArrayChains[UIcandidate - 1])
+		{
+			gsize UIdistance = (position - (UIcandidate - 1)); /**< How far back the candidate is. */
+			gsize UImatch = 0; /**< Bytes the candidate has in common with this position. */
+			
+			if (UIdistance > IMAGE2GB_LZ_FAR_DISTANCE)
+				break;
+				
+			while ((UImatch < UImaxLength) && (Pdata[UIcandidate - 1 + UImatch] == Pdata[position + UImatch]))
+				UImatch++;
+				
+			if ((UIdistance <= IMAGE2GB_LZ_NEAR_DISTANCE) && (UImatch > ArrayNearLength[position]))
+			{
+				ArrayNearLength[position] = MIN(UImatch, IMAGE2GB_LZ_NEAR_MAX);
+				ArrayNearDistance[position] = (UIdistance - 1);
+			}
+			
+			if (UImatch > ArrayFarLength[position])
+			{
+				ArrayFarLength[position] = UImatch;
+				ArrayFarDistance[position] = (UIdistance - 1);
+			}
+			
+			if (UImatch == UImaxLength)
+				break;
+		}
+	}
+	
+	// Then, the cheapest way to encode the data from every position to the end
+	// (every literal byte costs 1, plus 1 for the control byte of the literal
+	// when it starts; a match costs 2 if near, 3 if far). Any shorter piece of
+	// a match is a match too, so all of its lengths are tried.
+	ArrayCost[UIlength] = 1;
+	ArrayCostAfterLiteral[UIlength] = 1;
+	
+	for (gsize position = UIlength; position-- > 0;)
+	{
+		guint32 UImatchCost = G_MAXUINT32; /**< Cheapest way found that starts with a match. */
+		guint8 UImatchLength = 0; /**< Length of that match. */
+		guint32 UIliteralCost = (ArrayCostAfterLiteral[position + 1] + 1); /**< Cost of going on with a literal byte. */
+		
+		for (guint length = IMAGE2GB_LZ_NEAR_MIN; length <= ArrayNearLength[position]; length++)
+		{
+			if ((ArrayCost[position + length] + 2) < UImatchCost)
+			{
+				UImatchCost = (ArrayCost[position + length] + 2);
+				UImatchLength = length;
+			}
+		}
+		
+		for (guint length = IMAGE2GB_LZ_FAR_MIN; length <= ArrayFarLength[position]; length++)
+		{
+			if ((ArrayCost[position + length] + 3) < UImatchCost)
+			{
+				UImatchCost = (ArrayCost[position + length] + 3);
+				UImatchLength = length;
+			}
+		}
+		
+		// On a tie, literals win: they are faster to decode (a match reads VRAM).
+		ArrayCostAfterLiteral[position] = MIN(UIliteralCost, UImatchCost);
+		ArrayChoiceAfterLiteral[position] = (UIliteralCost <= UImatchCost) ? 0 : UImatchLength;
+		ArrayCost[position] = MIN((UIliteralCost + 1), UImatchCost);
+		ArrayChoice[position] = ((UIliteralCost + 1) <= UImatchCost) ? 0 : UImatchLength;
+	}
+	
+	// Finally, write the tokens chosen, from the start.
+	for (gsize position = 0; position < UIlength;)
+	{
+		guint UImatch = BafterLiteral ? ArrayChoiceAfterLiteral[position] : ArrayChoice[position]; /**< Length of the match, 0 for a literal byte. */
+		guint8 ArrayToken[3]; /**< The match. */
+		
+		if (UImatch == 0)
+		{
+			if (! BafterLiteral)
+				UIliteral = position;
+				
+			BafterLiteral = TRUE;
+			position++;
+			
+			continue;
+		}
+		
+		if (BafterLiteral)
+			image2gb_compress_literals(Pdata + UIliteral, (position - UIliteral), IMAGE2GB_LZ_LITERAL_MAX, Gpacked);
+			
+		// The near match is preferred (smaller and faster), when it is there.
+		if (UImatch <= ArrayNearLength[position])
+		{
+			ArrayToken[0] = (0x80 | (UImatch - IMAGE2GB_LZ_NEAR_MIN));
+			ArrayToken[1] = ArrayNearDistance[position];
+			
+			g_byte_array_append(Gpacked, ArrayToken, 2);
+		}
+		else
+		{
+			ArrayToken[0] = (0xC0 | (UImatch - IMAGE2GB_LZ_FAR_MIN));
+			ArrayToken[1] = (ArrayFarDistance[position] & 0xFF);
+			ArrayToken[2] = (ArrayFarDistance[position] >> 8);
+			
+			g_byte_array_append(Gpacked, ArrayToken, 3);
+		}
+		
+		BafterLiteral = FALSE;
+		position += UImatch;
+	}
+	
+	if (BafterLiteral)
+		image2gb_compress_literals(Pdata + UIliteral, (UIlength - UIliteral), IMAGE2GB_LZ_LITERAL_MAX, Gpacked);
+		
+	g_free(ArrayChoiceAfterLiteral);
+	g_free(ArrayChoice);
+	g_free(ArrayCostAfterLiteral);
+	g_free(ArrayCost);
+	g_free(ArrayFarDistance);
+	g_free(ArrayFarLength);
+	g_free(ArrayNearDistance);
+	g_free(ArrayNearLength);
+	g_free(ArrayChains);
+	g_free(ArrayHeads);
+}
+
+static void
+image2gb_compress_literals(const guint8* Pdata, gsize UIlength, guint UImax, GByteArray* Gpacked)
+{
+	while (UIlength > 0)
+	{
+		guint8 UIcount = MIN(UIlength, UImax); /**< Bytes in this token. */
+		
+		g_byte_array_append(Gpacked, & UIcount, 1);
+		g_byte_array_append(Gpacked, Pdata, UIcount);
+		
+		Pdata += UIcount;
+		UIlength -= UIcount;
+	}
+}
+
+static gboolean
+image2gb_decompress(ExportCompression Ecompression, const guint8* Ppacked, gsize UIlength, GByteArray* Gdata, guint64* Pcycles)
+{
+	gsize UIstart = Gdata->len; /**< Where the output starts in Gdata (back references can not go before it). */
+	gsize UIposition = 0; /**< Byte of the input being read. */
+	
+	while (UIposition < UIlength)
+	{
+		guint8 UIcontrol = Ppacked[UIposition++]; /**< Control byte of the token. */
+		guint UIcount = 0; /**< Bytes the token writes. */
+		gsize UIdistance = 0; /**< How far back a match starts. */
+		
+		(* Pcycles) += IMAGE2GB_CYCLES_TOKEN;
+		
+		if (UIcontrol == 0)
+			return (UIposition == UIlength);
+			
+		// Literal.
+		if ((UIcontrol & 0x80) == 0)
+		{
+			if ((UIposition + UIcontrol) > UIlength)
+				return FALSE;
+				
+			g_byte_array_append(Gdata, Ppacked + UIposition, UIcontrol);
+			
+			UIposition += UIcontrol;
+			(* Pcycles) += (UIcontrol * IMAGE2GB_CYCLES_LITERAL_BYTE);
+			
+			continue;
+		}
+		
+		// Run.
+		if (Ecompression == IMAGE2GB_COMPRESSION_RLE)
+		{
+			UIcount = (UIcontrol & 0x7F);
+			
+			if ((UIcount == 0) || (UIposition >= UIlength))
+				return FALSE;
+				
+			for (guint byte = 0; byte < UIcount; byte++)
+				g_byte_array_append(Gdata, Ppacked + UIposition, 1);
+				
+			UIposition++;
+			(* Pcycles) += (UIcount * IMAGE2GB_CYCLES_RUN_BYTE);
+			
+			continue;
+		}
+		
+		// Match, near or far.
+		if ((UIcontrol & 0x40) == 0)
+		{
+			if (UIposition >= UIlength)
+				return FALSE;
+				
+			UIcount = ((UIcontrol & 0x3F) + IMAGE2GB_LZ_NEAR_MIN);
+			UIdistance = (Ppacked[UIposition] + 1);
+			UIposition++;
+		}
+		else
+		{
+			if ((UIposition + 2) > UIlength)
+				return FALSE;
+				
+			UIcount = ((UIcontrol & 0x3F) + IMAGE2GB_LZ_FAR_MIN);
+			UIdistance = ((Ppacked[UIposition] | (Ppacked[UIposition + 1] << 8)) + 1);
+			UIposition += 2;
+		}
+		
+		if (UIdistance > (Gdata->len - UIstart))
+			return FALSE;
+			
+		// Byte by byte, the copy may overlap what it writes.
+		for (guint byte = 0; byte < UIcount; byte++)
+		{
+			guint8 UIvalue = Gdata->data[Gdata->len - UIdistance]; /**< Byte copied. */
+			
+			g_byte_array_append(Gdata, & UIvalue, 1);
+		}
+		
+		(* Pcycles) += (IMAGE2GB_CYCLES_MATCH + (UIcount * IMAGE2GB_CYCLES_MATCH_BYTE));
+	}
+	
+	// The end marker is missing.
+	return FALSE;
+}
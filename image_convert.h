@@ -0,0 +1,2784 @@
+/**
+ * @file  image_convert.h
+ * @brief Conversion of indexed pixels to Game Boy data (tiles, tilemap and output files), without GIMP - header + implementation.
+ */
+
+#pragma once
+
+#include "source_strings.h"
+#include "image_trace.h"
+#include "image_compress.h"
+
+// Ignore warnings in external libraries (GLib...).
+#pragma GCC system_header
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+// SIMD packers are only built for x86 (GCC/Clang), elsewhere the scalar one is
+// used.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGE2GB_PACK_X86
+#include <immintrin.h>
+#endif
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_ASSET_NAME_MAX_LENGTH 32 /**< Max characters of the asset name used for the C variable identifier. */
+
+#define IMAGE2GB_TILE_SIZE 8 /**< Size of a tile, in pixels (any dimension). */
+#define IMAGE2GB_TILE_BYTES 16 /**< Size of a tile, in bytes of Game Boy data. */
+
+#define IMAGE2GB_IMAGE_SIZE_MIN IMAGE2GB_TILE_SIZE /**< Minimum acceptable image size, in pixels (any dimension). */
+#define IMAGE2GB_IMAGE_SIZE_MAX 32768              /**< Maximum acceptable image size, in pixels (any dimension). */
+
+#define IMAGE2GB_IMAGE_TILES_VRAM_LIMIT 256 /**< How many unique tiles will fit in GB's VRAM at a time. */
+#define IMAGE2GB_MAP_8BIT_TILES_MAX     256 /**< Up to this many unique tiles, tilemap entries are 8-bit (16-bit above). */
+#define IMAGE2GB_MAP_16BIT_TILES_MAX    65536 /**< Most unique tiles (counting from the tile base) 16-bit tilemap entries can number. */
+#define IMAGE2GB_TILE_BASE_MAX          (IMAGE2GB_IMAGE_TILES_VRAM_LIMIT - 1) /**< Last VRAM tile slot an asset can be loaded at. */
+#define IMAGE2GB_UPLOAD_BUDGET_MAX      2048                                  /**< Largest upload budget, in bytes per frame (far more than a frame can copy). */
+#define IMAGE2GB_VRAM_MAP_WIDTH         32                                    /**< Width of the background map in VRAM, in tiles (the pitch of the VRAM layout). */
+#define IMAGE2GB_VRAM_MAP_PAD           0                                     /**< Entry that pads the rows of the VRAM layout (VRAM tile 0, the tile base is not added). */
+
+#define IMAGE2GB_HASH_EMPTY G_MAXUINT /**< Value of an unused slot in a TileHashTable. */
+
+#define IMAGE2GB_STREAMING_TILES_MIN (256 * 256) /**< Images with more tiles than this are exported in streaming mode. */
+#define IMAGE2GB_STREAMING_BAND_TILES (64 * 1024) /**< In streaming mode, duplicates are removed in bands of rows of about this many tiles. */
+
+#define IMAGE2GB_PARALLEL_TILES_MIN (32 * 32) /**< Images with more tiles than this (256x256 pixels) are packed and deduplicated in parallel. */
+#define IMAGE2GB_PARALLEL_JOB_TILES 256       /**< Minimum number of tiles for a worker thread to be worth it. */
+#define IMAGE2GB_PARALLEL_WORKERS_MAX 64      /**< Maximum number of worker threads. */
+
+#define IMAGE2GB_OUTPUT_BUFFER_SIZE (4 * 1024 * 1024) /**< Output is written to disk when this many bytes are buffered (or at the end). */
+#define IMAGE2GB_OUTPUT_BUFFER_START (16 * 1024)      /**< The output buffer starts this big, and grows up to the size above as needed. */
+
+#define IMAGE2GB_CACHE_VARIABLE    "IMAGE2GB_CACHE_DIR" /**< Environment variable with the folder of the export cache (see image2gb_cache_lookup()). */
+#define IMAGE2GB_CACHE_VERSION     "3"                  /**< Goes into every cache key; change it when the output for the same tiles changes. */
+#define IMAGE2GB_CACHE_INFO        "entry.ini"          /**< File of a cache entry that stores what the outputs do not tell (the number of unique tiles). */
+#define IMAGE2GB_CACHE_CHUNK_TILES 4096                 /**< Tiles hashed together, the key is made of the hashes of these chunks. */
+
+#define IMAGE2GB_DEPFILE_EXTENSION "d"     /**< Extension of the dependency file of an asset (see image2gb_write_depfile()). */
+#define IMAGE2GB_STAMP_EXTENSION   "stamp" /**< Extension of the file rewritten by every successful export of an asset. */
+
+/** Expands to the 16 hex strings "0xN0" to "0xNF" (N being the given digit).
+ */
+#define IMAGE2GB_HEX_ROW(N) "0x" #N "0" "0x" #N "1" "0x" #N "2" "0x" #N "3" \
+                            "0x" #N "4" "0x" #N "5" "0x" #N "6" "0x" #N "7" \
+                            "0x" #N "8" "0x" #N "9" "0x" #N "A" "0x" #N "B" \
+                            "0x" #N "C" "0x" #N "D" "0x" #N "E" "0x" #N "F"
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** Formats the asset can be exported to.
+ */
+typedef enum ExportFormat
+{
+	IMAGE2GB_FORMAT_SOURCE = 0, /**< C source: .h header and .c source with the data as arrays. */
+	IMAGE2GB_FORMAT_BINARY = 1  /**< Binary: .h header plus raw .2bpp (tiles) and .tilemap (map) files. */
+} ExportFormat;
+
+/** Orders the tilemap entries can be written in. The values are the ones the
+ *  header of the asset uses.
+ */
+typedef enum ExportLayout
+{
+	IMAGE2GB_LAYOUT_ROWS = 0,    /**< Row by row, as wide as the image. */
+	IMAGE2GB_LAYOUT_COLUMNS = 1, /**< Column by column, as tall as the image: a column is a single linear copy (horizontal scrolling). */
+	IMAGE2GB_LAYOUT_VRAM = 2,    /**< Row by row, padded to the width of the background map in VRAM: rows go straight to it. */
+	IMAGE2GB_LAYOUT_COUNT        /**< Number of orders (not one of them). */
+} ExportLayout;
+
+/** Object that stores the export parameters.
+ */
+typedef struct PluginExportOptions
+{
+	gchar name[IMAGE2GB_ASSET_NAME_MAX_LENGTH]; /**< Base name of the image asset to export. */
+	gchar folder[PATH_MAX]; /**< Full path of the directory to save to. */
+	gint bank; /**< ROM bank to store the image data in. */
+	gint format; /**< Output format (see ExportFormat). */
+	gint tileBase; /**< VRAM tile slot the tiles are loaded at, added to every tilemap entry (0 to IMAGE2GB_TILE_BASE_MAX). */
+	gint compression; /**< How the tile data and the tilemap are compressed (see ExportCompression). */
+	gint uploadBudget; /**< Bytes of tile data copied to VRAM per frame, for the upload table (0 for no table, see image2gb_write_uploads()). */
+	gint mapLayout; /**< Order of the tilemap entries (see ExportLayout). */
+} PluginExportOptions;
+
+/** Object that represents a Game Boy tile: a 8x8 square with 4-color (2 bit)
+ *  pixels. Hence, a tile has 64 * 2 = 128 bits (16 bytes) of data, in 8 rows of
+ *  16 bits (2 bytes) each.
+ */
+typedef struct DataTile
+{
+	uint16_t row[IMAGE2GB_TILE_SIZE]; /**< Array that stores the 8 pixel rows of this tile. */
+	gboolean duplicate; /**< Flag for marking this tile as a duplicate of another. */
+} DataTile;
+
+/** Open addressing hash table (linear probing) that indexes tiles by their
+ *  data. It does not store the tiles, only their positions in an array owned
+ *  by the caller.
+ */
+typedef struct TileHashTable
+{
+	guint* slots; /**< Position of the tile stored in each slot, or IMAGE2GB_HASH_EMPTY. */
+	guint mask; /**< Number of slots minus 1 (there is always a power of 2 of them). */
+	guint count; /**< Number of slots in use. */
+} TileHashTable;
+
+/** Object that buffers the contents of an output file, so it can be written
+ *  with a single call instead of thousands of small ones.
+ */
+typedef struct OutputWriter
+{
+	FILE* file; /**< Temporary file the output goes to (renamed to name when complete), NULL while the output matches oldFile. */
+	gchar* name; /**< Full name of the file. */
+	gchar* tempName; /**< Full name of the temporary file, NULL while the output matches oldFile. */
+	FILE* oldFile; /**< The file being replaced, compared with the output until they differ (then closed), or NULL. */
+	guint64 matched; /**< Bytes at the start of the output that are the same in oldFile. */
+	gboolean binary; /**< Whether the file is written in binary mode (text mode otherwise). */
+	GString* buffer; /**< Contents not written yet. */
+	gint error; /**< Error code (errno) of the first failed write, 0 if none. */
+	ExportStats* stats; /**< Where the bytes written are counted. */
+} OutputWriter;
+
+/** Object that stores the compressed tile data and tilemap of an asset.
+ */
+typedef struct PackedOutput
+{
+	GByteArray* data; /**< Tile data, compressed (NULL if the asset is not compressed). */
+	GByteArray* map; /**< Tilemap, compressed. */
+	guint dataSize; /**< Size of the tile data before compression, in bytes. */
+	guint mapSize; /**< Size of the tilemap before compression, in bytes. */
+	guint64 cycles; /**< Estimated CPU cycles the Game Boy takes to decompress both into VRAM. */
+} PackedOutput;
+
+/** Pointer to a function that packs the 64 pixels of a tile (8 lines of 8,
+ *  UIrowstride bytes apart) into the given DataTile.
+ */
+typedef void (* TilePacker)(const guchar* Ppixels, guint UIrowstride, DataTile* PdataTile);
+
+/** Pointer to a function that returns the pixels of the given row of tiles (8
+ *  lines, UIrowstride bytes apart), or NULL if they could not be read. Pdata is
+ *  whatever the function needs to find them.
+ */
+typedef const guchar* (* TileRowReader)(guint UIrow, guint UIrowstride, gpointer Pdata);
+
+/** Part of the packing of a grid of tiles, done by a worker thread.
+ */
+typedef struct PackJob
+{
+	const guchar* pixels; /**< First pixel of the grid. */
+	guint rowstride; /**< Bytes from one line of pixels to the next. */
+	guint columns; /**< Width of the grid, in tiles. */
+	guint first; /**< First tile (counting row by row) packed by this job. */
+	guint last; /**< Tile after the last one packed by this job. */
+	DataTile* tiles; /**< Where the packed tiles of the whole grid go. */
+} PackJob;
+
+/** Part of the hashing of an array of tiles for the cache key, done by a
+ *  worker thread.
+ */
+typedef struct CacheJob
+{
+	const DataTile* tiles; /**< All the tiles being hashed. */
+	guint tileTotal; /**< Number of tiles in the array. */
+	guint first; /**< First chunk (of IMAGE2GB_CACHE_CHUNK_TILES tiles) hashed by this job. */
+	guint last; /**< Chunk after the last one hashed by this job. */
+	guint8* digests; /**< Where the SHA-256 of every chunk goes (32 bytes each). */
+} CacheJob;
+
+/** Part of the deduplication of an array of tiles, done by a worker thread.
+ *  First every job hashes a range of tiles, then every job looks for the
+ *  duplicates among the tiles of its shard (those whose hash falls in its part
+ *  of the hash space).
+ */
+typedef struct DedupeJob
+{
+	const DataTile* tiles; /**< Tiles to deduplicate. */
+	guint tileTotal; /**< Number of tiles. */
+	guint* hashes; /**< Hash of every tile. */
+	guint* originals; /**< Position of the first tile with the same data, for every tile. */
+	guint first; /**< First tile hashed by this job. */
+	guint last; /**< Tile after the last one hashed by this job. */
+	guint shard; /**< Shard this job is in charge of. */
+	guint shardCount; /**< Number of shards (and of jobs). */
+} DedupeJob;
+
+/** What the deduplication of a previous export of the same image found, so the
+ *  next one only has to redo the tiles that changed (see
+ *  image2gb_find_originals_incremental()). The arrays are not owned.
+ */
+typedef struct DedupeState
+{
+	guint tileWidth; /**< Width of the image in Game Boy tiles. */
+	guint tileHeight; /**< Height of the image in Game Boy tiles. */
+	guint tileCount; /**< Number of unique tiles. */
+	const guint* hashes; /**< Hash of every tile (see image2gb_tile_hash()). */
+	const guint* map; /**< Tilemap (position of the unique tile of every tile, duplicates removed). */
+	const uint16_t* tiles; /**< Data of the unique tiles, IMAGE2GB_TILE_SIZE rows each. */
+} DedupeState;
+
+/** Object that stores everything about the conversion of one image, from its
+ *  tiles to the statistics. Conversions only touch their own context, so any
+ *  number of them can run at the same time (in different threads too).
+ */
+typedef struct ExportContext
+{
+	PluginExportOptions options; /**< Export parameters. */
+	guint tileWidth; /**< Width of the asset in Game Boy tiles. */
+	guint tileHeight; /**< Height of the asset in Game Boy tiles. */
+	guint tileCount; /**< Number of unique tiles the asset has. */
+	gpointer arena; /**< Memory block that holds both tiles and map, sized for the image (allocated once). */
+	DataTile* tiles; /**< All tiles of the image, in Game Boy data format. */
+	guint* map; /**< Tilemap of the image, in Game Boy data format. NULL in streaming mode, it is in streamedMap instead. */
+	guint* hashes; /**< Hash of every tile, kept for the next export (see DedupeState). NULL in streaming mode. */
+	FILE* streamedMap; /**< Temporary file that stores the tilemap in streaming mode (raw guint32 entries, row after row), or NULL. */
+	gchar* streamedMapName; /**< Full name of streamedMap, so it can be deleted afterwards. */
+	GChecksum* cacheKey; /**< Key of the export in the cache, as it is computed (tiles are added as they are packed), or NULL if there is no cache. */
+	gchar* cacheEntry; /**< Folder of the export in the cache, once the key is complete (NULL until then). */
+	gboolean cacheHit; /**< Whether the output is already in the cache (so there is nothing to deduplicate nor to write). */
+	GPtrArray* dependencies; /**< Input files the output depends on, for the depfile, or NULL if there is no depfile. */
+	PackedOutput packed; /**< Compressed tile data and tilemap, once written (if the asset is compressed). */
+	ExportStats stats; /**< Timing and counters of the conversion. */
+} ExportContext;
+
+// VARIABLES ///////////////////////////////////////////////////////////////////
+
+/** All byte values as C hex literals, "0x00" to "0xFF", 4 characters each (no
+ *  separators). Used for writing the output without printf.
+ */
+static const gchar SHexTable[] = IMAGE2GB_HEX_ROW(0) IMAGE2GB_HEX_ROW(1) IMAGE2GB_HEX_ROW(2) IMAGE2GB_HEX_ROW(3)
+                                 IMAGE2GB_HEX_ROW(4) IMAGE2GB_HEX_ROW(5) IMAGE2GB_HEX_ROW(6) IMAGE2GB_HEX_ROW(7)
+                                 IMAGE2GB_HEX_ROW(8) IMAGE2GB_HEX_ROW(9) IMAGE2GB_HEX_ROW(A) IMAGE2GB_HEX_ROW(B)
+                                 IMAGE2GB_HEX_ROW(C) IMAGE2GB_HEX_ROW(D) IMAGE2GB_HEX_ROW(E) IMAGE2GB_HEX_ROW(F);
+
+/** Names of the tilemap layouts, as the command line tool and the headers of
+ *  the assets call them.
+ */
+static const gchar* const ArrayLayoutNames[IMAGE2GB_LAYOUT_COUNT] = {"rows", "columns", "vram"};
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Creates the context for converting an image with the given export
+ *  parameters (NULL if it will not be emitted). Free it with
+ *  image2gb_context_free().
+ */
+static ExportContext*
+image2gb_context_new(const PluginExportOptions* PexportOptions);
+
+/** Converts an image in memory: one byte per pixel, with values from 0 to 3,
+ *  lines UIrowstride bytes apart. Its size must be made of whole tiles. Returns
+ *  TRUE if success, FALSE otherwise.
+ */
+static gboolean
+image2gb_context_convert(ExportContext* Pcontext, const guchar* Ppixels, guint UIwidth, guint UIheight, guint UIrowstride);
+
+/** Writes the output files of the converted image (see image2gb_write_files()).
+ *  Returns TRUE if success, FALSE otherwise.
+ */
+static gboolean
+image2gb_context_emit(ExportContext* Pcontext);
+
+/** Frees the context, and everything the conversion allocated.
+ */
+static void
+image2gb_context_free(ExportContext* Pcontext);
+
+/** Adds an input file the output depends on (the image, a shared tileset...),
+ *  so a depfile and a stamp file are written along with the output (see
+ *  image2gb_write_depfile()).
+ */
+static void
+image2gb_context_add_dependency(ExportContext* Pcontext, const gchar* SfileName);
+
+/** Sets the size of the image to convert, in pixels (whole tiles).
+ */
+static void
+image2gb_context_set_size(ExportContext* Pcontext, guint UIwidth, guint UIheight);
+
+/** Builds an asset name from a file name (or a layer name...): no folder nor
+ *  extension, first letter uppercase (like the plugin does), and anything that
+ *  can not be part of a C identifier replaced by '_'.
+ */
+static void
+image2gb_make_asset_name(const gchar* SfileName, gchar* Sname);
+
+/** Allocates the tiles and tilemap of the context (zeroed), for the size of
+ *  its image.
+ */
+static void
+image2gb_alloc_tiles(ExportContext* Pcontext);
+
+/** Frees the tiles and tilemap of the context (or its streamed tilemap).
+ */
+static void
+image2gb_free_tiles(ExportContext* Pcontext);
+
+/** Returns TRUE if the tilemap needs 16-bit entries (too many unique tiles to
+ *  number them with a byte, counting from the tile base), FALSE otherwise.
+ */
+static gboolean
+image2gb_map_is_16bit(const ExportContext* Pcontext);
+
+/** Returns the tilemap layout of the given name (one of ArrayLayoutNames), or
+ *  -1 if there is none.
+ */
+static gint
+image2gb_layout_from_name(const gchar* Sname);
+
+/** Returns the layout the tilemap is written in: the one of the options, or
+ *  IMAGE2GB_LAYOUT_ROWS if the map can not be laid out that way (columns need
+ *  the whole map in memory, so not a streamed one, and the VRAM layout an image
+ *  up to IMAGE2GB_VRAM_MAP_WIDTH tiles wide).
+ */
+static ExportLayout
+image2gb_map_layout(const ExportContext* Pcontext);
+
+/** Returns the number of entries of every line (row or column) of the tilemap,
+ *  as written in the given layout. The number of lines goes to PUIlines.
+ */
+static guint
+image2gb_map_pitch(const ExportContext* Pcontext, ExportLayout Elayout, guint* PUIlines);
+
+/** Returns the tilemap entry at the given position of the given layout (line
+ *  and entry in it), with the tile base added. Streamed maps are always
+ *  written in rows, PmapRow being the row read from the file. Padding entries
+ *  are IMAGE2GB_VRAM_MAP_PAD, as they are (not a tile of the asset).
+ */
+static guint32
+image2gb_map_entry(const ExportContext* Pcontext, ExportLayout Elayout, guint UIline, guint UIentry, const guint32* PmapRow);
+
+/** Returns the name of the given output file of an asset, without folder (0 is
+ *  the .h header, then the .c source, or the .2bpp and .tilemap binaries), or
+ *  NULL if the asset has not that many. Free it with g_free().
+ */
+static gchar*
+image2gb_output_file(const PluginExportOptions* PexportOptions, guint UIfile);
+
+/** Adds the given packed tiles (the next ones of the image) to the cache key
+ *  of the context, if there is a cache.
+ */
+static void
+image2gb_cache_add_tiles(ExportContext* Pcontext, const DataTile* PdataTiles, guint UItileTotal);
+
+/** Thread pool function: hashes a range of chunks of tiles (see CacheJob).
+ */
+static void
+image2gb_cache_add_tiles_job(gpointer Pjob, gpointer Pdata);
+
+/** Completes the cache key of the context (once all its tiles were added), and
+ *  looks for it in the cache: the folder named by the IMAGE2GB_CACHE_DIR
+ *  environment variable. Returns TRUE if the output is there (then the number
+ *  of unique tiles is known too), FALSE otherwise or if there is no cache.
+ */
+static gboolean
+image2gb_cache_lookup(ExportContext* Pcontext);
+
+/** Copies the output files of the context from its cache entry. Returns TRUE
+ *  if success, FALSE otherwise (the error is reported).
+ */
+static gboolean
+image2gb_cache_restore(ExportContext* Pcontext);
+
+/** Copies the output files just written into a new cache entry. Failing to do
+ *  so is not an error, the next export just does not find it.
+ */
+static void
+image2gb_cache_store(ExportContext* Pcontext);
+
+/** Copies a file as it is. Returns TRUE if success, FALSE otherwise.
+ */
+static gboolean
+image2gb_cache_copy(const gchar* SfromName, const gchar* StoName);
+
+/** Processes the image one row of tiles at a time, as given by PreadRow,
+ *  keeping only the unique tiles and streaming the tilemap to a temporary
+ *  file. Returns TRUE if success, FALSE otherwise.
+ */
+static gboolean
+image2gb_stream_tiles(ExportContext* Pcontext, TileRowReader PreadRow, guint UIrowstride, gpointer Pdata);
+
+/** Row reader for images in memory, Pdata being the first pixel.
+ */
+static const guchar*
+image2gb_read_row_memory(guint UIrow, guint UIrowstride, gpointer Pdata);
+
+/** Packs a grid of UIcolumns x UIrows tiles (starting at Ppixels, lines
+ *  UIrowstride bytes apart) into PdataTiles, row by row. Big grids are split
+ *  among several worker threads.
+ */
+static void
+image2gb_pack_tiles(const guchar* Ppixels, guint UIrowstride, guint UIcolumns, guint UIrows, DataTile* PdataTiles);
+
+/** Worker function for image2gb_pack_tiles(), Pjob being a PackJob.
+ */
+static void
+image2gb_pack_tiles_job(gpointer Pjob, gpointer Pdata);
+
+/** Parses a tile from the image and stores it in the given DataTile. The pixels
+ *  are 8 lines of 8 bytes, each line UIrowstride bytes after the other.
+ */
+static void
+image2gb_read_tile(const guchar* Ppixels, guint UIrowstride, DataTile* PdataTile);
+
+/** Returns the fastest tile packer this CPU supports.
+ */
+static TilePacker
+image2gb_select_packer(void);
+
+/** Packs a tile 8 pixels at a time, with plain integer arithmetic.
+ */
+static void
+image2gb_pack_tile_scalar(const guchar* Ppixels, guint UIrowstride, DataTile* PdataTile);
+
+#ifdef IMAGE2GB_PACK_X86
+/** Packs a tile 16 pixels (2 lines) at a time, with SSE2.
+ */
+static void
+image2gb_pack_tile_sse2(const guchar* Ppixels, guint UIrowstride, DataTile* PdataTile);
+
+/** Packs a tile 32 pixels (4 lines) at a time, with AVX2.
+ */
+static void
+image2gb_pack_tile_avx2(const guchar* Ppixels, guint UIrowstride, DataTile* PdataTile);
+#endif
+
+/** Checks all tiles and finds the duplicates, removing them from the tilemap.
+ *  If Pprevious is not NULL, only the tiles that changed since that export are
+ *  checked again (when it is worth it).
+ */
+static void
+image2gb_check_duplicates(ExportContext* Pcontext, const DedupeState* Pprevious);
+
+/** Finds, for every tile of the array, the position of the first tile with the
+ *  same data (itself if it is the first one), and stores it in Poriginals. The
+ *  hash of every tile is stored in Phashes. Big arrays are split among several
+ *  worker threads.
+ */
+static void
+image2gb_find_originals(const DataTile* PdataTiles, guint UItileTotal, guint* Phashes, guint* Poriginals);
+
+/** Does the same as image2gb_find_originals() for the tiles of the context
+ *  (into its map and hashes), starting from the result of a previous export:
+ *  only the tiles that changed, and those that had or now have the same data
+ *  as them, are looked up again. Returns FALSE (and does nothing useful) if the
+ *  previous export does not match the image, or too much of it changed.
+ */
+static gboolean
+image2gb_find_originals_incremental(ExportContext* Pcontext, const DedupeState* Pprevious);
+
+/** Worker function for image2gb_find_originals() that hashes the tiles of its
+ *  range, Pjob being a DedupeJob.
+ */
+static void
+image2gb_hash_tiles_job(gpointer Pjob, gpointer Pdata);
+
+/** Worker function for image2gb_find_originals() that finds the originals of
+ *  the tiles of its shard, Pjob being a DedupeJob.
+ */
+static void
+image2gb_find_originals_job(gpointer Pjob, gpointer Pdata);
+
+/** Returns the hash of the data of the given tile.
+ */
+static guint
+image2gb_tile_hash(const DataTile* PdataTile);
+
+/** Prepares an empty hash table, big enough for the given number of tiles
+ *  (it grows when needed anyway).
+ */
+static void
+image2gb_hash_table_init(TileHashTable* PhashTable, guint UIexpectedTiles);
+
+/** Frees the memory used by the hash table.
+ */
+static void
+image2gb_hash_table_free(TileHashTable* PhashTable);
+
+/** Looks for a tile with the same data as PdataTiles[UItile] in the hash table.
+ *  Returns its position if found, otherwise adds UItile and returns it.
+ */
+static guint
+image2gb_hash_table_find_or_add(TileHashTable* PhashTable, const DataTile* PdataTiles, guint UItile);
+
+/** Same as image2gb_hash_table_find_or_add(), with the hash of the tile
+ *  already computed.
+ */
+static guint
+image2gb_hash_table_find_or_add_hashed(TileHashTable* PhashTable, const DataTile* PdataTiles, guint UItile, guint UIhash);
+
+/** Returns how many worker threads are worth using for the given number of
+ *  tiles (1 for small images, that are not worth the overhead).
+ */
+static guint
+image2gb_worker_count(guint UItileTotal);
+
+/** Runs Pwork on every one of the UIjobCount jobs (an array of elements of
+ *  UIjobSize bytes) in a thread pool, and waits until all of them are done.
+ *  A single job runs in the calling thread.
+ */
+static void
+image2gb_run_jobs(GFunc Pwork, gpointer Pjobs, gsize UIjobSize, guint UIjobCount);
+
+/** Writes the output files containing the image asset: a .h header, plus a .c
+ *  source or .2bpp and .tilemap binaries (depending on the chosen format).
+ *  Returns TRUE if success, FALSE otherwise.
+ */
+static gboolean
+image2gb_write_files(ExportContext* Pcontext);
+
+/** Writes the dependency file of the asset (name.d), in make/ninja format: the
+ *  stamp file and the output files depend on the inputs of the context. Then
+ *  rewrites the stamp file (name.stamp), so a build system knows the export
+ *  is done even when no output file changed (those are left untouched).
+ *  Returns TRUE if success, FALSE otherwise (the error is reported).
+ */
+static gboolean
+image2gb_write_depfile(ExportContext* Pcontext);
+
+/** Appends the given file name to Stext, escaped for a make rule.
+ */
+static void
+image2gb_depfile_append(GString* Stext, const gchar* SfileName);
+
+/** Writes the asset tile data to the given output, in the format expected by GBDK-2020.
+ */
+static void
+image2gb_write_tile_data(const ExportContext* Pcontext, OutputWriter* Pwriter);
+
+/** Writes the asset tilemap to the given output, in the format expected by GBDK-2020.
+ *  Returns FALSE (and fails the writer) if a streamed map cannot be read back.
+ */
+static gboolean
+image2gb_write_tilemap(const ExportContext* Pcontext, OutputWriter* Pwriter);
+
+/** Writes the asset tile data to the given output, as raw bytes (.2bpp).
+ */
+static void
+image2gb_write_tile_data_binary(const ExportContext* Pcontext, OutputWriter* Pwriter);
+
+/** Writes the asset tilemap to the given output, as raw bytes (.tilemap).
+ *  Returns FALSE (and fails the writer) if a streamed map cannot be read back.
+ */
+static gboolean
+image2gb_write_tilemap_binary(const ExportContext* Pcontext, OutputWriter* Pwriter);
+
+/** Reads the given row of a streamed tilemap back from its file into PmapRow
+ *  (nothing to do if the map is in memory). Returns FALSE, and fails the
+ *  writer, if it can not be read: a short read would write a wrong map.
+ */
+static gboolean
+image2gb_read_map_row(const ExportContext* Pcontext, guint32* PmapRow, guint UIrow, OutputWriter* Pwriter);
+
+/** Writes the asset upload table to Stext: the tile data split in chunks of as
+ *  many tiles as the upload budget fits (at least 1), 4 bytes per chunk (its
+ *  offset in the tile data, low byte first, its first VRAM tile and its number
+ *  of tiles), in hexadecimal. Chunks are separated by Sseparator.
+ */
+static void
+image2gb_write_uploads(const ExportContext* Pcontext, GString* Stext, const gchar* Sseparator);
+
+/** Compresses the tile data and the tilemap of the asset into its packed
+ *  output (the same bytes as in binary format, see image2gb_compress()), and
+ *  estimates how long the Game Boy takes to decompress them. Returns TRUE if
+ *  success, FALSE otherwise (the error is reported).
+ */
+static gboolean
+image2gb_pack_outputs(ExportContext* Pcontext);
+
+/** Writes the given bytes to the output, in hexadecimal (16 per line, with no
+ *  line break after the last one).
+ */
+static void
+image2gb_write_bytes(OutputWriter* Pwriter, const guint8* Pdata, gsize UIlength);
+
+/** Prepares the writer for the given file (in text or binary mode), counting
+ *  the bytes written in Pstats. The file is only replaced if the output is
+ *  different from what it has. Returns TRUE if success, FALSE otherwise (the
+ *  error is reported).
+ */
+static gboolean
+image2gb_writer_open(OutputWriter* Pwriter, const gchar* SfileName, gboolean Bbinary, ExportStats* Pstats);
+
+/** Prepares the writer for collecting the output in its buffer, instead of
+ *  writing it to a file. Free the buffer with g_string_free() when done.
+ */
+static void
+image2gb_writer_open_memory(OutputWriter* Pwriter);
+
+/** Creates the temporary file, once the output is known to differ from the
+ *  file being replaced, and copies into it the part that matched. Returns TRUE
+ *  if success, FALSE otherwise (the error is stored in Pwriter).
+ */
+static gboolean
+image2gb_writer_diverge(OutputWriter* Pwriter);
+
+/** Adds the given text to the output.
+ */
+static void
+image2gb_writer_append(OutputWriter* Pwriter, const gchar* Stext, gsize UIlength);
+
+/** Adds the given byte value to the output, as a C hex literal ("0xNN").
+ */
+static void
+image2gb_writer_hex8(OutputWriter* Pwriter, guint UIvalue);
+
+/** Adds the given 16-bit value to the output, as a C hex literal ("0xNNNN").
+ */
+static void
+image2gb_writer_hex16(OutputWriter* Pwriter, guint UIvalue);
+
+/** Writes the buffered text to the file (or just compares it with the file
+ *  being replaced, while they match).
+ */
+static void
+image2gb_writer_flush(OutputWriter* Pwriter);
+
+/** Writes the remaining contents and closes the file, replacing the old one
+ *  if they are different. Returns TRUE if everything was written, FALSE
+ *  otherwise (the error is reported).
+ */
+static gboolean
+image2gb_writer_close(OutputWriter* Pwriter);
+
+////////////////////////////////////////////////////////////////////////////////
+
+static ExportContext*
+image2gb_context_new(const PluginExportOptions* PexportOptions)
+{
+	ExportContext* Pcontext = g_new0(ExportContext, 1); /**< Return value. */
+	
+	// Only contexts that will be emitted can use the cache.
+	if (PexportOptions != NULL)
+	{
+		Pcontext->options = * PexportOptions;
+		
+		if ((g_getenv(IMAGE2GB_CACHE_VARIABLE) != NULL) && (g_getenv(IMAGE2GB_CACHE_VARIABLE)[0] != '\0'))
+			Pcontext->cacheKey = g_checksum_new(G_CHECKSUM_SHA256);
+	}
+	
+	image2gb_trace_reset(& Pcontext->stats);
+	
+	return Pcontext;
+}
+
+static gboolean
+image2gb_context_convert(ExportContext* Pcontext, const guchar* Ppixels, guint UIwidth, guint UIheight, guint UIrowstride)
+{
+	gint64 ItimeStart = 0; /**< When the stage being timed started. */
+	
+	image2gb_context_set_size(Pcontext, UIwidth, UIheight);
+	
+	// Huge images are processed one row of tiles at a time, so memory usage
+	// depends on the number of unique tiles, not on the size of the image.
+	if ((Pcontext->tileWidth * Pcontext->tileHeight) > IMAGE2GB_STREAMING_TILES_MIN)
+		return image2gb_stream_tiles(Pcontext, image2gb_read_row_memory, UIrowstride, (gpointer) Ppixels);
+		
+	image2gb_alloc_tiles(Pcontext);
+	
+	ItimeStart = g_get_monotonic_time();
+	
+	image2gb_pack_tiles(Ppixels, UIrowstride, Pcontext->tileWidth, Pcontext->tileHeight, Pcontext->tiles);
+	
+	ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_PACK, ItimeStart);
+	
+	// If the output is in the cache, there is nothing else to do.
+	image2gb_cache_add_tiles(Pcontext, Pcontext->tiles, (Pcontext->tileWidth * Pcontext->tileHeight));
+	
+	ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_CACHE, ItimeStart);
+	
+	if (image2gb_cache_lookup(Pcontext))
+		return TRUE;
+		
+	image2gb_check_duplicates(Pcontext, NULL);
+	
+	image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_DEDUPE, ItimeStart);
+	
+	return TRUE;
+}
+
+static gboolean
+image2gb_context_emit(ExportContext* Pcontext)
+{
+	gboolean Bsuccess = TRUE; /**< Return value. */
+	gint64 ItimeStart = g_get_monotonic_time(); /**< When the stage being timed started. */
+	
+	// In streaming mode, the key is only complete now. A hit also tells the
+	// number of unique tiles.
+	image2gb_cache_lookup(Pcontext);
+	
+	image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_CACHE, ItimeStart);
+	
+	// Not even 16-bit entries can number that many tiles, so the map would be
+	// wrong.
+	if ((Pcontext->options.tileBase + Pcontext->tileCount) > IMAGE2GB_MAP_16BIT_TILES_MAX)
+	{
+		g_message("%s: the image has %u unique tiles, the map can only number up to %d (counting from the tile base %d).\n",
+		          Pcontext->options.name, Pcontext->tileCount, IMAGE2GB_MAP_16BIT_TILES_MAX, Pcontext->options.tileBase);
+		          
+		return FALSE;
+	}
+	
+	// Give a warning if the image will not fit in the Game Boy's VRAM.
+	if (Pcontext->tileCount > IMAGE2GB_IMAGE_TILES_VRAM_LIMIT)
+		g_message("WARNING: this image has %u unique tiles. The Game Boy video memory can only fit " \
+		          "up to %d at the same time (384 using a hack). It will probably give errors.\n",
+		          Pcontext->tileCount, IMAGE2GB_IMAGE_TILES_VRAM_LIMIT);
+	else if ((Pcontext->options.tileBase + Pcontext->tileCount) > IMAGE2GB_IMAGE_TILES_VRAM_LIMIT)
+		g_message("WARNING: this image has %u unique tiles, they do not fit in the Game Boy video memory " \
+		          "starting at tile %d (only %d slots left). Its header will stop the build.\n",
+		          Pcontext->tileCount, Pcontext->options.tileBase, (IMAGE2GB_IMAGE_TILES_VRAM_LIMIT - Pcontext->options.tileBase));
+		          
+	// Compressed assets are decompressed in one go, and tiles that do not fit
+	// can not be uploaded in chunks either, so they get no upload table.
+	if ((Pcontext->options.uploadBudget > 0) && (Pcontext->options.compression != IMAGE2GB_COMPRESSION_NONE))
+		g_message("WARNING: the upload table is only written for assets that are not compressed.\n");
+	else if ((Pcontext->options.uploadBudget > 0) && ((Pcontext->options.tileBase + Pcontext->tileCount) > IMAGE2GB_IMAGE_TILES_VRAM_LIMIT))
+		g_message("WARNING: the upload table is only written for assets whose tiles fit in the Game Boy video memory.\n");
+		
+	// image2gb_decompress_bkg_tiles() writes 8-bit entries, row by row.
+	if ((Pcontext->options.compression != IMAGE2GB_COMPRESSION_NONE) && image2gb_map_is_16bit(Pcontext))
+		g_message("WARNING: the map of %s has 16-bit entries, it can not be decompressed straight into VRAM " \
+		          "(decompress it to RAM with image2gb_decompress()).\n", Pcontext->options.name);
+	else if ((Pcontext->options.compression != IMAGE2GB_COMPRESSION_NONE) && (image2gb_map_layout(Pcontext) == IMAGE2GB_LAYOUT_COLUMNS))
+		g_message("WARNING: the map of %s is in columns, it can not be decompressed straight into VRAM " \
+		          "(decompress it to RAM with image2gb_decompress()).\n", Pcontext->options.name);
+	else if ((Pcontext->options.compression != IMAGE2GB_COMPRESSION_NONE) && (image2gb_map_layout(Pcontext) == IMAGE2GB_LAYOUT_VRAM))
+		g_message("WARNING: the map of %s is in VRAM rows, decompress it straight into VRAM with a width of %d tiles, " \
+		          "not the width of the image.\n", Pcontext->options.name, IMAGE2GB_VRAM_MAP_WIDTH);
+		          
+	// Streamed maps are read from their file row by row, and only narrow maps
+	// fit in the background map, so those are written row by row.
+	if ((Pcontext->options.mapLayout != IMAGE2GB_LAYOUT_ROWS) && (image2gb_map_layout(Pcontext) == IMAGE2GB_LAYOUT_ROWS))
+		g_message("WARNING: the map of %s is written row by row, the %s layout is only for %s.\n", Pcontext->options.name,
+		          ArrayLayoutNames[Pcontext->options.mapLayout],
+		          (Pcontext->options.mapLayout == IMAGE2GB_LAYOUT_COLUMNS) ? "maps that are not streamed" : "images up to 32 tiles wide");
+		          
+	if (Pcontext->cacheHit)
+		Bsuccess = image2gb_cache_restore(Pcontext);
+	else
+	{
+		Bsuccess = image2gb_write_files(Pcontext);
+		
+		if (Bsuccess)
+			image2gb_cache_store(Pcontext);
+	}
+	
+	if (Bsuccess && (Pcontext->dependencies != NULL))
+		Bsuccess = image2gb_write_depfile(Pcontext);
+		
+	if (Bsuccess)
+		image2gb_trace_report(& Pcontext->stats, Pcontext->options.name);
+		
+	return Bsuccess;
+}
+
+static void
+image2gb_context_free(ExportContext* Pcontext)
+{
+	if (Pcontext == NULL)
+		return;
+		
+	image2gb_free_tiles(Pcontext);
+	
+	if (Pcontext->cacheKey != NULL)
+		g_checksum_free(Pcontext->cacheKey);
+		
+	if (Pcontext->dependencies != NULL)
+		g_ptr_array_free(Pcontext->dependencies, TRUE);
+		
+	if (Pcontext->packed.data != NULL)
+		g_byte_array_free(Pcontext->packed.data, TRUE);
+		
+	if (Pcontext->packed.map != NULL)
+		g_byte_array_free(Pcontext->packed.map, TRUE);
+		
+	g_free(Pcontext->cacheEntry);
+	g_free(Pcontext);
+}
+
+static void
+image2gb_context_add_dependency(ExportContext* Pcontext, const gchar* SfileName)
+{
+	if (Pcontext->dependencies == NULL)
+		Pcontext->dependencies = g_ptr_array_new_with_free_func(g_free);
+		
+	g_ptr_array_add(Pcontext->dependencies, g_strdup(SfileName));
+}
+
+static void
+image2gb_context_set_size(ExportContext* Pcontext, guint UIwidth, guint UIheight)
+{
+	Pcontext->tileWidth = (UIwidth / IMAGE2GB_TILE_SIZE);
+	Pcontext->tileHeight = (UIheight / IMAGE2GB_TILE_SIZE);
+	
+	// The cache key starts with everything but the tiles. The parameters are
+	// hashed one by one, the name up to its end (whatever follows it in memory
+	// does not change the output), and not the folder (the output does not
+	// depend on it, and a fresh checkout somewhere else should hit too).
+	if (Pcontext->cacheKey != NULL)
+	{
+		const PluginExportOptions* PexportOptions = & Pcontext->options; /**< Export parameters. */
+		
+		g_checksum_update(Pcontext->cacheKey, (const guchar*) IMAGE2GB_CACHE_VERSION, -1);
+		g_checksum_update(Pcontext->cacheKey, (const guchar*) PexportOptions->name, (strlen(PexportOptions->name) + 1));
+		g_checksum_update(Pcontext->cacheKey, (const guchar*) & PexportOptions->bank, sizeof(PexportOptions->bank));
+		g_checksum_update(Pcontext->cacheKey, (const guchar*) & PexportOptions->format, sizeof(PexportOptions->format));
+		g_checksum_update(Pcontext->cacheKey, (const guchar*) & PexportOptions->tileBase, sizeof(PexportOptions->tileBase));
+		g_checksum_update(Pcontext->cacheKey, (const guchar*) & PexportOptions->compression, sizeof(PexportOptions->compression));
+		g_checksum_update(Pcontext->cacheKey, (const guchar*) & PexportOptions->uploadBudget, sizeof(PexportOptions->uploadBudget));
+		g_checksum_update(Pcontext->cacheKey, (const guchar*) & PexportOptions->mapLayout, sizeof(PexportOptions->mapLayout));
+		g_checksum_update(Pcontext->cacheKey, (const guchar*) & Pcontext->tileWidth, sizeof(Pcontext->tileWidth));
+		g_checksum_update(Pcontext->cacheKey, (const guchar*) & Pcontext->tileHeight, sizeof(Pcontext->tileHeight));
+	}
+}
+
+static void
+image2gb_make_asset_name(const gchar* SfileName, gchar* Sname)
+{
+	gchar* Sbase = g_path_get_basename(SfileName); /**< File name without the folder. */
+	gchar* Sdot = strrchr(Sbase, '.'); /**< Start of the extension, if any. */
+	
+	// We have to remove the extension from the file name.
+	if ((Sdot != NULL) && (Sdot != Sbase))
+		* Sdot = '\0';
+		
+	g_strlcpy(Sname, Sbase, (IMAGE2GB_ASSET_NAME_MAX_LENGTH - 3)); // 32 - "Bkg" or "Map" prefix.
+	
+	for (guint c = 0; Sname[c] != '\0'; c++)
+	{
+		if (! g_ascii_isalnum(Sname[c]))
+			Sname[c] = '_';
+	}
+	
+	// And make the first letter uppercase (a digit can not start the name).
+	if (g_ascii_isdigit(Sname[0]))
+		Sname[0] = '_';
+		
+	Sname[0] = g_ascii_toupper(Sname[0]);
+	
+	g_free(Sbase);
+}
+
+static void
+image2gb_alloc_tiles(ExportContext* Pcontext)
+{
+	gsize UItileTotal = ((gsize) Pcontext->tileWidth * Pcontext->tileHeight); /**< Number of tiles in the image. */
+	
+	// A single block for everything, tiles first (they have the strictest
+	// alignment), then the tilemap and the hashes.
+	Pcontext->arena = g_malloc0(UItileTotal * (sizeof(DataTile) + (2 * sizeof(guint))));
+	
+	Pcontext->tiles = Pcontext->arena;
+	Pcontext->map = (guint*)(Pcontext->tiles + UItileTotal);
+	Pcontext->hashes = (Pcontext->map + UItileTotal);
+}
+
+static void
+image2gb_free_tiles(ExportContext* Pcontext)
+{
+	g_free(Pcontext->arena);
+	
+	Pcontext->arena = NULL;
+	Pcontext->tiles = NULL;
+	Pcontext->map = NULL;
+	Pcontext->hashes = NULL;
+	
+	if (Pcontext->streamedMap != NULL)
+	{
+		fclose(Pcontext->streamedMap);
+		g_remove(Pcontext->streamedMapName);
+		g_free(Pcontext->streamedMapName);
+		
+		Pcontext->streamedMap = NULL;
+		Pcontext->streamedMapName = NULL;
+	}
+}
+
+static gboolean
+image2gb_map_is_16bit(const ExportContext* Pcontext)
+{
+	return ((Pcontext->options.tileBase + Pcontext->tileCount) > IMAGE2GB_MAP_8BIT_TILES_MAX);
+}
+
+static gint
+image2gb_layout_from_name(const gchar* Sname)
+{
+	for (gint layout = 0; layout < IMAGE2GB_LAYOUT_COUNT; layout++)
+	{
+		if (g_ascii_strcasecmp(Sname, ArrayLayoutNames[layout]) == 0)
+			return layout;
+	}
+	
+	return -1;
+}
+
+static ExportLayout
+image2gb_map_layout(const ExportContext* Pcontext)
+{
+	if ((Pcontext->options.mapLayout == IMAGE2GB_LAYOUT_COLUMNS) && (Pcontext->map != NULL))
+		return IMAGE2GB_LAYOUT_COLUMNS;
+		
+	if ((Pcontext->options.mapLayout == IMAGE2GB_LAYOUT_VRAM) && (Pcontext->tileWidth <= IMAGE2GB_VRAM_MAP_WIDTH))
+		return IMAGE2GB_LAYOUT_VRAM;
+		
+	return IMAGE2GB_LAYOUT_ROWS;
+}
+
+static guint
+image2gb_map_pitch(const ExportContext* Pcontext, ExportLayout Elayout, guint* PUIlines)
+{
+	if (Elayout == IMAGE2GB_LAYOUT_COLUMNS)
+	{
+		* PUIlines = Pcontext->tileWidth;
+		
+		return Pcontext->tileHeight;
+	}
+	
+	* PUIlines = Pcontext->tileHeight;
+	
+	return (Elayout == IMAGE2GB_LAYOUT_VRAM) ? IMAGE2GB_VRAM_MAP_WIDTH : Pcontext->tileWidth;
+}
+
+static guint32
+image2gb_map_entry(const ExportContext* Pcontext, ExportLayout Elayout, guint UIline, guint UIentry, const guint32* PmapRow)
+{
+	if (Elayout == IMAGE2GB_LAYOUT_COLUMNS)
+		return (Pcontext->map[(UIentry * Pcontext->tileWidth) + UIline] + Pcontext->options.tileBase);
+		
+	// The VRAM layout pads every row up to the width of the background map,
+	// with a fixed entry (the tile base would make it a tile of the asset).
+	if (UIentry >= Pcontext->tileWidth)
+		return IMAGE2GB_VRAM_MAP_PAD;
+		
+	return (((Pcontext->map != NULL) ? Pcontext->map[(UIline * Pcontext->tileWidth) + UIentry] : PmapRow[UIentry]) +
+	        Pcontext->options.tileBase);
+}
+
+static gchar*
+image2gb_output_file(const PluginExportOptions* PexportOptions, guint UIfile)
+{
+	const gchar* ArrayExtensions[] = {"h", "c"}; /**< Output files in source format. */
+	const gchar* ArrayExtensionsBinary[] = {"h", "2bpp", "tilemap"}; /**< Output files in binary format. */
+	gchar* SnameLowercase = NULL; /**< Asset name, all lowercase (as in the file names). */
+	gchar* SfileName = NULL; /**< Return value. */
+	
+	if (PexportOptions->format == IMAGE2GB_FORMAT_BINARY)
+	{
+		if (UIfile >= G_N_ELEMENTS(ArrayExtensionsBinary))
+			return NULL;
+			
+		SnameLowercase = g_ascii_strdown(PexportOptions->name, -1);
+		SfileName = g_strdup_printf("%s.%s", SnameLowercase, ArrayExtensionsBinary[UIfile]);
+	}
+	else
+	{
+		if (UIfile >= G_N_ELEMENTS(ArrayExtensions))
+			return NULL;
+			
+		SnameLowercase = g_ascii_strdown(PexportOptions->name, -1);
+		SfileName = g_strdup_printf("%s.%s", SnameLowercase, ArrayExtensions[UIfile]);
+	}
+	
+	g_free(SnameLowercase);
+	
+	return SfileName;
+}
+
+static void
+image2gb_cache_add_tiles(ExportContext* Pcontext, const DataTile* PdataTiles, guint UItileTotal)
+{
+	guint UIchunkCount = ((UItileTotal + IMAGE2GB_CACHE_CHUNK_TILES - 1) / IMAGE2GB_CACHE_CHUNK_TILES); /**< Number of chunks of tiles. */
+	guint UIjobCount = 0; /**< Number of jobs (one per worker thread). */
+	guint UIjobChunks = 0; /**< Chunks hashed by every job (the last one may get less). */
+	guint8* ArrayDigests = NULL; /**< SHA-256 of every chunk. */
+	CacheJob* ArrayJobs = NULL; /**< Jobs for the worker threads. */
+	
+	if ((Pcontext->cacheKey == NULL) || (UItileTotal == 0))
+		return;
+		
+	// The key is made of the hashes of fixed chunks of tiles, so it does not
+	// depend on the number of threads that computed them.
+	UIjobCount = MIN(image2gb_worker_count(UItileTotal), UIchunkCount);
+	UIjobChunks = ((UIchunkCount + UIjobCount - 1) / UIjobCount);
+	ArrayDigests = g_new(guint8, (UIchunkCount * 32));
+	ArrayJobs = g_new(CacheJob, UIjobCount);
+	
+	for (guint job = 0; job < UIjobCount; job++)
+	{
+		ArrayJobs[job].tiles = PdataTiles;
+		ArrayJobs[job].tileTotal = UItileTotal;
+		ArrayJobs[job].first = MIN((job * UIjobChunks), UIchunkCount);
+		ArrayJobs[job].last = MIN(((job + 1) * UIjobChunks), UIchunkCount);
+		ArrayJobs[job].digests = ArrayDigests;
+	}
+	
+	image2gb_run_jobs(image2gb_cache_add_tiles_job, ArrayJobs, sizeof(CacheJob), UIjobCount);
+	
+	g_checksum_update(Pcontext->cacheKey, ArrayDigests, (UIchunkCount * 32));
+	
+	g_free(ArrayJobs);
+	g_free(ArrayDigests);
+}
+
+static void
+image2gb_cache_add_tiles_job(gpointer Pjob, gpointer Pdata)
+{
+	const CacheJob* PcacheJob = Pjob; /**< Range of chunks to hash. */
+	guint8* Pbuffer = g_new(guint8, (IMAGE2GB_CACHE_CHUNK_TILES * IMAGE2GB_TILE_BYTES)); /**< Data of the tiles of a chunk, one after the other. */
+	
+	for (guint chunk = PcacheJob->first; chunk < PcacheJob->last; chunk++)
+	{
+		guint UIfirst = (chunk * IMAGE2GB_CACHE_CHUNK_TILES); /**< First tile of the chunk. */
+		guint UIlast = MIN((UIfirst + IMAGE2GB_CACHE_CHUNK_TILES), PcacheJob->tileTotal); /**< Tile after the last one of the chunk. */
+		GChecksum* Gchecksum = g_checksum_new(G_CHECKSUM_SHA256); /**< Hash of the chunk. */
+		gsize UIdigestSize = 32; /**< Size of the hash, in bytes. */
+		
+		// Only the pixel data counts (not the duplicate flag).
+		for (guint tile = UIfirst; tile < UIlast; tile++)
+			memcpy(Pbuffer + ((tile - UIfirst) * IMAGE2GB_TILE_BYTES), PcacheJob->tiles[tile].row, IMAGE2GB_TILE_BYTES);
+			
+		g_checksum_update(Gchecksum, Pbuffer, ((UIlast - UIfirst) * IMAGE2GB_TILE_BYTES));
+		g_checksum_get_digest(Gchecksum, PcacheJob->digests + (chunk * 32), & UIdigestSize);
+		g_checksum_free(Gchecksum);
+	}
+	
+	g_free(Pbuffer);
+}
+
+static gboolean
+image2gb_cache_lookup(ExportContext* Pcontext)
+{
+	GKeyFile* Ginfo = NULL; /**< What the entry stores besides the outputs. */
+	gchar* SinfoName = NULL; /**< Full name of the info file of the entry. */
+	GError* Gerror = NULL; /**< Error reading the number of tiles, if any. */
+	gint ItileCount = 0; /**< Number of unique tiles, as stored in the entry. */
+	
+	if ((Pcontext->cacheKey == NULL) || (Pcontext->cacheEntry != NULL))
+		return Pcontext->cacheHit;
+		
+	Pcontext->cacheEntry = g_build_filename(g_getenv(IMAGE2GB_CACHE_VARIABLE), g_checksum_get_string(Pcontext->cacheKey), NULL);
+	
+	// Entries are complete or do not exist at all (see image2gb_cache_store()),
+	// but someone could have deleted some of their files by hand.
+	Pcontext->cacheHit = TRUE;
+	
+	for (guint file = 0; Pcontext->cacheHit; file++)
+	{
+		gchar* SfileName = image2gb_output_file(& Pcontext->options, file); /**< Output file to look for. */
+		gchar* SentryName = NULL; /**< The output file, in the entry. */
+		
+		if (SfileName == NULL)
+			break;
+			
+		SentryName = g_build_filename(Pcontext->cacheEntry, SfileName, NULL);
+		Pcontext->cacheHit = g_file_test(SentryName, G_FILE_TEST_IS_REGULAR);
+		
+		g_free(SentryName);
+		g_free(SfileName);
+	}
+	
+	if (Pcontext->cacheHit)
+	{
+		Ginfo = g_key_file_new();
+		SinfoName = g_build_filename(Pcontext->cacheEntry, IMAGE2GB_CACHE_INFO, NULL);
+		
+		if (g_key_file_load_from_file(Ginfo, SinfoName, G_KEY_FILE_NONE, NULL))
+			ItileCount = g_key_file_get_integer(Ginfo, "asset", "tiles", & Gerror);
+			
+		Pcontext->cacheHit = ((Gerror == NULL) && (ItileCount > 0));
+		
+		g_clear_error(& Gerror);
+		g_free(SinfoName);
+		g_key_file_free(Ginfo);
+	}
+	
+	if (Pcontext->cacheHit)
+		Pcontext->tileCount = ItileCount;
+		
+	return Pcontext->cacheHit;
+}
+
+static gboolean
+image2gb_cache_restore(ExportContext* Pcontext)
+{
+	gboolean Bsuccess = TRUE; /**< Return value. */
+	gchar* Pbuffer = g_malloc(IMAGE2GB_OUTPUT_BUFFER_SIZE); /**< Piece of the file being copied. */
+	
+	// The files go through an OutputWriter like when they are generated, so
+	// unchanged ones are not touched and changed ones are replaced at once.
+	// They are copied as they are (binary mode), line endings included.
+	for (guint file = 0; Bsuccess; file++)
+	{
+		gchar* SfileName = image2gb_output_file(& Pcontext->options, file); /**< Output file to copy. */
+		gchar* SentryName = NULL; /**< The output file, in the entry. */
+		gchar* SoutputName = NULL; /**< The output file, where it goes. */
+		FILE* PentryFile = NULL; /**< The output file, in the entry (opened). */
+		OutputWriter StructWriter = {0}; /**< Buffers the contents of the file being written. */
+		gsize UIread = 0; /**< Bytes in Pbuffer. */
+		
+		if (SfileName == NULL)
+			break;
+			
+		SentryName = g_build_filename(Pcontext->cacheEntry, SfileName, NULL);
+		SoutputName = g_strdup_printf("%s/%s", Pcontext->options.folder, SfileName);
+		PentryFile = fopen(SentryName, "rb");
+		
+		if (PentryFile == NULL)
+		{
+			// Save error code before calling another function (may be overwritten).
+			gint Ierror = errno;
+			g_message("Could not open file %s, error code %d (%s).\n", SentryName, Ierror, g_strerror(Ierror));
+			
+			Bsuccess = FALSE;
+		}
+		else if (image2gb_writer_open(& StructWriter, SoutputName, TRUE, & Pcontext->stats))
+		{
+			while ((UIread = fread(Pbuffer, 1, IMAGE2GB_OUTPUT_BUFFER_SIZE, PentryFile)) > 0)
+				image2gb_writer_append(& StructWriter, Pbuffer, UIread);
+				
+			if (ferror(PentryFile) && (StructWriter.error == 0))
+				StructWriter.error = EIO;
+				
+			Bsuccess = image2gb_writer_close(& StructWriter);
+		}
+		else
+			Bsuccess = FALSE;
+			
+		if (PentryFile != NULL)
+			fclose(PentryFile);
+			
+		g_free(SoutputName);
+		g_free(SentryName);
+		g_free(SfileName);
+	}
+	
+	g_free(Pbuffer);
+	
+	return Bsuccess;
+}
+
+static void
+image2gb_cache_store(ExportContext* Pcontext)
+{
+	GKeyFile* Ginfo = NULL; /**< What the entry stores besides the outputs. */
+	gchar* StempName = NULL; /**< Folder where the entry is put together. */
+	gchar* SinfoName = NULL; /**< Full name of the info file of the entry. */
+	gboolean Bsuccess = TRUE; /**< Whether the entry is complete. */
+	
+	if (Pcontext->cacheEntry == NULL)
+		return;
+		
+	// The entry is put together in a temporary folder, then renamed, so other
+	// exports (maybe running at the same time) see it complete or not at all.
+	if (g_mkdir_with_parents(g_getenv(IMAGE2GB_CACHE_VARIABLE), 0755) != 0)
+		return;
+		
+	StempName = g_strconcat(Pcontext->cacheEntry, ".XXXXXX", NULL);
+	
+	if (g_mkdtemp(StempName) == NULL)
+	{
+		g_free(StempName);
+		
+		return;
+	}
+	
+	for (guint file = 0; Bsuccess; file++)
+	{
+		gchar* SfileName = image2gb_output_file(& Pcontext->options, file); /**< Output file to copy. */
+		gchar* SoutputName = NULL; /**< The output file, as just written. */
+		gchar* SentryName = NULL; /**< The output file, in the entry. */
+		
+		if (SfileName == NULL)
+			break;
+			
+		SoutputName = g_strdup_printf("%s/%s", Pcontext->options.folder, SfileName);
+		SentryName = g_build_filename(StempName, SfileName, NULL);
+		
+		Bsuccess = image2gb_cache_copy(SoutputName, SentryName);
+		
+		g_free(SentryName);
+		g_free(SoutputName);
+		g_free(SfileName);
+	}
+	
+	SinfoName = g_build_filename(StempName, IMAGE2GB_CACHE_INFO, NULL);
+	
+	if (Bsuccess)
+	{
+		Ginfo = g_key_file_new();
+		g_key_file_set_integer(Ginfo, "asset", "tiles", Pcontext->tileCount);
+		
+		Bsuccess = g_key_file_save_to_file(Ginfo, SinfoName, NULL);
+		
+		g_key_file_free(Ginfo);
+	}
+	
+	// If the entry already exists (stored by another export meanwhile), the
+	// rename fails and ours is thrown away.
+	if ((! Bsuccess) || (g_rename(StempName, Pcontext->cacheEntry) != 0))
+	{
+		for (guint file = 0; ; file++)
+		{
+			gchar* SfileName = image2gb_output_file(& Pcontext->options, file); /**< Output file to delete. */
+			gchar* SentryName = NULL; /**< The output file, in the entry. */
+			
+			if (SfileName == NULL)
+				break;
+				
+			SentryName = g_build_filename(StempName, SfileName, NULL);
+			g_unlink(SentryName);
+			
+			g_free(SentryName);
+			g_free(SfileName);
+		}
+		
+		g_unlink(SinfoName);
+		g_rmdir(StempName);
+	}
+	
+	g_free(SinfoName);
+	g_free(StempName);
+}
+
+static gboolean
+image2gb_cache_copy(const gchar* SfromName, const gchar* StoName)
+{
+	FILE* PfromFile = fopen(SfromName, "rb"); /**< File to copy. */
+	FILE* PtoFile = NULL; /**< The copy. */
+	gchar* Pbuffer = NULL; /**< Piece of the file being copied. */
+	gsize UIread = 0; /**< Bytes in Pbuffer. */
+	gboolean Bsuccess = TRUE; /**< Return value. */
+	
+	if (PfromFile == NULL)
+		return FALSE;
+		
+	PtoFile = fopen(StoName, "wb");
+	
+	if (PtoFile == NULL)
+	{
+		fclose(PfromFile);
+		
+		return FALSE;
+	}
+	
+	Pbuffer = g_malloc(IMAGE2GB_OUTPUT_BUFFER_SIZE);
+	
+	while (Bsuccess && ((UIread = fread(Pbuffer, 1, IMAGE2GB_OUTPUT_BUFFER_SIZE, PfromFile)) > 0))
+		Bsuccess = (fwrite(Pbuffer, 1, UIread, PtoFile) == UIread);
+		
+	Bsuccess = (Bsuccess && (! ferror(PfromFile)));
+	Bsuccess = ((fclose(PtoFile) == 0) && Bsuccess);
+	
+	fclose(PfromFile);
+	g_free(Pbuffer);
+	
+	return Bsuccess;
+}
+
+static gboolean
+image2gb_stream_tiles(ExportContext* Pcontext, TileRowReader PreadRow, guint UIrowstride, gpointer Pdata)
+{
+	gboolean Bsuccess = TRUE; /**< Return value. */
+	GArray* GuniqueTiles = NULL; /**< Unique tiles found so far, in order of appearance. */
+	TileHashTable StructHashTable = {0}; /**< Index of GuniqueTiles. */
+	GError* Gerror = NULL; /**< Error creating the temporary file, if any. */
+	gint IfileDescriptor = -1; /**< Temporary file for the tilemap, as returned by GLib. */
+	const guchar* Ppixels = NULL; /**< Pixels of the row of tiles being processed. */
+	guint UIbandRows = 0; /**< How many rows of tiles are deduplicated together. */
+	guint UIbandRow = 0; /**< Rows of tiles of the current band packed so far. */
+	DataTile* PbandTiles = NULL; /**< Packed tiles of the band of rows being processed. */
+	guint32* PbandMap = NULL; /**< Tilemap entries of the band of rows being processed. */
+	guint* PbandHashes = NULL; /**< Hashes of the tiles of the band of rows being processed. */
+	gint64 ItimeStart = 0; /**< When the stage being timed started. */
+	
+	// The tilemap goes to a temporary file, it is not needed until the tile
+	// data has been written, and it could be too big to keep in memory.
+	IfileDescriptor = g_file_open_tmp("image2gb-XXXXXX.map", & Pcontext->streamedMapName, & Gerror);
+	
+	if (IfileDescriptor != -1)
+		Pcontext->streamedMap = fdopen(IfileDescriptor, "w+b");
+		
+	if (Pcontext->streamedMap == NULL)
+	{
+		g_message("Could not create a temporary file for the tilemap (%s).\n",
+		          (Gerror != NULL) ? Gerror->message : "fdopen failed");
+		          
+		g_clear_error(& Gerror);
+		
+		return FALSE;
+	}
+	
+	// Rows are packed as they are read, but duplicates are looked for in bands
+	// of several rows, so there is enough work to share among the threads.
+	UIbandRows = (IMAGE2GB_STREAMING_BAND_TILES / Pcontext->tileWidth);
+	UIbandRows = CLAMP(UIbandRows, 1, Pcontext->tileHeight);
+	
+	GuniqueTiles = g_array_new(FALSE, TRUE, sizeof(DataTile));
+	image2gb_hash_table_init(& StructHashTable, IMAGE2GB_IMAGE_TILES_VRAM_LIMIT);
+	PbandTiles = g_new0(DataTile, (UIbandRows * Pcontext->tileWidth));
+	PbandMap = g_new(guint32, (UIbandRows * Pcontext->tileWidth));
+	PbandHashes = g_new(guint, (UIbandRows * Pcontext->tileWidth));
+	
+	for (guint row = 0; row < Pcontext->tileHeight; row++)
+	{
+		guint UIbandTiles = 0; /**< Number of tiles of the current band. */
+		
+		ItimeStart = g_get_monotonic_time();
+		
+		Ppixels = PreadRow(row, UIrowstride, Pdata);
+		
+		if (Ppixels == NULL)
+		{
+			Bsuccess = FALSE;
+			
+			break;
+		}
+		
+		ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_READ, ItimeStart);
+		
+		image2gb_pack_tiles(Ppixels, UIrowstride, Pcontext->tileWidth, 1, PbandTiles + (UIbandRow * Pcontext->tileWidth));
+		UIbandRow++;
+		
+		ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_PACK, ItimeStart);
+		
+		if ((UIbandRow < UIbandRows) && (row < (Pcontext->tileHeight - 1)))
+			continue;
+			
+		UIbandTiles = (UIbandRow * Pcontext->tileWidth);
+		
+		image2gb_cache_add_tiles(Pcontext, PbandTiles, UIbandTiles);
+		
+		// First find the duplicates inside the band (in parallel), then look
+		// up only the first occurrences in the unique tiles of the previous
+		// bands. As GuniqueTiles only holds unique tiles, positions are
+		// directly the values of the tilemap.
+		image2gb_find_originals(PbandTiles, UIbandTiles, PbandHashes, PbandMap);
+		
+		for (guint tile = 0; tile < UIbandTiles; tile++)
+		{
+			guint UIcandidate = GuniqueTiles->len; /**< Position the tile takes if it turns out to be unique. */
+			guint UIoriginal = 0; /**< Position of the first tile with the same data. */
+			
+			// A copy of an earlier tile of the band gets the same value, which
+			// is already final (originals always come first).
+			if (PbandMap[tile] != tile)
+			{
+				PbandMap[tile] = PbandMap[PbandMap[tile]];
+				
+				continue;
+			}
+			
+			// Add the tile at the end of the unique tiles, and take it out
+			// again if it is a duplicate of a tile from a previous band.
+			g_array_append_val(GuniqueTiles, PbandTiles[tile]);
+			
+			UIoriginal = image2gb_hash_table_find_or_add(& StructHashTable, (DataTile*) GuniqueTiles->data, UIcandidate);
+			
+			if (UIoriginal != UIcandidate)
+				g_array_set_size(GuniqueTiles, UIcandidate);
+				
+			PbandMap[tile] = UIoriginal;
+		}
+		
+		// We do not check for success, we take for granted we can write OK.
+		fwrite(PbandMap, sizeof(guint32), UIbandTiles, Pcontext->streamedMap);
+		
+		UIbandRow = 0;
+		
+		image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_DEDUPE, ItimeStart);
+	}
+	
+	Pcontext->tileCount = GuniqueTiles->len;
+	
+	// The unique tiles become the tile data to write (none is a duplicate).
+	Pcontext->arena = g_array_free(GuniqueTiles, FALSE);
+	Pcontext->tiles = Pcontext->arena;
+	Pcontext->map = NULL;
+	
+	g_free(PbandHashes);
+	g_free(PbandMap);
+	g_free(PbandTiles);
+	image2gb_hash_table_free(& StructHashTable);
+	
+	rewind(Pcontext->streamedMap);
+	
+	return Bsuccess;
+}
+
+static const guchar*
+image2gb_read_row_memory(guint UIrow, guint UIrowstride, gpointer Pdata)
+{
+	return ((const guchar*) Pdata + ((gsize) UIrow * IMAGE2GB_TILE_SIZE * UIrowstride));
+}
+
+static void
+image2gb_pack_tiles(const guchar* Ppixels, guint UIrowstride, guint UIcolumns, guint UIrows, DataTile* PdataTiles)
+{
+	guint UItileTotal = (UIcolumns * UIrows); /**< Number of tiles of the grid. */
+	guint UIjobCount = image2gb_worker_count(UItileTotal); /**< Number of jobs (one per worker thread). */
+	guint UIjobTiles = ((UItileTotal + UIjobCount - 1) / UIjobCount); /**< Tiles packed by every job (the last one may get less). */
+	PackJob* ArrayJobs = g_new(PackJob, UIjobCount); /**< Jobs for the worker threads. */
+	
+	// Every tile is packed on its own, so the grid is just cut in consecutive
+	// ranges of tiles, one per thread.
+	for (guint job = 0; job < UIjobCount; job++)
+	{
+		ArrayJobs[job].pixels = Ppixels;
+		ArrayJobs[job].rowstride = UIrowstride;
+		ArrayJobs[job].columns = UIcolumns;
+		ArrayJobs[job].first = MIN((job * UIjobTiles), UItileTotal);
+		ArrayJobs[job].last = MIN(((job + 1) * UIjobTiles), UItileTotal);
+		ArrayJobs[job].tiles = PdataTiles;
+	}
+	
+	image2gb_run_jobs(image2gb_pack_tiles_job, ArrayJobs, sizeof(PackJob), UIjobCount);
+	
+	g_free(ArrayJobs);
+}
+
+static void
+image2gb_pack_tiles_job(gpointer Pjob, gpointer Pdata)
+{
+	const PackJob* PpackJob = Pjob; /**< Range of tiles to pack. */
+	
+	for (guint tile = PpackJob->first; tile < PpackJob->last; tile++)
+	{
+		guint UIrow = (tile / PpackJob->columns); /**< Row of the tile in the grid. */
+		guint UIcol = (tile % PpackJob->columns); /**< Column of the tile in the grid. */
+		
+		image2gb_read_tile(PpackJob->pixels + (((gsize) UIrow * IMAGE2GB_TILE_SIZE * PpackJob->rowstride) + (UIcol * IMAGE2GB_TILE_SIZE)),
+		                   PpackJob->rowstride,
+		                   PpackJob->tiles + tile);
+	}
+}
+
+static void
+image2gb_read_tile(const guchar* Ppixels, guint UIrowstride, DataTile* PdataTile)
+{
+	// Visual explanation: right now we are processing a single tile, which is a
+	// square 8x8 pixel area of the image, 64 pixels in total. We have 2
+	// variable types:
+	//
+	// 1- The GIMP pixels, 64 guchar that contain the values of every pixel of
+	// this tile, in 8 lines of 8 (in memory, each line starts UIrowstride bytes
+	// after the previous one). Every pixel has a color index value from 0
+	// (lightest green) to 3 (darkest green). Example with random values:
+	//
+	//  guchar Ppixels[64]:   [1 0 3 0 2 1 0 3
+	//                         0 1 3 2 1 0 2 0
+	//                         0 1 2 0 3 1 1 2
+	//                         0 3 0 2 3 1 0 2
+	//                         3 1 0 3 0 2 3 0
+	//                         0 2 1 3 0 3 2 1
+	//                         0 3 3 2 1 0 1 2
+	//                         3 0 2 3 1 0 2 2]
+	//
+	// 2- DataTile, which also represents a tile, in this case using 8
+	// rows of uint16 (16 bits per row, each pixel is 2 bits, so 8 pixels per
+	// row). Right now all values are 0, waiting to be filled with the values of
+	// the GIMP pixels:
+	//
+	//  uint16_t row [8]: [00000000 00000000
+	//                     00000000 00000000
+	//                     00000000 00000000
+	//                     00000000 00000000
+	//                     00000000 00000000
+	//                     00000000 00000000
+	//                     00000000 00000000
+	//                     00000000 00000000]
+	//
+	// For every GIMP pixel, we have to get those significant last 2
+	// bits of the guchar containing the color value, and place them in the
+	// right position of their row in DataTile. But the Game Boy uses a very
+	// specific format. Instead of storing those 2 bits consecutively, the low
+	// bit (the rightmost one) is stored in the first byte of the tile, and the
+	// high bit (the leftmost one) is stored in the second byte. For example,
+	// after processing the first pixel above the result would be:
+	//
+	//  uint16_t row [8]: [10000000 00000000 <=> [ 1]
+	//                     00000000 00000000     [01]
+	//                     00000000 00000000       1 - Low
+	//                     00000000 00000000      0  - High
+	//                     00000000 00000000
+	//                     00000000 00000000
+	//                     00000000 00000000
+	//                     00000000 00000000]
+	//
+	// After processing the whole first row (8 pixels) the result would be:
+	//
+	//  uint16_t row [8]: [10100101 00101001 <=> [ 1  0  3  0  2  1  0  3]
+	//                     00000000 00000000     [01 00 11 00 10 01 00 11]
+	//                     00000000 00000000       1  0  1  0  0  1  0  1 - Low
+	//                     00000000 00000000      0  0  1  0  1  0  0  1  - High
+	//                     00000000 00000000
+	//                     00000000 00000000
+	//                     00000000 00000000
+	//                     00000000 00000000]
+	//
+	// When all 64 pixels are processed, this tile is done.
+	//
+	// Doing it literally (pixel by pixel, 2 masks, 2 shifts and 2 writes each)
+	// is slow, so the real work is done by one of the packers below, which
+	// handle a whole line of 8 pixels (or several lines) with each operation.
+	// The fastest one the CPU supports is chosen the first time.
+	static TilePacker PtilePacker = NULL; /**< Tile packer best suited to this CPU, chosen on first use. */
+	static gsize UIpackerChosen = 0; /**< Guard for choosing the packer only once (thread-safe). */
+	
+	if (g_once_init_enter(& UIpackerChosen))
+	{
+		PtilePacker = image2gb_select_packer();
+		g_once_init_leave(& UIpackerChosen, 1);
+	}
+	
+	PtilePacker(Ppixels, UIrowstride, PdataTile);
+}
+
+static TilePacker
+image2gb_select_packer(void)
+{
+#ifdef IMAGE2GB_PACK_X86
+	__builtin_cpu_init();
+	
+	if (__builtin_cpu_supports("avx2"))
+		return image2gb_pack_tile_avx2;
+		
+	if (__builtin_cpu_supports("sse2"))
+		return image2gb_pack_tile_sse2;
+#endif
+		
+	return image2gb_pack_tile_scalar;
+}
+
+static void
+image2gb_pack_tile_scalar(const guchar* Ppixels, guint UIrowstride, DataTile* PdataTile)
+{
+	// Read a line of 8 pixels as a single 64-bit number (pixel 0 in the lowest
+	// byte). Masking it against 0x0101010101010101 keeps the low bit of every
+	// pixel, and multiplying the result by 0x8040201008040201 gathers those 8
+	// bits in the top byte, with pixel 0 as its leftmost bit (every partial
+	// product lands on a different bit, so nothing carries). That byte is the
+	// low bitplane of the line; the same trick after shifting right by 1 gives
+	// the high bitplane.
+	for (guchar line = 0; line < IMAGE2GB_TILE_SIZE; line++)
+	{
+		guint64 ULpixels = 0; /**< The 8 pixels of this line. */
+		
+		memcpy(& ULpixels, Ppixels + (line * UIrowstride), sizeof(ULpixels));
+		ULpixels = GUINT64_FROM_LE(ULpixels);
+		
+		guint16 UIlowBits = (((ULpixels & G_GUINT64_CONSTANT(0x0101010101010101))
+		                      * G_GUINT64_CONSTANT(0x8040201008040201)) >> 56);
+		guint16 UIhighBits = ((((ULpixels >> 1) & G_GUINT64_CONSTANT(0x0101010101010101))
+		                       * G_GUINT64_CONSTANT(0x8040201008040201)) >> 56);
+		                       
+		PdataTile->row[line] = ((UIlowBits << 8) | UIhighBits);
+	}
+}
+
+#ifdef IMAGE2GB_PACK_X86
+__attribute__((target("sse2"))) static void
+image2gb_pack_tile_sse2(const guchar* Ppixels, guint UIrowstride, DataTile* PdataTile)
+{
+	// Load 2 lines (16 pixels) per register and reverse the pixels of each line,
+	// so pixel 0 is the last byte. Shifting every pixel left by 7 moves its low
+	// bit to the sign position of its byte (by 6, the high bit), and movemask
+	// collects the 16 sign bits in order: the bitplane bytes of both lines.
+	for (guchar line = 0; line < IMAGE2GB_TILE_SIZE; line += 2)
+	{
+		__m128i Vpixels = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(Ppixels + (line * UIrowstride))),
+		                                     _mm_loadl_epi64((const __m128i*)(Ppixels + ((line + 1) * UIrowstride))));
+		                                     
+		// Reverse the 16-bit words of each line, then the 2 bytes of each word.
+		Vpixels = _mm_shufflelo_epi16(Vpixels, _MM_SHUFFLE(0, 1, 2, 3));
+		Vpixels = _mm_shufflehi_epi16(Vpixels, _MM_SHUFFLE(0, 1, 2, 3));
+		Vpixels = _mm_or_si128(_mm_slli_epi16(Vpixels, 8), _mm_srli_epi16(Vpixels, 8));
+		
+		guint UIlowBits = _mm_movemask_epi8(_mm_slli_epi16(Vpixels, 7));
+		guint UIhighBits = _mm_movemask_epi8(_mm_slli_epi16(Vpixels, 6));
+		
+		PdataTile->row[line] = (((UIlowBits & 0xFF) << 8) | (UIhighBits & 0xFF));
+		PdataTile->row[line + 1] = ((UIlowBits & 0xFF00) | (UIhighBits >> 8));
+	}
+}
+
+__attribute__((target("avx2"))) static void
+image2gb_pack_tile_avx2(const guchar* Ppixels, guint UIrowstride, DataTile* PdataTile)
+{
+	// Same idea as the SSE2 packer, with 4 lines (32 pixels) per register, and
+	// a single byte shuffle to reverse the pixels of every line.
+	const __m256i Vreverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+	                                          7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	                                          
+	for (guchar line = 0; line < IMAGE2GB_TILE_SIZE; line += 4)
+	{
+		long long ArrayLines[4]; /**< The 4 lines of 8 pixels loaded in this step. */
+		
+		for (guchar l = 0; l < 4; l++)
+			memcpy(ArrayLines + l, Ppixels + ((line + l) * UIrowstride), sizeof(ArrayLines[l]));
+			
+		__m256i Vpixels = _mm256_setr_epi64x(ArrayLines[0], ArrayLines[1], ArrayLines[2], ArrayLines[3]);
+		
+		Vpixels = _mm256_shuffle_epi8(Vpixels, Vreverse);
+		
+		guint UIlowBits = _mm256_movemask_epi8(_mm256_slli_epi16(Vpixels, 7));
+		guint UIhighBits = _mm256_movemask_epi8(_mm256_slli_epi16(Vpixels, 6));
+		
+		for (guchar l = 0; l < 4; l++)
+			PdataTile->row[line + l] = ((((UIlowBits >> (8 * l)) & 0xFF) << 8) | ((UIhighBits >> (8 * l)) & 0xFF));
+	}
+}
+#endif
+
+static void
+image2gb_check_duplicates(ExportContext* Pcontext, const DedupeState* Pprevious)
+{
+	guint UItileTotal = (Pcontext->tileWidth * Pcontext->tileHeight); /**< Number of tiles in the image, duplicates included. */
+	
+	// Right now the image data has as many different tiles as the full original
+	// image. We have to check if any of the tiles are duplicated, because in
+	// that case we could save video memory by removing it. First we find, for
+	// every tile, the first tile with the same data (see
+	// image2gb_find_originals()). Then we traverse the data tiles in order: if
+	// a tile is its own original, it is a new unique tile, and its value in the
+	// tilemap is the number of unique tiles before it (that will be its
+	// position in the final data array, where duplicates are removed). If it is
+	// not, we mark it as duplicate, and in the tilemap we give it the value of
+	// the tile it is a copy of. For example, if tile 61 is a copy of tile 37,
+	// and there were 11 duplicates before tile 37, both get the value 26 in the
+	// tilemap. The originals are stored in the tilemap itself: as an original
+	// always comes before its copies, its final value is already there when
+	// they need it.
+	
+	Pcontext->tileCount = 0;
+	
+	if ((Pprevious == NULL) || (! image2gb_find_originals_incremental(Pcontext, Pprevious)))
+		image2gb_find_originals(Pcontext->tiles, UItileTotal, Pcontext->hashes, Pcontext->map);
+		
+	for (guint tile = 0; tile < UItileTotal; tile++)
+	{
+		guint UIoriginal = Pcontext->map[tile]; /**< First tile with this data. */
+		
+		if (UIoriginal == tile)
+		{
+			Pcontext->tiles[tile].duplicate = FALSE;
+			Pcontext->map[tile] = Pcontext->tileCount;
+			Pcontext->tileCount++;
+		}
+		else
+		{
+			Pcontext->tiles[tile].duplicate = TRUE;
+			Pcontext->map[tile] = Pcontext->map[UIoriginal];
+		}
+	}
+}
+
+static void
+image2gb_find_originals(const DataTile* PdataTiles, guint UItileTotal, guint* Phashes, guint* Poriginals)
+{
+	guint UIjobCount = image2gb_worker_count(UItileTotal); /**< Number of jobs (one per worker thread). */
+	guint UIjobTiles = ((UItileTotal + UIjobCount - 1) / UIjobCount); /**< Tiles hashed by every job (the last one may get less). */
+	DedupeJob* ArrayJobs = g_new(DedupeJob, UIjobCount); /**< Jobs for the worker threads. */
+	
+	// Equal tiles have equal hashes, so they always end up in the same shard,
+	// and each shard can be deduplicated on its own, with a hash table of its
+	// own. Every job walks the tiles in order, so the first tile with some
+	// data is found before its copies, as if it was done by a single thread.
+	for (guint job = 0; job < UIjobCount; job++)
+	{
+		ArrayJobs[job].tiles = PdataTiles;
+		ArrayJobs[job].tileTotal = UItileTotal;
+		ArrayJobs[job].hashes = Phashes;
+		ArrayJobs[job].originals = Poriginals;
+		ArrayJobs[job].first = MIN((job * UIjobTiles), UItileTotal);
+		ArrayJobs[job].last = MIN(((job + 1) * UIjobTiles), UItileTotal);
+		ArrayJobs[job].shard = job;
+		ArrayJobs[job].shardCount = UIjobCount;
+	}
+	
+	image2gb_run_jobs(image2gb_hash_tiles_job, ArrayJobs, sizeof(DedupeJob), UIjobCount);
+	image2gb_run_jobs(image2gb_find_originals_job, ArrayJobs, sizeof(DedupeJob), UIjobCount);
+	
+	g_free(ArrayJobs);
+}
+
+static gboolean
+image2gb_find_originals_incremental(ExportContext* Pcontext, const DedupeState* Pprevious)
+{
+	guint UItileTotal = (Pcontext->tileWidth * Pcontext->tileHeight); /**< Number of tiles in the image. */
+	guint UIchangedTotal = 0; /**< Number of tiles that changed since the previous export. */
+	gboolean Bvalid = TRUE; /**< Whether the previous export can be used. */
+	guint* ArrayFirsts = NULL; /**< Position of the first tile of every unique tile of the previous export. */
+	gboolean* ArrayChanged = NULL; /**< Whether every tile changed. */
+	gboolean* ArrayAffected = NULL; /**< Whether the tiles of every unique tile of the previous export have to be looked up again. */
+	TileHashTable StructHashTable = {0}; /**< Index of the tiles looked up. */
+	
+	if ((Pprevious->tileWidth != Pcontext->tileWidth) || (Pprevious->tileHeight != Pcontext->tileHeight) ||
+	    (Pprevious->tileCount > UItileTotal))
+		return FALSE;
+		
+	ArrayFirsts = g_new(guint, MAX(Pprevious->tileCount, 1));
+	ArrayChanged = g_new0(gboolean, UItileTotal);
+	ArrayAffected = g_new0(gboolean, MAX(Pprevious->tileCount, 1));
+	
+	for (guint unique = 0; unique < Pprevious->tileCount; unique++)
+		ArrayFirsts[unique] = IMAGE2GB_HASH_EMPTY;
+		
+	// A tile did not change if it has the same hash as before, and the data of
+	// its unique tile back then. If it did, its old unique tile has to be
+	// redone (it lost a copy, or even its first tile).
+	for (guint tile = 0; tile < UItileTotal; tile++)
+	{
+		guint UIunique = Pprevious->map[tile]; /**< Unique tile it was a copy of. */
+		
+		if (UIunique >= Pprevious->tileCount)
+		{
+			Bvalid = FALSE;
+			
+			break;
+		}
+		
+		if (ArrayFirsts[UIunique] == IMAGE2GB_HASH_EMPTY)
+			ArrayFirsts[UIunique] = tile;
+			
+		Pcontext->hashes[tile] = image2gb_tile_hash(Pcontext->tiles + tile);
+		
+		if ((Pcontext->hashes[tile] != Pprevious->hashes[tile]) ||
+		    (memcmp(Pcontext->tiles[tile].row, Pprevious->tiles + (UIunique * IMAGE2GB_TILE_SIZE), sizeof(Pcontext->tiles[tile].row)) != 0))
+		{
+			ArrayChanged[tile] = TRUE;
+			ArrayAffected[UIunique] = TRUE;
+			UIchangedTotal++;
+		}
+	}
+	
+	// When most of the image changed, a full deduplication (that runs in
+	// parallel) is faster.
+	if ((! Bvalid) || ((2 * UIchangedTotal) > UItileTotal))
+	{
+		g_free(ArrayAffected);
+		g_free(ArrayChanged);
+		g_free(ArrayFirsts);
+		
+		return FALSE;
+	}
+	
+	// The unique tiles that now have the same data as a tile that changed have
+	// to be redone too. Their first tile did not change (otherwise they are
+	// already marked), so it still has their data. If it is not found, it gets
+	// added to the index, which does no harm: unique tiles all differ.
+	image2gb_hash_table_init(& StructHashTable, UIchangedTotal);
+	
+	for (guint tile = 0; tile < UItileTotal; tile++)
+	{
+		if (ArrayChanged[tile])
+			image2gb_hash_table_find_or_add_hashed(& StructHashTable, Pcontext->tiles, tile, Pcontext->hashes[tile]);
+	}
+	
+	for (guint unique = 0; unique < Pprevious->tileCount; unique++)
+	{
+		guint UIfirst = ArrayFirsts[unique]; /**< First tile with the data of this unique tile. */
+		
+		if ((UIfirst == IMAGE2GB_HASH_EMPTY) || ArrayAffected[unique])
+			continue;
+			
+		if (image2gb_hash_table_find_or_add_hashed(& StructHashTable, Pcontext->tiles, UIfirst, Pcontext->hashes[UIfirst]) != UIfirst)
+			ArrayAffected[unique] = TRUE;
+	}
+	
+	image2gb_hash_table_free(& StructHashTable);
+	
+	// Tiles of the unique tiles that were not affected keep their original:
+	// none of its copies changed, and no other tile got its data. The rest are
+	// looked up again, in order, among themselves (no other tile has their
+	// data).
+	image2gb_hash_table_init(& StructHashTable, UIchangedTotal);
+	
+	for (guint tile = 0; tile < UItileTotal; tile++)
+	{
+		guint UIunique = Pprevious->map[tile]; /**< Unique tile it was a copy of. */
+		
+		if (ArrayChanged[tile] || ArrayAffected[UIunique])
+			Pcontext->map[tile] = image2gb_hash_table_find_or_add_hashed(& StructHashTable, Pcontext->tiles, tile, Pcontext->hashes[tile]);
+		else
+			Pcontext->map[tile] = ArrayFirsts[UIunique];
+	}
+	
+	image2gb_hash_table_free(& StructHashTable);
+	
+	g_free(ArrayAffected);
+	g_free(ArrayChanged);
+	g_free(ArrayFirsts);
+	
+	return TRUE;
+}
+
+static void
+image2gb_hash_tiles_job(gpointer Pjob, gpointer Pdata)
+{
+	const DedupeJob* PdedupeJob = Pjob; /**< Range of tiles to hash. */
+	
+	for (guint tile = PdedupeJob->first; tile < PdedupeJob->last; tile++)
+		PdedupeJob->hashes[tile] = image2gb_tile_hash(PdedupeJob->tiles + tile);
+}
+
+static void
+image2gb_find_originals_job(gpointer Pjob, gpointer Pdata)
+{
+	const DedupeJob* PdedupeJob = Pjob; /**< Shard to deduplicate. */
+	TileHashTable StructHashTable = {0}; /**< Index of the unique tiles of the shard found so far. */
+	
+	image2gb_hash_table_init(& StructHashTable, (PdedupeJob->tileTotal / PdedupeJob->shardCount));
+	
+	for (guint tile = 0; tile < PdedupeJob->tileTotal; tile++)
+	{
+		guint UIhash = PdedupeJob->hashes[tile]; /**< Hash of the tile. */
+		
+		// The shard is chosen by the high bits of the hash, the hash table
+		// slot by the low ones, so tiles still spread over the whole table.
+		if ((guint)(((guint64) UIhash * PdedupeJob->shardCount) >> 32) != PdedupeJob->shard)
+			continue;
+			
+		PdedupeJob->originals[tile] = image2gb_hash_table_find_or_add_hashed(& StructHashTable, PdedupeJob->tiles, tile, UIhash);
+	}
+	
+	image2gb_hash_table_free(& StructHashTable);
+}
+
+static guint
+image2gb_tile_hash(const DataTile* PdataTile)
+{
+	guint64 ULfirstHalf = 0; /**< Rows 0-3 of the tile. */
+	guint64 ULsecondHalf = 0; /**< Rows 4-7 of the tile. */
+	guint64 ULhash = 0; /**< Result. */
+	
+	memcpy(& ULfirstHalf, PdataTile->row, sizeof(ULfirstHalf));
+	memcpy(& ULsecondHalf, PdataTile->row + 4, sizeof(ULsecondHalf));
+	
+	// Multiply-xor mixing, the high bits end up depending on all the input.
+	ULhash = ((ULfirstHalf * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15)) ^ ULsecondHalf);
+	ULhash = (ULhash * G_GUINT64_CONSTANT(0xC2B2AE3D27D4EB4F));
+	ULhash = (ULhash ^ (ULhash >> 32));
+	
+	return (guint) ULhash;
+}
+
+static void
+image2gb_hash_table_init(TileHashTable* PhashTable, guint UIexpectedTiles)
+{
+	guint UIslotCount = 16; /**< Number of slots, at least twice the expected tiles. */
+	
+	while (UIslotCount < (2 * UIexpectedTiles))
+		UIslotCount *= 2;
+		
+	PhashTable->slots = g_new(guint, UIslotCount);
+	PhashTable->mask = (UIslotCount - 1);
+	PhashTable->count = 0;
+	
+	for (guint slot = 0; slot < UIslotCount; slot++)
+		PhashTable->slots[slot] = IMAGE2GB_HASH_EMPTY;
+}
+
+static void
+image2gb_hash_table_free(TileHashTable* PhashTable)
+{
+	g_free(PhashTable->slots);
+	
+	PhashTable->slots = NULL;
+	PhashTable->mask = 0;
+	PhashTable->count = 0;
+}
+
+static guint
+image2gb_hash_table_find_or_add(TileHashTable* PhashTable, const DataTile* PdataTiles, guint UItile)
+{
+	return image2gb_hash_table_find_or_add_hashed(PhashTable, PdataTiles, UItile, image2gb_tile_hash(PdataTiles + UItile));
+}
+
+static guint
+image2gb_hash_table_find_or_add_hashed(TileHashTable* PhashTable, const DataTile* PdataTiles, guint UItile, guint UIhash)
+{
+	guint UIslot = (UIhash & PhashTable->mask); /**< Current slot being probed. */
+	
+	// Walk the slots from the one given by the hash until we find the tile, or
+	// an empty slot (then it is not in the table). Tiles with the same hash are
+	// not necessarily equal, so the full data is always compared.
+	while (PhashTable->slots[UIslot] != IMAGE2GB_HASH_EMPTY)
+	{
+		guint UIcandidate = PhashTable->slots[UIslot];
+		
+		if (memcmp(PdataTiles[UIcandidate].row, PdataTiles[UItile].row, sizeof(PdataTiles[UItile].row)) == 0)
+			return UIcandidate;
+			
+		UIslot = ((UIslot + 1) & PhashTable->mask);
+	}
+	
+	PhashTable->slots[UIslot] = UItile;
+	PhashTable->count++;
+	
+	// Keep the table at most half full, so probe sequences stay short.
+	if ((2 * PhashTable->count) > PhashTable->mask)
+	{
+		guint* PoldSlots = PhashTable->slots; /**< Slots before growing. */
+		guint UIoldSlotCount = (PhashTable->mask + 1); /**< Number of slots before growing. */
+		
+		image2gb_hash_table_init(PhashTable, UIoldSlotCount);
+		
+		for (guint slot = 0; slot < UIoldSlotCount; slot++)
+		{
+			if (PoldSlots[slot] != IMAGE2GB_HASH_EMPTY)
+			{
+				UIslot = (image2gb_tile_hash(PdataTiles + PoldSlots[slot]) & PhashTable->mask);
+				
+				while (PhashTable->slots[UIslot] != IMAGE2GB_HASH_EMPTY)
+					UIslot = ((UIslot + 1) & PhashTable->mask);
+					
+				PhashTable->slots[UIslot] = PoldSlots[slot];
+				PhashTable->count++;
+			}
+		}
+		
+		g_free(PoldSlots);
+	}
+	
+	return UItile;
+}
+
+static guint
+image2gb_worker_count(guint UItileTotal)
+{
+	guint UIworkers = g_get_num_processors(); /**< Return value. */
+	
+	if (UItileTotal <= IMAGE2GB_PARALLEL_TILES_MIN)
+		return 1;
+		
+	// Every thread should get enough tiles to make up for starting it.
+	UIworkers = MIN(UIworkers, (UItileTotal / IMAGE2GB_PARALLEL_JOB_TILES));
+	
+	return CLAMP(UIworkers, 1, IMAGE2GB_PARALLEL_WORKERS_MAX);
+}
+
+static void
+image2gb_run_jobs(GFunc Pwork, gpointer Pjobs, gsize UIjobSize, guint UIjobCount)
+{
+	GThreadPool* Gpool = NULL; /**< Worker threads. */
+	
+	// The pool is not exclusive, so GLib reuses its threads from one call to
+	// the next. If it can not be created, the jobs just run here.
+	if (UIjobCount > 1)
+		Gpool = g_thread_pool_new(Pwork, NULL, UIjobCount, FALSE, NULL);
+		
+	for (guint job = 0; job < UIjobCount; job++)
+	{
+		gpointer Pjob = ((guchar*) Pjobs + (job * UIjobSize)); /**< Job to run. */
+		
+		if (Gpool != NULL)
+			g_thread_pool_push(Gpool, Pjob, NULL);
+		else
+			Pwork(Pjob, NULL);
+	}
+	
+	// Wait for all jobs to finish.
+	if (Gpool != NULL)
+		g_thread_pool_free(Gpool, FALSE, TRUE);
+}
+
+static gboolean
+image2gb_write_files(ExportContext* Pcontext)
+{
+	const PluginExportOptions* PexportOptions = & Pcontext->options; /**< Export parameters. */
+	gchar SfileName[PATH_MAX] = {0}; /**< Auxiliary string for composing the full file names. */
+	gchar SNameLowercase[IMAGE2GB_ASSET_NAME_MAX_LENGTH] = {0}; /**< Asset name, all lowercase. */
+	gchar SNameUppercase[IMAGE2GB_ASSET_NAME_MAX_LENGTH] = {0}; /**< Asset name, all UPPERCASE. */
+	const PackedOutput* Ppacked = & Pcontext->packed; /**< Compressed tile data and tilemap. */
+	gboolean Bpacked = (PexportOptions->compression != IMAGE2GB_COMPRESSION_NONE); /**< Whether the asset is compressed. */
+	gboolean Buploads = ((PexportOptions->uploadBudget > 0) && (! Bpacked) &&
+	                     ((PexportOptions->tileBase + Pcontext->tileCount) <= IMAGE2GB_IMAGE_TILES_VRAM_LIMIT)); /**< Whether the asset has an upload table. */
+	GString* Sconstants = g_string_new(NULL); /**< Constants and checks that only some headers have (may be empty). */
+	gchar* Sinfo = NULL; /**< Details of the compression, for the comment at the top of the header (may be empty). */
+	const gchar* SmapType = NULL; /**< C type of the tilemap entries. */
+	guint UIdataSize = (Pcontext->tileCount * IMAGE2GB_TILE_BYTES); /**< Size of the tile data, as written. */
+	ExportLayout Elayout = image2gb_map_layout(Pcontext); /**< Order of the tilemap entries. */
+	guint UImapLines = 0; /**< Rows (or columns) of the tilemap, as written. */
+	guint UImapPitch = image2gb_map_pitch(Pcontext, Elayout, & UImapLines); /**< Entries of every line of the tilemap. */
+	guint UImapSize = ((UImapLines * UImapPitch) * (image2gb_map_is_16bit(Pcontext) ? 2 : 1)); /**< Size of the tilemap, as written. */
+	OutputWriter StructWriter = {0}; /**< Buffers the contents of the file being written. */
+	gint64 ItimeStart = 0; /**< When the stage being timed started. */
+	
+	// When writing the final .c source file, the values will be in hexadecimal.
+	// The Game Boy expects the asset data as unsigned chars (8-bit). Each tile
+	// row is 16-bit, so we have to take half and half and convert them to hex.
+	// 2 hex digits equal 8 bits (1 byte), so using the same example above:
+	//
+	//  [1 0 3 0 2 1 0 3] <=> [10100101 00101001] <=> [0xA5, 0x29] <=> 8 pixels
+	//
+	// Repeat this for the remaining 7 rows and you have a full tile, with 16
+	// byte values. Repeat for all tiles and you have the final image. Tiles
+	// marked as duplicate are ignored and not written. The tilemap is written
+	// with the tile base added to every entry, also in hexadecimal (one byte
+	// per entry, or two if the tile numbers go over 255; the C type changes
+	// accordingly), row by row unless the layout says otherwise (column by
+	// column, or rows padded to the background map in VRAM). In binary format,
+	// the very same bytes are written as they are, to a .2bpp file (tiles) and
+	// a .tilemap file (map, 16-bit entries are little-endian). Compressed assets
+	// have those bytes compressed instead, written the same way (the map is then
+	// always an array of bytes). With an upload budget, a table also tells how
+	// to copy the tile data to VRAM in chunks that fit in a frame (see
+	// image2gb_write_uploads()).
+	
+	// Get the all upper and lowercase version of the asset name.
+	for (guint c = 0; c < strlen(PexportOptions->name); c++)
+		SNameLowercase[c] = tolower(PexportOptions->name[c]);
+		
+	for (guint c = 0; c < strlen(PexportOptions->name); c++)
+		SNameUppercase[c] = toupper(PexportOptions->name[c]);
+		
+	ItimeStart = g_get_monotonic_time();
+	
+	// Compressed assets are compressed first, the header tells their sizes.
+	if (Bpacked)
+	{
+		if (! image2gb_pack_outputs(Pcontext))
+		{
+			g_string_free(Sconstants, TRUE);
+			
+			return FALSE;
+		}
+		
+		UIdataSize = Ppacked->data->len;
+		UImapSize = Ppacked->map->len;
+		
+		Sinfo = g_strdup_printf(IMAGE2GB_SOURCE_STRING_COMPRESSION_INFO, ArrayCompressionNames[PexportOptions->compression],
+		                        (UIdataSize + UImapSize), (Ppacked->dataSize + Ppacked->mapSize),
+		                        (guint)((100.0 * (UIdataSize + UImapSize)) / MAX(1, (Ppacked->dataSize + Ppacked->mapSize))),
+		                        Ppacked->cycles, ((gdouble) Ppacked->cycles / IMAGE2GB_CYCLES_FRAME));
+		g_string_append_printf(Sconstants, IMAGE2GB_SOURCE_STRING_COMPRESSION, SNameUppercase, PexportOptions->compression,
+		                       SNameUppercase, UIdataSize, SNameUppercase, UImapSize, SNameUppercase, Ppacked->cycles);
+		                       
+		ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_COMPRESS, ItimeStart);
+	}
+	else
+		Sinfo = g_strdup("");
+		
+	SmapType = ((! Bpacked) && image2gb_map_is_16bit(Pcontext)) ? "unsigned int" : "unsigned char";
+	
+	// Assets loaded at tile 0 may have more than 256 tiles (big images, loaded
+	// piece by piece), so the header only checks that the tiles fit if they are
+	// loaded somewhere else.
+	if (PexportOptions->tileBase > 0)
+		g_string_append_printf(Sconstants, IMAGE2GB_SOURCE_STRING_FIT_CHECK, SNameUppercase, SNameUppercase,
+		                       IMAGE2GB_IMAGE_TILES_VRAM_LIMIT, PexportOptions->name);
+		                       
+	if (Elayout != IMAGE2GB_LAYOUT_ROWS)
+		g_string_append_printf(Sconstants, IMAGE2GB_SOURCE_STRING_MAP_LAYOUT, SNameUppercase, Elayout, ArrayLayoutNames[Elayout],
+		                       SNameUppercase, UImapPitch, (Elayout == IMAGE2GB_LAYOUT_COLUMNS) ? "column" : "row");
+		                       
+	// The upload table goes in the header in binary format (there is no .c
+	// source), only its declaration otherwise.
+	if (Buploads)
+	{
+		guint UIchunkTiles = MAX(1, (guint) PexportOptions->uploadBudget / IMAGE2GB_TILE_BYTES); /**< Tiles per chunk. */
+		GString* Suploads = g_string_new(NULL); /**< Entries of the table. */
+		
+		g_string_append_printf(Sconstants, IMAGE2GB_SOURCE_STRING_UPLOADS,
+		                       SNameUppercase, ((Pcontext->tileCount + UIchunkTiles - 1) / UIchunkTiles),
+		                       SNameUppercase, UIchunkTiles, (UIchunkTiles * IMAGE2GB_TILE_BYTES));
+		                       
+		if (PexportOptions->format == IMAGE2GB_FORMAT_BINARY)
+		{
+			image2gb_write_uploads(Pcontext, Suploads, ", \\\n");
+			g_string_append_printf(Sconstants, IMAGE2GB_SOURCE_STRING_UPLOADS_TABLE, PexportOptions->name,
+			                       PexportOptions->name, SNameUppercase, SNameUppercase, Suploads->str);
+		}
+		else
+			g_string_append_printf(Sconstants, IMAGE2GB_SOURCE_STRING_UPLOADS_EXTERN, PexportOptions->name, PexportOptions->name);
+			
+		g_string_free(Suploads, TRUE);
+	}
+	
+	// First, write the .h header.
+	sprintf(SfileName, "%s/%s.h", PexportOptions->folder, SNameLowercase);
+	
+	if (! image2gb_writer_open(& StructWriter, SfileName, FALSE, & Pcontext->stats))
+	{
+		g_string_free(Sconstants, TRUE);
+		g_free(Sinfo);
+		
+		return FALSE;
+	}
+	
+	// Check "source_strings.h" to see what we're printing here.
+	if (PexportOptions->format == IMAGE2GB_FORMAT_BINARY)
+		g_string_append_printf(StructWriter.buffer, IMAGE2GB_SOURCE_STRING_H_BINARY,
+		                       SNameLowercase, PexportOptions->name,
+		                       Pcontext->tileCount, (Pcontext->tileWidth * Pcontext->tileHeight), Pcontext->tileWidth, Pcontext->tileHeight,
+		                       (Pcontext->tileWidth * IMAGE2GB_TILE_SIZE), (Pcontext->tileHeight * IMAGE2GB_TILE_SIZE),
+		                       PexportOptions->bank, Sinfo,
+		                       SNameLowercase, SNameLowercase,
+		                       PexportOptions->name, SNameLowercase, PexportOptions->name, SNameLowercase,
+		                       SNameUppercase, Pcontext->tileCount, SNameUppercase, PexportOptions->tileBase,
+		                       SNameUppercase, Pcontext->tileWidth, SNameUppercase, Pcontext->tileHeight, Sconstants->str,
+		                       SNameUppercase, UIdataSize, SNameLowercase,
+		                       SNameUppercase, image2gb_map_is_16bit(Pcontext) ? 2 : 1,
+		                       SNameUppercase, UImapSize, SNameLowercase,
+		                       PexportOptions->name, PexportOptions->name, PexportOptions->name, PexportOptions->name);
+	else
+		g_string_append_printf(StructWriter.buffer, IMAGE2GB_SOURCE_STRING_H,
+		                       SNameLowercase, PexportOptions->name,
+		                       Pcontext->tileCount, (Pcontext->tileWidth * Pcontext->tileHeight), Pcontext->tileWidth, Pcontext->tileHeight,
+		                       (Pcontext->tileWidth * IMAGE2GB_TILE_SIZE), (Pcontext->tileHeight * IMAGE2GB_TILE_SIZE),
+		                       PexportOptions->bank, Sinfo,
+		                       (PexportOptions->bank == 0) ? "//" : "", // If bank = 0, line is commented out.
+		                       (PexportOptions->bank == 0) ? "//" : "", SNameUppercase, // If bank = 0, line is commented out.
+		                       SNameUppercase, Pcontext->tileCount, SNameUppercase, PexportOptions->tileBase,
+		                       SNameUppercase, Pcontext->tileWidth, SNameUppercase, Pcontext->tileHeight, Sconstants->str,
+		                       PexportOptions->name, PexportOptions->name, PexportOptions->name,
+		                       SmapType, PexportOptions->name);
+		                       
+	g_string_free(Sconstants, TRUE);
+	g_free(Sinfo);
+	
+	if (! image2gb_writer_close(& StructWriter))
+		return FALSE;
+		
+	ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_WRITE_HEADER, ItimeStart);
+	
+	// Binary format: now, write the .2bpp tile data and the .tilemap map.
+	if (PexportOptions->format == IMAGE2GB_FORMAT_BINARY)
+	{
+		memset(SfileName, 0, sizeof(SfileName));
+		sprintf(SfileName, "%s/%s.2bpp", PexportOptions->folder, SNameLowercase);
+		
+		if (! image2gb_writer_open(& StructWriter, SfileName, TRUE, & Pcontext->stats))
+			return FALSE;
+			
+		if (Bpacked)
+			image2gb_writer_append(& StructWriter, (const gchar*) Ppacked->data->data, Ppacked->data->len);
+		else
+			image2gb_write_tile_data_binary(Pcontext, & StructWriter);
+			
+		if (! image2gb_writer_close(& StructWriter))
+			return FALSE;
+			
+		memset(SfileName, 0, sizeof(SfileName));
+		sprintf(SfileName, "%s/%s.tilemap", PexportOptions->folder, SNameLowercase);
+		
+		if (! image2gb_writer_open(& StructWriter, SfileName, TRUE, & Pcontext->stats))
+			return FALSE;
+			
+		if (Bpacked)
+			image2gb_writer_append(& StructWriter, (const gchar*) Ppacked->map->data, Ppacked->map->len);
+		else if (! image2gb_write_tilemap_binary(Pcontext, & StructWriter))
+		{
+			image2gb_writer_close(& StructWriter);
+			
+			return FALSE;
+		}
+		
+		if (! image2gb_writer_close(& StructWriter))
+			return FALSE;
+			
+		image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_WRITE_SOURCE, ItimeStart);
+		
+		return TRUE;
+	}
+	
+	// Source format: now, write the .c source.
+	memset(SfileName, 0, sizeof(SfileName));
+	sprintf(SfileName, "%s/%s.c", PexportOptions->folder, SNameLowercase);
+	
+	if (! image2gb_writer_open(& StructWriter, SfileName, FALSE, & Pcontext->stats))
+		return FALSE;
+		
+	// Check "source_strings.h" to see what we're printing here.
+	g_string_append_printf(StructWriter.buffer, IMAGE2GB_SOURCE_STRING_C_1,
+	                       SNameLowercase, PexportOptions->name,
+	                       Pcontext->tileCount, (Pcontext->tileWidth * Pcontext->tileHeight), Pcontext->tileWidth, Pcontext->tileHeight,
+	                       (Pcontext->tileWidth * IMAGE2GB_TILE_SIZE), (Pcontext->tileHeight * IMAGE2GB_TILE_SIZE),
+	                       PexportOptions->bank,
+	                       SNameLowercase,
+	                       (PexportOptions->bank == 0) ? "//" : "", // If bank = 0, line is commented out.
+	                       (PexportOptions->bank == 0) ? "//" : "", SNameUppercase, // If bank = 0, line is commented out.
+	                       PexportOptions->name);
+	                       
+	if (Bpacked)
+	{
+		image2gb_write_bytes(& StructWriter, Ppacked->data->data, Ppacked->data->len);
+		image2gb_writer_append(& StructWriter, "\n", 1);
+	}
+	else
+		image2gb_write_tile_data(Pcontext, & StructWriter);
+		
+	g_string_append_printf(StructWriter.buffer, IMAGE2GB_SOURCE_STRING_C_2, SmapType, PexportOptions->name);
+	
+	if (Bpacked)
+		image2gb_write_bytes(& StructWriter, Ppacked->map->data, Ppacked->map->len);
+	else if (! image2gb_write_tilemap(Pcontext, & StructWriter))
+	{
+		image2gb_writer_close(& StructWriter);
+		
+		return FALSE;
+	}
+	
+	image2gb_writer_append(& StructWriter, "\n};", 3);
+	
+	if (Buploads)
+	{
+		GString* Suploads = g_string_new(NULL); /**< Entries of the upload table. */
+		
+		image2gb_write_uploads(Pcontext, Suploads, ",\n");
+		g_string_append_printf(StructWriter.buffer, IMAGE2GB_SOURCE_STRING_C_UPLOADS, PexportOptions->name, Suploads->str);
+		
+		g_string_free(Suploads, TRUE);
+	}
+	
+	if (! image2gb_writer_close(& StructWriter))
+		return FALSE;
+		
+	image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_WRITE_SOURCE, ItimeStart);
+	
+	return TRUE;
+}
+
+static gboolean
+image2gb_write_depfile(ExportContext* Pcontext)
+{
+	const PluginExportOptions* PexportOptions = & Pcontext->options; /**< Export parameters. */
+	gchar* SnameLowercase = g_ascii_strdown(PexportOptions->name, -1); /**< Asset name, all lowercase (as in the file names). */
+	gchar* SdepfileName = g_strdup_printf("%s/%s.%s", PexportOptions->folder, SnameLowercase, IMAGE2GB_DEPFILE_EXTENSION); /**< Full name of the depfile. */
+	gchar* SstampName = g_strdup_printf("%s/%s.%s", PexportOptions->folder, SnameLowercase, IMAGE2GB_STAMP_EXTENSION); /**< Full name of the stamp file. */
+	gchar* SoutputName = NULL; /**< Name of the current output file. */
+	OutputWriter StructWriter = {0}; /**< Buffers the contents of the depfile. */
+	GError* Gerror = NULL; /**< Error writing the stamp file, if any. */
+	gboolean Bsuccess = TRUE; /**< Return value. */
+	
+	// A single rule, with the stamp file as first target (ninja only looks at
+	// that one), followed by an empty rule for every input (like gcc -MP), so
+	// make does not fail when one of them is deleted. The depfile goes through
+	// an OutputWriter, so it is only rewritten when the inputs change.
+	if (! image2gb_writer_open(& StructWriter, SdepfileName, FALSE, & Pcontext->stats))
+		Bsuccess = FALSE;
+	else
+	{
+		image2gb_depfile_append(StructWriter.buffer, SstampName);
+		
+		for (guint file = 0; (SoutputName = image2gb_output_file(PexportOptions, file)) != NULL; file++)
+		{
+			gchar* SfullName = g_strdup_printf("%s/%s", PexportOptions->folder, SoutputName); /**< Full name of the output file. */
+			
+			g_string_append_c(StructWriter.buffer, ' ');
+			image2gb_depfile_append(StructWriter.buffer, SfullName);
+			
+			g_free(SfullName);
+			g_free(SoutputName);
+		}
+		
+		g_string_append_c(StructWriter.buffer, ':');
+		
+		for (guint input = 0; input < Pcontext->dependencies->len; input++)
+		{
+			g_string_append(StructWriter.buffer, " \\\n ");
+			image2gb_depfile_append(StructWriter.buffer, g_ptr_array_index(Pcontext->dependencies, input));
+		}
+		
+		g_string_append_c(StructWriter.buffer, '\n');
+		
+		for (guint input = 0; input < Pcontext->dependencies->len; input++)
+		{
+			g_string_append_c(StructWriter.buffer, '\n');
+			image2gb_depfile_append(StructWriter.buffer, g_ptr_array_index(Pcontext->dependencies, input));
+			g_string_append(StructWriter.buffer, ":\n");
+		}
+		
+		Bsuccess = image2gb_writer_close(& StructWriter);
+	}
+	
+	// The stamp file is always rewritten, last (its contents do not matter).
+	if (Bsuccess && (! g_file_set_contents(SstampName, "", 0, & Gerror)))
+	{
+		g_message("Could not write %s (%s).\n", SstampName, Gerror->message);
+		
+		g_clear_error(& Gerror);
+		
+		Bsuccess = FALSE;
+	}
+	
+	g_free(SstampName);
+	g_free(SdepfileName);
+	g_free(SnameLowercase);
+	
+	return Bsuccess;
+}
+
+static void
+image2gb_depfile_append(GString* Stext, const gchar* SfileName)
+{
+	// Spaces and '#' are escaped with a backslash, '$' is doubled.
+	for (const gchar* Pchar = SfileName; (* Pchar) != '\0'; Pchar++)
+	{
+		if (((* Pchar) == ' ') || ((* Pchar) == '#'))
+			g_string_append_c(Stext, '\\');
+		else if ((* Pchar) == '$')
+			g_string_append_c(Stext, '$');
+			
+		g_string_append_c(Stext, (* Pchar));
+	}
+}
+
+static void
+image2gb_write_tile_data(const ExportContext* Pcontext, OutputWriter* Pwriter)
+{
+	guint UIprintCount = 0; /**< Auxiliary variable to keep track of how many tiles we have written. */
+	
+	// Print one tile per line (stop after the last unique one, in streaming
+	// mode the array holds nothing else).
+	for (guint tile = 0; UIprintCount < Pcontext->tileCount; tile++)
+	{
+		// Ignore duplicate tiles.
+		if (Pcontext->tiles[tile].duplicate == TRUE)
+			continue;
+			
+		UIprintCount++;
+		
+		image2gb_writer_append(Pwriter, "\t", 1);
+		
+		// There are 8 rows, each row is 2 hex numbers, so 16 per line in total.
+		for (guchar row = 0; row < IMAGE2GB_TILE_SIZE; row++)
+		{
+			// Shift right by 8 bits to write only the first half.
+			image2gb_writer_hex8(Pwriter, ((Pcontext->tiles[tile].row[row]) >> 8));
+			image2gb_writer_append(Pwriter, ", ", 2);
+			// Mask against 00000000 11111111 to write only the second half.
+			image2gb_writer_hex8(Pwriter, ((Pcontext->tiles[tile].row[row]) & 0xFF));
+			
+			// Do not write a comma after the last char of this tile.
+			if (row != (IMAGE2GB_TILE_SIZE - 1))
+				image2gb_writer_append(Pwriter, ", ", 2);
+		}
+		
+		// Do not write a comma after the last tile.
+		if (UIprintCount < Pcontext->tileCount)
+			image2gb_writer_append(Pwriter, ",\n", 2);
+		else
+			image2gb_writer_append(Pwriter, "\n", 1);
+	}
+}
+
+static gboolean
+image2gb_write_tilemap(const ExportContext* Pcontext, OutputWriter* Pwriter)
+{
+	guint32* PmapRow = NULL; /**< Buffer for reading a row of the tilemap, in streaming mode. */
+	gboolean B16bit = image2gb_map_is_16bit(Pcontext); /**< Whether entries are written as 16-bit values. */
+	ExportLayout Elayout = image2gb_map_layout(Pcontext); /**< Order of the entries. */
+	guint UIlines = 0; /**< Rows (or columns) of the map, as written. */
+	guint UIpitch = image2gb_map_pitch(Pcontext, Elayout, & UIlines); /**< Entries of every line. */
+	
+	if (Pcontext->map == NULL)
+		PmapRow = g_new(guint32, Pcontext->tileWidth);
+		
+	image2gb_writer_append(Pwriter, "\t", 1);
+	
+	// Print lines of "pitch" tiles (so the output code has as many rows and
+	// columns as the map, as laid out).
+	for (guint line = 0; line < UIlines; line++)
+	{
+		if (! image2gb_read_map_row(Pcontext, PmapRow, line, Pwriter))
+		{
+			g_free(PmapRow);
+			
+			return FALSE;
+		}
+		
+		for (guint entry = 0; entry < UIpitch; entry++)
+		{
+			guint UIentry = image2gb_map_entry(Pcontext, Elayout, line, entry, PmapRow); /**< Tile number, as it will be in VRAM. */
+			
+			if (B16bit)
+				image2gb_writer_hex16(Pwriter, UIentry);
+			else
+				image2gb_writer_hex8(Pwriter, UIentry);
+				
+			// If this is not the last tile of the map, print a separator.
+			if (entry != (UIpitch - 1))
+				image2gb_writer_append(Pwriter, ", ", 2);
+			else if (line != (UIlines - 1))
+				image2gb_writer_append(Pwriter, ",\n\t", 3);
+		}
+	}
+	
+	g_free(PmapRow);
+	return TRUE;
+}
+
+static void
+image2gb_write_tile_data_binary(const ExportContext* Pcontext, OutputWriter* Pwriter)
+{
+	guint UIprintCount = 0; /**< Auxiliary variable to keep track of how many tiles we have written. */
+	
+	for (guint tile = 0; UIprintCount < Pcontext->tileCount; tile++)
+	{
+		gchar ArrayBytes[IMAGE2GB_TILE_BYTES]; /**< The 16 bytes of this tile, in output order. */
+		
+		// Ignore duplicate tiles.
+		if (Pcontext->tiles[tile].duplicate == TRUE)
+			continue;
+			
+		UIprintCount++;
+		
+		// Same bytes as in the .c source: first half of each row, then second.
+		for (guchar row = 0; row < IMAGE2GB_TILE_SIZE; row++)
+		{
+			ArrayBytes[2 * row] = ((Pcontext->tiles[tile].row[row]) >> 8);
+			ArrayBytes[(2 * row) + 1] = ((Pcontext->tiles[tile].row[row]) & 0xFF);
+		}
+		
+		image2gb_writer_append(Pwriter, ArrayBytes, IMAGE2GB_TILE_BYTES);
+	}
+}
+
+static gboolean
+image2gb_write_tilemap_binary(const ExportContext* Pcontext, OutputWriter* Pwriter)
+{
+	guint32* PmapRow = NULL; /**< Buffer for reading a row of the tilemap, in streaming mode. */
+	gboolean B16bit = image2gb_map_is_16bit(Pcontext); /**< Whether entries are written as 16-bit values. */
+	ExportLayout Elayout = image2gb_map_layout(Pcontext); /**< Order of the entries. */
+	guint UIlines = 0; /**< Rows (or columns) of the map, as written. */
+	guint UIpitch = image2gb_map_pitch(Pcontext, Elayout, & UIlines); /**< Entries of every line. */
+	
+	if (Pcontext->map == NULL)
+		PmapRow = g_new(guint32, Pcontext->tileWidth);
+		
+	for (guint line = 0; line < UIlines; line++)
+	{
+		if (! image2gb_read_map_row(Pcontext, PmapRow, line, Pwriter))
+		{
+			g_free(PmapRow);
+			
+			return FALSE;
+		}
+		
+		for (guint entry = 0; entry < UIpitch; entry++)
+		{
+			guint UIentry = image2gb_map_entry(Pcontext, Elayout, line, entry, PmapRow); /**< Tile number, as it will be in VRAM. */
+			gchar ArrayBytes[2] = {(UIentry & 0xFF), ((UIentry >> 8) & 0xFF)}; /**< The entry, little-endian. */
+			
+			image2gb_writer_append(Pwriter, ArrayBytes, B16bit ? 2 : 1);
+		}
+	}
+	
+	g_free(PmapRow);
+	return TRUE;
+}
+
+static gboolean
+image2gb_read_map_row(const ExportContext* Pcontext, guint32* PmapRow, guint UIrow, OutputWriter* Pwriter)
+{
+	if ((Pcontext->map != NULL) ||
+	    (fread(PmapRow, sizeof(guint32), Pcontext->tileWidth, Pcontext->streamedMap) == Pcontext->tileWidth))
+		return TRUE;
+		
+	g_message("%s: could not read row %u of the tilemap back from its temporary file.\n",
+	          Pcontext->options.name, UIrow);
+	          
+	if (Pwriter->error == 0)
+		Pwriter->error = EIO;
+		
+	return FALSE;
+}
+
+static void
+image2gb_write_uploads(const ExportContext* Pcontext, GString* Stext, const gchar* Sseparator)
+{
+	guint UIchunkTiles = MAX(1, (guint) Pcontext->options.uploadBudget / IMAGE2GB_TILE_BYTES); /**< Tiles per chunk. */
+	
+	// Chunks are whole tiles, so set_bkg_data() can copy them as they are.
+	for (guint tile = 0; tile < Pcontext->tileCount; tile += UIchunkTiles)
+	{
+		guint UIoffset = (tile * IMAGE2GB_TILE_BYTES); /**< Where the chunk starts in the tile data. */
+		
+		if (tile > 0)
+			g_string_append(Stext, Sseparator);
+			
+		g_string_append_printf(Stext, "\t0x%02X, 0x%02X, 0x%02X, 0x%02X", (UIoffset & 0xFF), (UIoffset >> 8),
+		                       (Pcontext->options.tileBase + tile), MIN(UIchunkTiles, (Pcontext->tileCount - tile)));
+	}
+}
+
+static gboolean
+image2gb_pack_outputs(ExportContext* Pcontext)
+{
+	PackedOutput* Ppacked = & Pcontext->packed; /**< Where the result goes. */
+	OutputWriter StructWriter; /**< Collects the bytes to compress. */
+	GByteArray* Gcheck = g_byte_array_new(); /**< The compressed bytes, decompressed again. */
+	gboolean Bsuccess = TRUE; /**< Return value. */
+	
+	Ppacked->data = g_byte_array_new();
+	Ppacked->map = g_byte_array_new();
+	Ppacked->cycles = 0;
+	
+	// The bytes are the same the binary format has.
+	image2gb_writer_open_memory(& StructWriter);
+	image2gb_write_tile_data_binary(Pcontext, & StructWriter);
+	
+	Ppacked->dataSize = StructWriter.buffer->len;
+	image2gb_compress(Pcontext->options.compression, (const guint8*) StructWriter.buffer->str, StructWriter.buffer->len, Ppacked->data);
+	
+	// Decompressing it gives the cycles, and proves it was right.
+	Bsuccess = (image2gb_decompress(Pcontext->options.compression, Ppacked->data->data, Ppacked->data->len, Gcheck, & Ppacked->cycles)
+	            && (Gcheck->len == StructWriter.buffer->len) && (memcmp(Gcheck->data, StructWriter.buffer->str, Gcheck->len) == 0));
+	            
+	g_string_truncate(StructWriter.buffer, 0);
+	g_byte_array_set_size(Gcheck, 0);
+	
+	// The message was already given, no need to report a compression error.
+	if (! image2gb_write_tilemap_binary(Pcontext, & StructWriter))
+	{
+		g_string_free(StructWriter.buffer, TRUE);
+		g_byte_array_free(Gcheck, TRUE);
+		
+		return FALSE;
+	}
+	
+	Ppacked->mapSize = StructWriter.buffer->len;
+	image2gb_compress(Pcontext->options.compression, (const guint8*) StructWriter.buffer->str, StructWriter.buffer->len, Ppacked->map);
+	
+	Bsuccess = (Bsuccess && image2gb_decompress(Pcontext->options.compression, Ppacked->map->data, Ppacked->map->len, Gcheck, & Ppacked->cycles)
+	            && (Gcheck->len == StructWriter.buffer->len) && (memcmp(Gcheck->data, StructWriter.buffer->str, Gcheck->len) == 0));
+	            
+	if (! Bsuccess)
+		g_message("Could not compress %s: the compressed data does not decompress to the original.\n", Pcontext->options.name);
+		
+	g_string_free(StructWriter.buffer, TRUE);
+	g_byte_array_free(Gcheck, TRUE);
+	
+	return Bsuccess;
+}
+
+static void
+image2gb_write_bytes(OutputWriter* Pwriter, const guint8* Pdata, gsize UIlength)
+{
+	for (gsize byte = 0; byte < UIlength; byte++)
+	{
+		if ((byte % 16) == 0)
+			image2gb_writer_append(Pwriter, "\t", 1);
+			
+		image2gb_writer_hex8(Pwriter, Pdata[byte]);
+		
+		// Do not write a comma after the last byte.
+		if (byte == (UIlength - 1))
+			break;
+			
+		if ((byte % 16) == 15)
+			image2gb_writer_append(Pwriter, ",\n", 2);
+		else
+			image2gb_writer_append(Pwriter, ", ", 2);
+	}
+}
+
+static gboolean
+image2gb_writer_open(OutputWriter* Pwriter, const gchar* SfileName, gboolean Bbinary, ExportStats* Pstats)
+{
+	Pwriter->file = NULL;
+	Pwriter->name = g_strdup(SfileName);
+	Pwriter->tempName = NULL;
+	Pwriter->matched = 0;
+	Pwriter->binary = Bbinary;
+	Pwriter->buffer = g_string_sized_new(IMAGE2GB_OUTPUT_BUFFER_START);
+	Pwriter->error = 0;
+	Pwriter->stats = Pstats;
+	
+	// Nothing is written while the output matches the file it replaces, so an
+	// export that gives the same result leaves the file (and its modification
+	// time) alone, and does not trigger a rebuild of whatever depends on it.
+	// Text files are read in text mode, so line endings compare equal.
+	Pwriter->oldFile = fopen(SfileName, Bbinary ? "rb" : "r");
+	
+	if ((Pwriter->oldFile == NULL) && (! image2gb_writer_diverge(Pwriter)))
+	{
+		g_message("Could not open file %s, error code %d (%s).\n", SfileName, Pwriter->error, g_strerror(Pwriter->error));
+		
+		g_string_free(Pwriter->buffer, TRUE);
+		g_free(Pwriter->name);
+		
+		Pwriter->buffer = NULL;
+		Pwriter->name = NULL;
+		
+		return FALSE;
+	}
+	
+	return TRUE;
+}
+
+static void
+image2gb_writer_open_memory(OutputWriter* Pwriter)
+{
+	// Without a name, nothing is ever flushed.
+	memset(Pwriter, 0, sizeof(OutputWriter));
+	
+	Pwriter->buffer = g_string_new(NULL);
+}
+
+static gboolean
+image2gb_writer_diverge(OutputWriter* Pwriter)
+{
+	gint IfileDescriptor = -1; /**< Temporary file, as returned by GLib. */
+	gchar* Pcopy = NULL; /**< Piece of the old file being copied. */
+	guint64 UIcopied = 0; /**< Bytes of the old file copied so far. */
+	
+	// The temporary file goes in the same folder, so that renaming it over the
+	// old one is atomic: nobody ever sees a half written file.
+	Pwriter->tempName = g_strconcat(Pwriter->name, ".XXXXXX", NULL);
+	IfileDescriptor = g_mkstemp_full(Pwriter->tempName, O_WRONLY, 0666);
+	
+	// Text files are written in text mode, like they always were (on Windows,
+	// that means CRLF line endings).
+	if (IfileDescriptor != -1)
+		Pwriter->file = fdopen(IfileDescriptor, Pwriter->binary ? "wb" : "w");
+		
+	if (Pwriter->file == NULL)
+	{
+		// Save error code before calling another function (may be overwritten).
+		Pwriter->error = errno;
+		
+		if (IfileDescriptor != -1)
+		{
+			g_close(IfileDescriptor, NULL);
+			g_unlink(Pwriter->tempName);
+		}
+		
+		g_free(Pwriter->tempName);
+		
+		Pwriter->tempName = NULL;
+	}
+	else if (Pwriter->matched > 0)
+	{
+		// The part that matched was not kept, but it is in the old file.
+		Pcopy = g_malloc(MIN(Pwriter->matched, IMAGE2GB_OUTPUT_BUFFER_SIZE));
+		
+		rewind(Pwriter->oldFile);
+		
+		while ((UIcopied < Pwriter->matched) && (Pwriter->error == 0))
+		{
+			gsize UIlength = MIN((Pwriter->matched - UIcopied), IMAGE2GB_OUTPUT_BUFFER_SIZE); /**< Bytes to copy this time. */
+			
+			if ((fread(Pcopy, 1, UIlength, Pwriter->oldFile) != UIlength) || (fwrite(Pcopy, 1, UIlength, Pwriter->file) != UIlength))
+				Pwriter->error = (errno != 0) ? errno : EIO;
+				
+			UIcopied += UIlength;
+		}
+		
+		g_free(Pcopy);
+	}
+	
+	if (Pwriter->oldFile != NULL)
+		fclose(Pwriter->oldFile);
+		
+	Pwriter->oldFile = NULL;
+	
+	return (Pwriter->error == 0);
+}
+
+static void
+image2gb_writer_append(OutputWriter* Pwriter, const gchar* Stext, gsize UIlength)
+{
+	g_string_append_len(Pwriter->buffer, Stext, UIlength);
+	
+	// Only really huge files (streaming mode) are written in several pieces.
+	if ((Pwriter->buffer->len >= IMAGE2GB_OUTPUT_BUFFER_SIZE) && (Pwriter->name != NULL))
+		image2gb_writer_flush(Pwriter);
+}
+
+static void
+image2gb_writer_hex8(OutputWriter* Pwriter, guint UIvalue)
+{
+	// Every entry of the table is exactly 4 characters long ("0xNN").
+	image2gb_writer_append(Pwriter, SHexTable + (4 * (UIvalue & 0xFF)), 4);
+}
+
+static void
+image2gb_writer_hex16(OutputWriter* Pwriter, guint UIvalue)
+{
+	// "0x", then the 2 digits of the high byte, then those of the low byte.
+	image2gb_writer_append(Pwriter, SHexTable + (4 * ((UIvalue >> 8) & 0xFF)), 4);
+	image2gb_writer_append(Pwriter, SHexTable + (4 * (UIvalue & 0xFF)) + 2, 2);
+}
+
+static void
+image2gb_writer_flush(OutputWriter* Pwriter)
+{
+	gsize UIlength = Pwriter->buffer->len; /**< Bytes to write. */
+	
+	// While the output matches the old file, it is only compared with it.
+	if ((UIlength > 0) && (Pwriter->error == 0) && (Pwriter->file == NULL))
+	{
+		gchar* Pold = g_malloc(UIlength); /**< The same part of the old file. */
+		
+		if ((fread(Pold, 1, UIlength, Pwriter->oldFile) == UIlength) && (memcmp(Pold, Pwriter->buffer->str, UIlength) == 0))
+			Pwriter->matched += UIlength;
+		else
+			image2gb_writer_diverge(Pwriter);
+			
+		g_free(Pold);
+	}
+	
+	if ((UIlength > 0) && (Pwriter->error == 0) && (Pwriter->file != NULL)
+	    && (fwrite(Pwriter->buffer->str, 1, UIlength, Pwriter->file) != UIlength))
+		Pwriter->error = errno;
+		
+	Pwriter->stats->bytesWritten += UIlength;
+	
+	g_string_truncate(Pwriter->buffer, 0);
+}
+
+static gboolean
+image2gb_writer_close(OutputWriter* Pwriter)
+{
+	gboolean Bsuccess = TRUE; /**< Return value. */
+	
+	image2gb_writer_flush(Pwriter);
+	
+	// All the output matched, but the old file may still have more.
+	if ((Pwriter->file == NULL) && (Pwriter->error == 0) && (fgetc(Pwriter->oldFile) != EOF))
+		image2gb_writer_diverge(Pwriter);
+		
+	if (Pwriter->oldFile != NULL)
+		fclose(Pwriter->oldFile);
+		
+	// Only a complete file replaces the old one.
+	if (Pwriter->file != NULL)
+	{
+		// Save error code before calling another function (may be overwritten).
+		if ((fclose(Pwriter->file) != 0) && (Pwriter->error == 0))
+			Pwriter->error = errno;
+			
+		if ((Pwriter->error == 0) && (g_rename(Pwriter->tempName, Pwriter->name) != 0))
+			Pwriter->error = errno;
+			
+		if (Pwriter->error != 0)
+			g_unlink(Pwriter->tempName);
+	}
+	
+	if (Pwriter->error != 0)
+	{
+		g_message("While trying to write file %s, got error code %d (%s).\n",
+		          Pwriter->name, Pwriter->error, g_strerror(Pwriter->error));
+		          
+		Bsuccess = FALSE;
+	}
+	
+	g_string_free(Pwriter->buffer, TRUE);
+	g_free(Pwriter->tempName);
+	g_free(Pwriter->name);
+	
+	Pwriter->file = NULL;
+	Pwriter->oldFile = NULL;
+	Pwriter->buffer = NULL;
+	Pwriter->tempName = NULL;
+	Pwriter->name = NULL;
+	
+	return Bsuccess;
+}
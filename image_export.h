@@ -5,60 +5,41 @@
 
 #pragma once
 
-#include "image2gb.h" // For PluginExportOptions.
-#include "source_strings.h"
+#include "image_convert.h" // The conversion itself, this file only reads the GIMP image.
+#include "image2gb.h" // For the parasites with the parameters and the result of the previous export.
 
 // Ignore warnings in external libraries (GIMP, GTK...).
 #pragma GCC system_header
 #include <libgimp/gimp.h>
 #include <libgimp/gimpui.h>
-#include <ctype.h>
-#include <stdint.h>
-#include <stdio.h>
-#include <errno.h>
 
 // CONSTANTS ///////////////////////////////////////////////////////////////////
 
-#define IMAGE2GB_TILE_SIZE 8 /**< Size of a tile, in pixels (any dimension). */
-
-#define IMAGE2GB_IMAGE_SIZE_MIN IMAGE2GB_TILE_SIZE /**< Minimum acceptable image size, in pixels (any dimension). */
-#define IMAGE2GB_IMAGE_SIZE_MAX 256                /**< Maximum acceptable image size, in pixels (any dimension). */
-
-#define IMAGE2GB_IMAGE_TILES_VRAM_LIMIT 256 /**< How many unique tiles will fit in GB's VRAM at a time. */
+#define IMAGE2GB_READ_BUFFER_SIZE (1024 * 1024) /**< Max bytes read from GIMP in a single transfer (a band of tile rows). */
+#define IMAGE2GB_READ_METHOD      IMAGE2GB_READ_GEGL /**< Strategy used for reading the image (see ImageReadMethod). */
+#define IMAGE2GB_DEPFILE_VARIABLE "IMAGE2GB_DEPFILE" /**< Environment variable that enables the depfile and stamp file (see image2gb_write_depfile()). */
 
 // DEFINITIONS /////////////////////////////////////////////////////////////////
 
-/** Object that represents a tile on the GIMP image: a 8x8 pixel square.
+/** Available strategies for reading the pixels of the GIMP image.
  */
-typedef guchar ImageTile[IMAGE2GB_TILE_SIZE * IMAGE2GB_TILE_SIZE];
-
-/** Object that represents a Game Boy tile: a 8x8 square with 4-color (2 bit)
- *  pixels. Hence, a tile has 64 * 2 = 128 bits (16 bytes) of data, in 8 rows of
- *  16 bits (2 bytes) each.
- */
-typedef struct DataTile
+typedef enum ImageReadMethod
 {
-	uint16_t row[IMAGE2GB_TILE_SIZE]; /**< Array that stores the 8 pixel rows of this tile. */
-	gboolean duplicate; /**< Flag for marking this tile as a duplicate of another. */
-} DataTile;
-
-// VARIABLES ///////////////////////////////////////////////////////////////////
+	IMAGE2GB_READ_BANDS,  /**< Copy bands of tile rows to a plugin-side buffer (gimp_pixel_rgn_get_rect). */
+	IMAGE2GB_READ_NATIVE, /**< Walk GIMP's own storage tiles, without extra copies (gimp_pixel_rgns_process). */
+	IMAGE2GB_READ_GEGL    /**< Fetch bands of tile rows from the drawable's GEGL buffer (gegl_buffer_get). */
+} ImageReadMethod;
 
-/** Array that stores all tiles of the image, in Game Boy data format.
+/** Object that stores what image2gb_read_row_gegl() needs for reading a row of
+ *  tiles.
  */
-DataTile ArrayDataTiles[(IMAGE2GB_IMAGE_SIZE_MAX / IMAGE2GB_TILE_SIZE)
-                        * (IMAGE2GB_IMAGE_SIZE_MAX / IMAGE2GB_TILE_SIZE)] = {0};
-
-/** Array that stores the tilemap of the image, in Game Boy data format.
- */
-guint ArrayTileMap[(IMAGE2GB_IMAGE_SIZE_MAX / IMAGE2GB_TILE_SIZE)
-                   * (IMAGE2GB_IMAGE_SIZE_MAX / IMAGE2GB_TILE_SIZE)] = {0};
-
-guint UItileWidth = 0; /**< Width of the asset in Game Boy tiles. */
-
-guint UItileHeight = 0; /**< Height of the asset in Game Boy tiles. */
-
-guint UItileCount = 0; /**< Total number of tiles the asset has. */
+typedef struct GeglRowSource
+{
+	GeglBuffer* buffer; /**< GEGL buffer that holds the pixels of the drawable. */
+	const Babl* format; /**< Native format of the drawable (palette indices, 1 byte each). */
+	guchar* pixels; /**< Pixels of the row of tiles being processed. */
+	ExportStats* stats; /**< Where the calls to GIMP and the bytes read are counted. */
+} GeglRowSource;
 
 // FUNCTIONS ///////////////////////////////////////////////////////////////////
 
@@ -67,426 +48,348 @@ guint UItileCount = 0; /**< Total number of tiles the asset has. */
 static GimpPDBStatusType
 image2gb_export_image(gint32 IimageID, gint32 IdrawableID, PluginExportOptions* PexportOptions);
 
-/** Reads the GIMP image and populates the tile array accordingly.
+/** Reads the GIMP image one row of tiles at a time, keeping only the unique
+ *  tiles (see image2gb_stream_tiles()). Returns the program status.
  */
-static void
-image2gb_read_image_tiles(gint32 IimageID, gint32 IdrawableID);
+static GimpPDBStatusType
+image2gb_stream_image_tiles(ExportContext* Pcontext, gint32 IdrawableID);
 
-/** Parses a tile from the GIMP image and stores it in the given DataTile.
+/** Row reader for image2gb_stream_tiles(), Pdata being a GeglRowSource.
  */
-static void
-image2gb_read_tile(ImageTile* PimageTile, DataTile* PdataTile);
+static const guchar*
+image2gb_read_row_gegl(guint UIrow, guint UIrowstride, gpointer Pdata);
 
-/** Checks all tiles and finds the duplicates, removing them from the tilemap.
+/** Reads the GIMP image and populates the given tile array accordingly, using
+ *  the given strategy (the size and statistics are those of the context).
  */
 static void
-image2gb_check_duplicates(void);
+image2gb_read_image_tiles(gint32 IimageID, gint32 IdrawableID, ImageReadMethod EreadMethod, ExportContext* Pcontext, DataTile* PdataTiles);
 
-/** Writes the output .h header and .c source files containing the image asset.
- *  Returns the program status.
+/** Reads the GIMP image in bands of tile rows, copied to a buffer of our own.
  */
-static GimpPDBStatusType
-image2gb_write_files(PluginExportOptions* PexportOptions);
+static void
+image2gb_read_image_bands(gint32 IimageID, gint32 IdrawableID, ExportContext* Pcontext, DataTile* PdataTiles);
 
-/** Writes the asset tile data to the given file in the format expected by GBDK-2020.
+/** Reads the GIMP image directly from the drawable's storage tiles.
  */
 static void
-image2gb_write_tile_data(FILE* FileOut);
+image2gb_read_image_native(gint32 IimageID, gint32 IdrawableID, ExportContext* Pcontext, DataTile* PdataTiles);
 
-/** Writes the asset tilemap to the given file, in the format expected by GBDK-2020.
+/** Reads the GIMP image in bands of tile rows, fetched from its GEGL buffer.
  */
 static void
-image2gb_write_tilemap(FILE* FileOut);
+image2gb_read_image_gegl(gint32 IimageID, gint32 IdrawableID, ExportContext* Pcontext, DataTile* PdataTiles);
 
 ////////////////////////////////////////////////////////////////////////////////
 
 static GimpPDBStatusType
 image2gb_export_image(gint32 IimageID, gint32 IdrawableID, PluginExportOptions* PexportOptions)
 {
+	ExportContext* Pcontext = image2gb_context_new(PexportOptions); /**< State of this export. */
 	GimpPDBStatusType GreturnStatus = GIMP_PDB_SUCCESS; /**< Return value. */
+	gint64 ItimeStart = 0; /**< When the stage being timed started. */
+	GimpParasite* Gparasite = NULL; /**< Result of the previous export, if any. */
+	DedupeState StructPrevious = {0}; /**< Result of the previous export, if known. */
+	gchar* SimageFile = NULL; /**< File the image was loaded from, if any. */
 	
-	// Compute image statistics.
-	UItileWidth = (gimp_image_width(IimageID) / IMAGE2GB_TILE_SIZE);
-	UItileHeight = (gimp_image_height(IimageID) / IMAGE2GB_TILE_SIZE);
+	// The output depends on the file of the image (if it has one). Images are
+	// not exported from the build, so the depfile is only written on demand.
+	if ((g_getenv(IMAGE2GB_DEPFILE_VARIABLE) != NULL) && (g_getenv(IMAGE2GB_DEPFILE_VARIABLE)[0] != '\0'))
+	{
+		SimageFile = gimp_image_get_filename(IimageID);
+		Pcontext->stats.pdbCalls++;
+		
+		if (SimageFile != NULL)
+			image2gb_context_add_dependency(Pcontext, SimageFile);
+			
+		g_free(SimageFile);
+	}
 	
-	image2gb_read_image_tiles(IimageID, IdrawableID);
+	image2gb_context_set_size(Pcontext, gimp_image_width(IimageID), gimp_image_height(IimageID));
+	Pcontext->stats.pdbCalls += 2;
 	
-	image2gb_check_duplicates();
+	// Huge images are processed one row of tiles at a time, so memory usage
+	// depends on the number of unique tiles, not on the size of the image.
+	// Otherwise, all tiles are read first, then the duplicates are removed.
+	if ((Pcontext->tileWidth * Pcontext->tileHeight) > IMAGE2GB_STREAMING_TILES_MIN)
+		GreturnStatus = image2gb_stream_image_tiles(Pcontext, IdrawableID);
+	else
+	{
+		image2gb_alloc_tiles(Pcontext);
+		
+		image2gb_read_image_tiles(IimageID, IdrawableID, IMAGE2GB_READ_METHOD, Pcontext, Pcontext->tiles);
+		
+		// If the output is in the cache, the tiles are not needed any more.
+		ItimeStart = g_get_monotonic_time();
+		image2gb_cache_add_tiles(Pcontext, Pcontext->tiles, (Pcontext->tileWidth * Pcontext->tileHeight));
+		ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_CACHE, ItimeStart);
+		
+		// Otherwise, only the tiles that changed since the previous export
+		// are checked again (if it is known).
+		if (! image2gb_cache_lookup(Pcontext))
+		{
+			Gparasite = gimp_image_get_parasite(IimageID, IMAGE2GB_STATE_PARASITE);
+			Pcontext->stats.pdbCalls++;
+			
+			if ((Gparasite != NULL) && image2gb_load_dedupe_state(Gparasite, & StructPrevious))
+				image2gb_check_duplicates(Pcontext, & StructPrevious);
+			else
+				image2gb_check_duplicates(Pcontext, NULL);
+				
+			if (Gparasite != NULL)
+				gimp_parasite_free(Gparasite);
+				
+			image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_DEDUPE, ItimeStart);
+		}
+	}
 	
-	// Give a warning if the image will not fit in the Game Boy's VRAM.
-	if (UItileCount > IMAGE2GB_IMAGE_TILES_VRAM_LIMIT)
-		g_message("WARNING: this image has %u unique tiles. The Game Boy video memory can only fit " \
-		          "up to %d at the same time (384 using a hack). It will probably give errors.\n",
-		          UItileCount, IMAGE2GB_IMAGE_TILES_VRAM_LIMIT);
-		          
-	image2gb_write_files(PexportOptions);
+	if ((GreturnStatus == GIMP_PDB_SUCCESS) && (! image2gb_context_emit(Pcontext)))
+		GreturnStatus = GIMP_PDB_EXECUTION_ERROR;
+		
+	// Save the parameters (and the result of this export) for the next
+	// invocation, using parasites.
+	if (GreturnStatus == GIMP_PDB_SUCCESS)
+		image2gb_save_parameters(IimageID, Pcontext);
+		
+	image2gb_context_free(Pcontext);
 	
 	return GreturnStatus;
 }
 
-static void
-image2gb_read_image_tiles(gint32 IimageID, gint32 IdrawableID)
+static GimpPDBStatusType
+image2gb_stream_image_tiles(ExportContext* Pcontext, gint32 IdrawableID)
 {
-	GimpDrawable* Gdrawable = gimp_drawable_get(IdrawableID); /**< GIMP drawable object that represents the image. */
-	GimpPixelRgn Gregion = {0}; /**< GIMP pixel region for reading the image. */
-	ImageTile imageTile = {0}; /**< Array that stores the GIMP pixels of a tile (8x8). */
+	GeglRowSource StructSource = {0}; /**< Where the rows of tiles come from. */
+	guint UIimageWidth = (Pcontext->tileWidth * IMAGE2GB_TILE_SIZE); /**< Width of the image, in pixels. */
+	gboolean Bsuccess = TRUE; /**< Whether the image could be processed. */
 	
-	// Initialize the pixel region for later use.
-	gimp_pixel_rgn_init(& Gregion, Gdrawable,
-	                    0, 0,
-	                    gimp_image_width(IimageID), gimp_image_height(IimageID),
-	                    FALSE, FALSE);
-	                    
-	// Loop through all tiles of the GIMP image.
-	for (unsigned int row = 0; row < UItileHeight; row++)
-	{
-		for (unsigned int col = 0; col < UItileWidth; col++)
-		{
-			// Get the 64 pixels for this tile.
-			gimp_pixel_rgn_get_rect(& Gregion, imageTile,
-			                        IMAGE2GB_TILE_SIZE * col, IMAGE2GB_TILE_SIZE * row,
-			                        IMAGE2GB_TILE_SIZE, IMAGE2GB_TILE_SIZE);
-			                        
-			// Call this other function which will parse and store that tile.
-			// "array + n" gets the address of the nth element of the array.
-			image2gb_read_tile(& imageTile, ArrayDataTiles + ((row * UItileWidth) + col));
-		}
-	}
+	StructSource.buffer = gimp_drawable_get_buffer(IdrawableID);
+	StructSource.format = gimp_drawable_get_format(IdrawableID);
+	StructSource.pixels = g_new(guchar, (IMAGE2GB_TILE_SIZE * UIimageWidth));
+	StructSource.stats = & Pcontext->stats;
+	Pcontext->stats.pdbCalls += 2;
+	
+	Bsuccess = image2gb_stream_tiles(Pcontext, image2gb_read_row_gegl, UIimageWidth, & StructSource);
+	
+	g_free(StructSource.pixels);
+	g_object_unref(StructSource.buffer);
+	
+	return Bsuccess ? GIMP_PDB_SUCCESS : GIMP_PDB_EXECUTION_ERROR;
 }
 
-static void
-image2gb_read_tile(ImageTile* PimageTile, DataTile* PdataTile)
+static const guchar*
+image2gb_read_row_gegl(guint UIrow, guint UIrowstride, gpointer Pdata)
 {
-	// Visual explanation: right now we are processing a single tile, which is a
-	// square 8x8 pixel area of the image, 64 pixels in total. We have 2
-	// variable types:
-	//
-	// 1- ImageTile, filled with 64 guchar that contain the values of every
-	// pixel of this tile. Every pixel has a color index value from 0 (lightest
-	// green) to 3 (darkest green). Example with random values:
-	//
-	//  guchar ImageTile[64]: [1 0 3 0 2 1 0 3
-	//                         0 1 3 2 1 0 2 0
-	//                         0 1 2 0 3 1 1 2
-	//                         0 3 0 2 3 1 0 2
-	//                         3 1 0 3 0 2 3 0
-	//                         0 2 1 3 0 3 2 1
-	//                         0 3 3 2 1 0 1 2
-	//                         3 0 2 3 1 0 2 2]
-	//
-	// 2- DataTile, which also represents a tile, in this case using 8
-	// rows of uint16 (16 bits per row, each pixel is 2 bits, so 8 pixels per
-	// row). Right now all values are 0, waiting to be filled with the values of
-	// ImageTile:
-	//
-	//  uint16_t row [8]: [00000000 00000000
-	//                     00000000 00000000
-	//                     00000000 00000000
-	//                     00000000 00000000
-	//                     00000000 00000000
-	//                     00000000 00000000
-	//                     00000000 00000000
-	//                     00000000 00000000]
-	//
-	// For every pixel in ImageTile, we have to get those significant last 2
-	// bits of the guchar containing the color value, and place them in the
-	// right position of their row in DataTile. But the Game Boy uses a very
-	// specific format. Instead of storing those 2 bits consecutively, the low
-	// bit (the rightmost one) is stored in the first byte of the tile, and the
-	// high bit (the leftmost one) is stored in the second byte. For example,
-	// after processing the first pixel above the result would be:
-	//
-	//  uint16_t row [8]: [10000000 00000000 <=> [ 1]
-	//                     00000000 00000000     [01]
-	//                     00000000 00000000       1 - Low
-	//                     00000000 00000000      0  - High
-	//                     00000000 00000000
-	//                     00000000 00000000
-	//                     00000000 00000000
-	//                     00000000 00000000]
-	//
-	// After processing the whole first row (8 pixels) the result would be:
-	//
-	//  uint16_t row [8]: [10100101 00101001 <=> [ 1  0  3  0  2  1  0  3]
-	//                     00000000 00000000     [01 00 11 00 10 01 00 11]
-	//                     00000000 00000000       1  0  1  0  0  1  0  1 - Low
-	//                     00000000 00000000      0  0  1  0  1  0  0  1  - High
-	//                     00000000 00000000
-	//                     00000000 00000000
-	//                     00000000 00000000
-	//                     00000000 00000000]
-	//
-	// When all 64 pixels are processed, this tile is done.
+	GeglRowSource* Psource = Pdata; /**< Where the row comes from. */
 	
-	guchar UCbitPair = 1; /**< Current bit pair to write (we go left to right). */
-	guchar UCtileRow = 0; /**< Current row being written in this tile. */
+	// Get the pixels of this row of tiles (see image2gb_read_image_gegl()). The
+	// rowstride is the width of the image.
+	gegl_buffer_get(Psource->buffer,
+	                GEGL_RECTANGLE(0, IMAGE2GB_TILE_SIZE * UIrow, UIrowstride, IMAGE2GB_TILE_SIZE),
+	                1.0, Psource->format, Psource->pixels, UIrowstride, GEGL_ABYSS_NONE);
+	                
+	Psource->stats->pixelTransfers++;
+	Psource->stats->bytesRead += (IMAGE2GB_TILE_SIZE * UIrowstride);
 	
-	for (guchar pixel = 0; pixel < 64; pixel++)
-	{
-		// Get the individual bits of the color value, low (right) and high
-		// (left). Important, the variables must be 16-bit.
-		uint16_t UClowBit = (* PimageTile)[pixel] & 0x1;  // Mask against 00000001.
-		uint16_t UChighBit = ((* PimageTile)[pixel] & 0x2) >> 1;  // Mask against 00000010.
-		
-		// Shift bits to the left and store them.
-		PdataTile->row[UCtileRow] = (PdataTile->row[UCtileRow] | (UClowBit << (16 - UCbitPair)));
-		PdataTile->row[UCtileRow] = (PdataTile->row[UCtileRow] | (UChighBit << (8 - UCbitPair)));
-		
-		// Row finished? Switch to the next.
-		if (UCbitPair == 8)
-		{
-			UCbitPair = 1;
-			UCtileRow++;
-		}
-		else
-			UCbitPair++;
-	}
+	return Psource->pixels;
 }
 
 static void
-image2gb_check_duplicates(void)
+image2gb_read_image_tiles(gint32 IimageID, gint32 IdrawableID, ImageReadMethod EreadMethod, ExportContext* Pcontext, DataTile* PdataTiles)
 {
-	guint UIduplicateCount = 0; /**< Number of duplicate tiles that were found. */
-	gboolean BisDuplicate = FALSE; /**< Auxiliary variable for checking if a tile is duplicate. */
-	guint UIpreviousDuplicates = 0; /**< Auxiliary variable for storing how many duplicates before the current tile. */
-	
-	// Initialize count to the maximum possible number of tiles.
-	UItileCount = (UItileWidth * UItileHeight);
-	
-	// Initialize tilemap.
-	for (guint tile = 0; tile < UItileCount; tile++)
-		ArrayTileMap[tile] = tile;
-		
-	// Right now the image data has as many different tiles as the full original
-	// image, and the tilemap is just a count from 0 to N-1 (N being the number
-	// of tiles). We have to check if any of the tiles are duplicated, because
-	// in that case we could save video memory by removing it. The algorithm is
-	// simple: we traverse the data tiles, and for each one, we check if any of
-	// the next ones are identical. If true, we mark those as duplicates, then
-	// in the tilemap we replace them. For example, if we are checking tile 37,
-	// and we find that tile 61 is a copy, we would mark tile 61 as duplicate
-	// and in the tilemap replace "61" for "37". But, because in the final data
-	// duplicate tiles will be removed, we have to substract the current number
-	// of duplicates that have been found up to that moment. So, if there are 11
-	// duplicates before it so far, the correct tile value would be 26, not 37,
-	// because in the final tileset those 11 tiles before it will be suppressed.
-	
-	for (guint tile = 0; tile < UItileCount; tile++)
+	// Walking the native storage tiles only works if they are made of whole
+	// Game Boy tiles (GIMP uses 64x64, but better safe than sorry).
+	if (EreadMethod == IMAGE2GB_READ_NATIVE)
 	{
-		// Do not check tiles already marked as duplicate.
-		if (ArrayDataTiles[tile].duplicate == TRUE)
-		{
-			UIpreviousDuplicates++;
-			
-			continue;
-		}
+		guint UInativeWidth = gimp_tile_width(); /**< Width of GIMP's storage tiles, in pixels. */
+		guint UInativeHeight = gimp_tile_height(); /**< Height of GIMP's storage tiles, in pixels. */
 		
-		// Substract the number of duplicated tiles that exist up to this tile's
-		// position, to get the correct position it will be in when we output
-		// the final data array.
-		ArrayTileMap[tile] = (tile - UIpreviousDuplicates);
+		Pcontext->stats.pdbCalls += 2;
 		
-		// Do not check previous tiles, only check forward.
-		for (guint checktile = (tile + 1); checktile < UItileCount; checktile++)
-		{
-			BisDuplicate = FALSE;
+		if (((UInativeWidth % IMAGE2GB_TILE_SIZE) != 0) || ((UInativeHeight % IMAGE2GB_TILE_SIZE) != 0))
+			EreadMethod = IMAGE2GB_READ_BANDS;
+	}
+	
+	switch (EreadMethod)
+	{
+		case IMAGE2GB_READ_GEGL:
+			image2gb_read_image_gegl(IimageID, IdrawableID, Pcontext, PdataTiles);
+			break;
 			
-			// To see if they are equal, we have to compare row per row.
-			for (guchar row = 0; row < 8; row++)
-			{
-				if (ArrayDataTiles[tile].row[row] != ArrayDataTiles[checktile].row[row])
-					break;
-					
-				if (row == (8 - 1))
-					BisDuplicate = TRUE;
-			}
+		case IMAGE2GB_READ_NATIVE:
+			image2gb_read_image_native(IimageID, IdrawableID, Pcontext, PdataTiles);
+			break;
 			
-			if (BisDuplicate)
-			{
-				ArrayDataTiles[checktile].duplicate = TRUE;
-				UIduplicateCount++;
-				
-				// Replace its value in the tilemap with the one of the tile it
-				// is a duplicate of (its value was already corrected above).
-				ArrayTileMap[checktile] = ArrayTileMap[tile];
-			}
-		}
+		case IMAGE2GB_READ_BANDS:
+		default:
+			image2gb_read_image_bands(IimageID, IdrawableID, Pcontext, PdataTiles);
+			break;
 	}
-	
-	UItileCount = UItileCount - UIduplicateCount;
 }
 
-static GimpPDBStatusType
-image2gb_write_files(PluginExportOptions* PexportOptions)
+static void
+image2gb_read_image_bands(gint32 IimageID, gint32 IdrawableID, ExportContext* Pcontext, DataTile* PdataTiles)
 {
-	GimpPDBStatusType GreturnStatus = GIMP_PDB_SUCCESS; /**< Return value. */
-	FILE* FileOut = NULL; /**< File handler for writing output. */
-	gchar SfileName[PATH_MAX] = {0}; /**< Auxiliary string for composing the full file names. */
-	gchar SNameLowercase[IMAGE2GB_ASSET_NAME_MAX_LENGTH] = {0}; /**< Asset name, all lowercase. */
-	gchar SNameUppercase[IMAGE2GB_ASSET_NAME_MAX_LENGTH] = {0}; /**< Asset name, all UPPERCASE. */
+	GimpDrawable* Gdrawable = gimp_drawable_get(IdrawableID); /**< GIMP drawable object that represents the image. */
+	GimpPixelRgn Gregion = {0}; /**< GIMP pixel region for reading the image. */
+	guint UIimageWidth = (Pcontext->tileWidth * IMAGE2GB_TILE_SIZE); /**< Width of the image (and of every band), in pixels. */
+	guint UIbandRows = 0; /**< How many rows of tiles are read in a single transfer. */
+	guchar* PbandBuffer = NULL; /**< Buffer that stores the GIMP pixels of a whole band of tile rows. */
 	
-	// When writing the final .c source file, the values will be in hexadecimal.
-	// The Game Boy expects the asset data as unsigned chars (8-bit). Each tile
-	// row is 16-bit, so we have to take half and half and convert them to hex.
-	// 2 hex digits equal 8 bits (1 byte), so using the same example above:
-	//
-	//  [1 0 3 0 2 1 0 3] <=> [10100101 00101001] <=> [0xA5, 0x29] <=> 8 pixels
-	//
-	// Repeat this for the remaining 7 rows and you have a full tile, with 16
-	// byte values. Repeat for all tiles and you have the final image. Tiles
-	// marked as duplicate are ignored and not written. The tilemap is written
-	// as it is, also in hexadecimal.
+	// Initialize the pixel region for later use.
+	gimp_pixel_rgn_init(& Gregion, Gdrawable,
+	                    0, 0,
+	                    gimp_image_width(IimageID), gimp_image_height(IimageID),
+	                    FALSE, FALSE);
+	                    
+	// Getting the drawable and the size of the image.
+	Pcontext->stats.pdbCalls += 3;
 	
-	// Get the all upper and lowercase version of the asset name.
-	for (guint c = 0; c < strlen(PexportOptions->name); c++)
-		SNameLowercase[c] = tolower(PexportOptions->name[c]);
-		
-	for (guint c = 0; c < strlen(PexportOptions->name); c++)
-		SNameUppercase[c] = toupper(PexportOptions->name[c]);
-		
-	// First, write the .h header.
-	sprintf(SfileName, "%s/%s.h", PexportOptions->folder, SNameLowercase);
-	FileOut = fopen(SfileName, "w");
+	// Every call to gimp_pixel_rgn_get_rect() is a round trip to the GIMP core,
+	// so instead of asking for the tiles one by one, we read whole bands of
+	// tile rows at once (as many as fit in the buffer, usually the full image)
+	// and parse the tiles straight from there.
+	UIbandRows = (IMAGE2GB_READ_BUFFER_SIZE / (UIimageWidth * IMAGE2GB_TILE_SIZE));
+	UIbandRows = CLAMP(UIbandRows, 1, Pcontext->tileHeight);
 	
-	if (FileOut == NULL)
-	{
-		// Save error code before calling another function (may be overwritten).
-		gint Ierror = errno;
-		g_message("Could not open file %s, error code %d (%s).\n", SfileName, Ierror, strerror(Ierror));
-		
-		GreturnStatus = GIMP_PDB_EXECUTION_ERROR;
-		
-		return GreturnStatus;
-	}
+	PbandBuffer = g_new(guchar, (UIbandRows * IMAGE2GB_TILE_SIZE * UIimageWidth));
 	
-	// Check "source_strings.h" to see what we're printing here.
-	fprintf(FileOut, IMAGE2GB_SOURCE_STRING_H,
-	        SNameLowercase, PexportOptions->name,
-	        UItileCount, (UItileWidth * UItileHeight), UItileWidth, UItileHeight,
-	        (UItileWidth * IMAGE2GB_TILE_SIZE), (UItileHeight * IMAGE2GB_TILE_SIZE),
-	        PexportOptions->bank,
-	        (PexportOptions->bank == 0) ? "//" : "", // If bank = 0, line is commented out.
-	        (PexportOptions->bank == 0) ? "//" : "", SNameUppercase, // If bank = 0, line is commented out.
-	        SNameUppercase, UItileCount, SNameUppercase, UItileWidth, SNameUppercase, UItileHeight,
-	        PexportOptions->name, PexportOptions->name, PexportOptions->name, PexportOptions->name);
-	        
-	if (fclose(FileOut) != 0)
+	// Loop through all bands of the GIMP image.
+	for (guint band = 0; band < Pcontext->tileHeight; band += UIbandRows)
 	{
-		// Save error code before calling another function (may be overwritten).
-		gint Ierror = errno;
-		g_message("While trying to close file %s, got error code %d (%s).\n", SfileName, Ierror, strerror(Ierror));
+		guint UIrowCount = MIN(UIbandRows, (Pcontext->tileHeight - band)); /**< Rows of tiles in this band (the last one may be shorter). */
 		
-		GreturnStatus = GIMP_PDB_EXECUTION_ERROR;
+		gint64 ItimeStart = g_get_monotonic_time(); /**< When the stage being timed started. */
 		
-		return GreturnStatus;
-	}
-	
-	// Now, write the .c source.
-	memset(SfileName, 0, sizeof(SfileName));
-	sprintf(SfileName, "%s/%s.c", PexportOptions->folder, SNameLowercase);
-	FileOut = fopen(SfileName, "w");
-	
-	if (FileOut == NULL)
-	{
-		// Save error code before calling another function (may be overwritten).
-		gint Ierror = errno;
-		g_message("Could not open file %s, error code %d (%s).\n", SfileName, Ierror, strerror(Ierror));
+		// Get all the pixels of this band in one go.
+		gimp_pixel_rgn_get_rect(& Gregion, PbandBuffer,
+		                        0, IMAGE2GB_TILE_SIZE * band,
+		                        UIimageWidth, IMAGE2GB_TILE_SIZE * UIrowCount);
+		                        
+		Pcontext->stats.pixelTransfers++;
+		Pcontext->stats.bytesRead += (UIrowCount * IMAGE2GB_TILE_SIZE * UIimageWidth);
+		ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_READ, ItimeStart);
 		
-		GreturnStatus = GIMP_PDB_EXECUTION_ERROR;
+		// Parse and store all tiles of the band (in parallel if there are many).
+		// "array + n" gets the address of the nth element of the array.
+		image2gb_pack_tiles(PbandBuffer, UIimageWidth, Pcontext->tileWidth, UIrowCount, PdataTiles + (band * Pcontext->tileWidth));
 		
-		return GreturnStatus;
+		image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_PACK, ItimeStart);
 	}
 	
-	// Check "source_strings.h" to see what we're printing here.
-	fprintf(FileOut, IMAGE2GB_SOURCE_STRING_C_1,
-	        SNameLowercase, PexportOptions->name,
-	        UItileCount, (UItileWidth * UItileHeight), UItileWidth, UItileHeight,
-	        (UItileWidth * IMAGE2GB_TILE_SIZE), (UItileHeight * IMAGE2GB_TILE_SIZE),
-	        PexportOptions->bank,
-	        SNameLowercase,
-	        (PexportOptions->bank == 0) ? "//" : "", // If bank = 0, line is commented out.
-	        (PexportOptions->bank == 0) ? "//" : "", SNameUppercase, // If bank = 0, line is commented out.
-	        PexportOptions->name);
-	        
-	image2gb_write_tile_data(FileOut);
+	g_free(PbandBuffer);
+	gimp_drawable_detach(Gdrawable);
+	Pcontext->stats.pdbCalls++;
+}
+
+static void
+image2gb_read_image_native(gint32 IimageID, gint32 IdrawableID, ExportContext* Pcontext, DataTile* PdataTiles)
+{
+	GimpDrawable* Gdrawable = gimp_drawable_get(IdrawableID); /**< GIMP drawable object that represents the image. */
+	GimpPixelRgn Gregion = {0}; /**< GIMP pixel region for reading the image. */
+	gpointer Piterator = NULL; /**< GIMP iterator over the storage tiles of the region. */
+	guint UInativeTilesWide = 0; /**< How many GIMP storage tiles make up a row of the image. */
+	gint64 ItimeStart = 0; /**< When the stage being timed started. */
 	
-	fprintf(FileOut, IMAGE2GB_SOURCE_STRING_C_2, PexportOptions->name);
+	// GIMP stores the drawable in its own tiles (64x64 pixels). We walk them
+	// one by one and parse the Game Boy tiles (8x8) they contain straight from
+	// that memory, so no pixel is copied. The tile cache must hold at least a
+	// full row of storage tiles, otherwise large images would keep evicting and
+	// fetching them again.
+	UInativeTilesWide = (((Pcontext->tileWidth * IMAGE2GB_TILE_SIZE) + gimp_tile_width() - 1) / gimp_tile_width());
+	gimp_tile_cache_ntiles(2 * UInativeTilesWide);
+	Pcontext->stats.pdbCalls += 3;
 	
-	image2gb_write_tilemap(FileOut);
+	// Initialize the pixel region for later use.
+	gimp_pixel_rgn_init(& Gregion, Gdrawable,
+	                    0, 0,
+	                    gimp_image_width(IimageID), gimp_image_height(IimageID),
+	                    FALSE, FALSE);
+	                    
+	// Getting the drawable and the size of the image.
+	Pcontext->stats.pdbCalls += 3;
 	
-	fprintf(FileOut, "\n};");
+	// Every iteration gives us one storage tile (the ones at the right and
+	// bottom borders may be smaller, but always whole Game Boy tiles). Getting
+	// the next one counts as reading, parsing its Game Boy tiles as packing.
+	ItimeStart = g_get_monotonic_time();
 	
-	if (fclose(FileOut) != 0)
+	for (Piterator = gimp_pixel_rgns_register(1, & Gregion);
+	     Piterator != NULL;
+	     Piterator = gimp_pixel_rgns_process(Piterator))
 	{
-		// Save error code before calling another function (may be overwritten).
-		gint Ierror = errno;
-		g_message("While trying to close file %s, got error code %d (%s).\n", SfileName, Ierror, strerror(Ierror));
+		Pcontext->stats.pixelTransfers++;
+		Pcontext->stats.bytesRead += (Gregion.w * Gregion.h * Gregion.bpp);
+		ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_READ, ItimeStart);
 		
-		GreturnStatus = GIMP_PDB_EXECUTION_ERROR;
+		for (gint y = 0; y < Gregion.h; y += IMAGE2GB_TILE_SIZE)
+		{
+			for (gint x = 0; x < Gregion.w; x += IMAGE2GB_TILE_SIZE)
+			{
+				// Position of this Game Boy tile in the whole image.
+				guint UItileRow = ((Gregion.y + y) / IMAGE2GB_TILE_SIZE);
+				guint UItileCol = ((Gregion.x + x) / IMAGE2GB_TILE_SIZE);
+				
+				image2gb_read_tile(Gregion.data + ((y * Gregion.rowstride) + (x * Gregion.bpp)),
+				                   Gregion.rowstride,
+				                   PdataTiles + ((UItileRow * Pcontext->tileWidth) + UItileCol));
+			}
+		}
 		
-		return GreturnStatus;
+		ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_PACK, ItimeStart);
 	}
 	
-	return GreturnStatus;
+	// The last call to gimp_pixel_rgns_process() (the one that ends the loop).
+	image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_READ, ItimeStart);
+	
+	gimp_drawable_detach(Gdrawable);
+	Pcontext->stats.pdbCalls++;
 }
 
 static void
-image2gb_write_tile_data(FILE* FileOut)
+image2gb_read_image_gegl(gint32 IimageID, gint32 IdrawableID, ExportContext* Pcontext, DataTile* PdataTiles)
 {
-	guint UIprintCount = 0; /**< Auxiliary variable to keep track of how many tiles we have written. */
+	GeglBuffer* Gbuffer = gimp_drawable_get_buffer(IdrawableID); /**< GEGL buffer that holds the pixels of the drawable. */
+	const Babl* Gformat = gimp_drawable_get_format(IdrawableID); /**< Native format of the drawable (palette indices, 1 byte each). */
+	guint UIimageWidth = (Pcontext->tileWidth * IMAGE2GB_TILE_SIZE); /**< Width of the image (and of every band), in pixels. */
+	guint UIbandRows = 0; /**< How many rows of tiles are read in a single transfer. */
+	guchar* PbandBuffer = NULL; /**< Buffer that stores the GIMP pixels of a whole band of tile rows. */
+	
+	// Getting the buffer and its format.
+	Pcontext->stats.pdbCalls += 2;
 	
-	// Print one tile per line.
-	for (guint tile = 0; tile < (UItileWidth * UItileHeight); tile++)
+	// Same approach as image2gb_read_image_bands(), but through GEGL, which is
+	// the API GIMP itself uses (GimpPixelRgn is deprecated). Reading with the
+	// drawable's own indexed format gives us the raw color indices, and the
+	// rowstride is exactly one image line, so tiles start every 8 bytes.
+	UIbandRows = (IMAGE2GB_READ_BUFFER_SIZE / (UIimageWidth * IMAGE2GB_TILE_SIZE));
+	UIbandRows = CLAMP(UIbandRows, 1, Pcontext->tileHeight);
+	
+	PbandBuffer = g_new(guchar, (UIbandRows * IMAGE2GB_TILE_SIZE * UIimageWidth));
+	
+	// Loop through all bands of the GIMP image.
+	for (guint band = 0; band < Pcontext->tileHeight; band += UIbandRows)
 	{
-		// Ignore duplicate tiles.
-		if (ArrayDataTiles[tile].duplicate == TRUE)
-			continue;
-			
-		UIprintCount++;
+		guint UIrowCount = MIN(UIbandRows, (Pcontext->tileHeight - band)); /**< Rows of tiles in this band (the last one may be shorter). */
 		
-		// We do not check for success, we take for granted we can write OK.
-		fprintf(FileOut, "\t");
+		gint64 ItimeStart = g_get_monotonic_time(); /**< When the stage being timed started. */
 		
-		// There are 8 rows, each row is 2 hex numbers, so 16 per line in total.
-		for (guchar row = 0; row < IMAGE2GB_TILE_SIZE; row++)
-		{
-			// Shift right by 8 bits to write only the first half.
-			fprintf(FileOut, "0x%02X, ", ((ArrayDataTiles[tile].row[row]) >> 8));
-			// Mask against 00000000 11111111 to write only the second half.
-			fprintf(FileOut, "0x%02X", ((ArrayDataTiles[tile].row[row]) & 0xFF));
-			
-			// Do not write a comma after the last char of this tile.
-			if (row != (IMAGE2GB_TILE_SIZE - 1))
-				fprintf(FileOut, ", ");
-		}
+		// Get all the pixels of this band in one go.
+		gegl_buffer_get(Gbuffer,
+		                GEGL_RECTANGLE(0, IMAGE2GB_TILE_SIZE * band, UIimageWidth, IMAGE2GB_TILE_SIZE * UIrowCount),
+		                1.0, Gformat, PbandBuffer, UIimageWidth, GEGL_ABYSS_NONE);
+		                
+		Pcontext->stats.pixelTransfers++;
+		Pcontext->stats.bytesRead += (UIrowCount * IMAGE2GB_TILE_SIZE * UIimageWidth);
+		ItimeStart = image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_READ, ItimeStart);
 		
-		// Do not write a comma after the last tile.
-		if (UIprintCount < UItileCount)
-			fprintf(FileOut, ",\n");
-		else
-			fprintf(FileOut, "\n");
-	}
-}
-
-static void
-image2gb_write_tilemap(FILE* FileOut)
-{
-	// We do not check for success, we take for granted we can write OK.
-	fprintf(FileOut, "\t");
-	
-	for (guint tile = 0; tile < (UItileWidth * UItileHeight); tile++)
-	{
-		fprintf(FileOut, "0x%02X", ArrayTileMap[tile]);
+		// Parse and store all tiles of the band (in parallel if there are many).
+		// "array + n" gets the address of the nth element of the array.
+		image2gb_pack_tiles(PbandBuffer, UIimageWidth, Pcontext->tileWidth, UIrowCount, PdataTiles + (band * Pcontext->tileWidth));
 		
-		// If this is not the last tile of the map, print a separator.
-		if (tile != ((UItileWidth * UItileHeight) - 1))
-		{
-			// Print lines of "width" tiles maximum (so the output code has as
-			// many rows and columns as the image).
-			if (((tile + 1) % UItileWidth) == 0)
-				fprintf(FileOut, ",\n\t");
-			else
-				fprintf(FileOut, ", ");
-		}
+		image2gb_trace_stage(& Pcontext->stats, IMAGE2GB_STAGE_PACK, ItimeStart);
 	}
+	
+	g_free(PbandBuffer);
+	g_object_unref(Gbuffer);
 }
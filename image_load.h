@@ -0,0 +1,431 @@
+/**
+ * @file  image_load.h
+ * @brief Loading of indexed images from PNG, BMP and PGM files, without GIMP - header + implementation.
+ */
+
+#pragma once
+
+#include "image_convert.h" // For the image size limits.
+
+// Ignore warnings in external libraries (GLib, libpng...).
+#pragma GCC system_header
+#include <glib.h>
+#include <png.h>
+#include <stdint.h>
+#include <string.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_COLOR_MAX 3 /**< Highest color index of a Game Boy pixel (0 is the lightest, 3 the darkest). */
+
+#define IMAGE2GB_BMP_HEADER_SIZE 54 /**< Size of the BMP file header plus the smallest supported info header (BITMAPINFOHEADER). */
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** Object that stores an image loaded from a file: one byte per pixel, its
+ *  color index (or gray level converted to one), lines one after the other.
+ */
+typedef struct IndexedImage
+{
+	guint width; /**< Width of the image, in pixels (also the rowstride). */
+	guint height; /**< Height of the image, in pixels. */
+	guchar* pixels; /**< Color index of every pixel. */
+} IndexedImage;
+
+/** Object that lets libpng read a PNG file that is already in memory.
+ */
+typedef struct PngSource
+{
+	const guchar* data; /**< Contents of the file. */
+	gsize size; /**< Size of the file, in bytes. */
+	gsize offset; /**< Bytes already given to libpng. */
+	const gchar* name; /**< Name of the file, for error messages. */
+} PngSource;
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Loads the given image file (PNG, BMP or PGM, told apart by their contents)
+ *  into Pimage, counting the bytes read in Pstats. Returns TRUE if success,
+ *  FALSE otherwise (the error is reported).
+ */
+static gboolean
+image2gb_load_image(const gchar* SfileName, IndexedImage* Pimage, ExportStats* Pstats);
+
+/** Frees the pixels of the image.
+ */
+static void
+image2gb_free_image(IndexedImage* Pimage);
+
+/** Checks the size of an image about to be loaded, and allocates its pixels.
+ *  Returns TRUE if success, FALSE otherwise (the error is reported).
+ */
+static gboolean
+image2gb_alloc_image(IndexedImage* Pimage, gint64 Iwidth, gint64 Iheight, const gchar* SfileName);
+
+/** Returns the color index of the given gray level (white is the lightest
+ *  color, black the darkest), UImaxval being white.
+ */
+static guchar
+image2gb_gray_to_index(guint UIgray, guint UImaxval);
+
+/** Loads an indexed (palette) or grayscale PNG file, of any bit depth.
+ */
+static gboolean
+image2gb_load_png(const guchar* Pdata, gsize UIsize, const gchar* SfileName, IndexedImage* Pimage);
+
+/** Callback for libpng, gives it the next bytes of a PngSource.
+ */
+static void
+image2gb_png_read(png_structp Ppng, png_bytep Pbytes, png_size_t UIlength);
+
+/** Callback for libpng, reports an error and jumps back to image2gb_load_png().
+ */
+static void
+image2gb_png_error(png_structp Ppng, png_const_charp Smessage);
+
+/** Callback for libpng, ignores its warnings (they are not worth bothering).
+ */
+static void
+image2gb_png_warning(png_structp Ppng, png_const_charp Smessage);
+
+/** Loads an indexed (1, 4 or 8 bits per pixel) uncompressed BMP file.
+ */
+static gboolean
+image2gb_load_bmp(const guchar* Pdata, gsize UIsize, const gchar* SfileName, IndexedImage* Pimage);
+
+/** Loads a binary (P5) PGM file.
+ */
+static gboolean
+image2gb_load_pgm(const guchar* Pdata, gsize UIsize, const gchar* SfileName, IndexedImage* Pimage);
+
+/** Parses the next number of a PGM header (skipping blanks and comments) at
+ *  *PUIoffset, and advances it. Returns -1 if there is none.
+ */
+static gint64
+image2gb_pgm_number(const guchar* Pdata, gsize UIsize, gsize* PUIoffset);
+
+////////////////////////////////////////////////////////////////////////////////
+
+static gboolean
+image2gb_load_image(const gchar* SfileName, IndexedImage* Pimage, ExportStats* Pstats)
+{
+	gchar* Pdata = NULL; /**< Contents of the file. */
+	gsize UIsize = 0; /**< Size of the file, in bytes. */
+	GError* Gerror = NULL; /**< Error reading the file, if any. */
+	gboolean Bsuccess = FALSE; /**< Return value. */
+	
+	memset(Pimage, 0, sizeof(IndexedImage));
+	
+	if (! g_file_get_contents(SfileName, & Pdata, & UIsize, & Gerror))
+	{
+		g_message("Could not read %s (%s).\n", SfileName, Gerror->message);
+		
+		g_clear_error(& Gerror);
+		
+		return FALSE;
+	}
+	
+	Pstats->bytesRead += UIsize;
+	
+	// Tell the formats apart by their signatures, not by the file extension.
+	if ((UIsize >= 8) && (png_sig_cmp((png_const_bytep) Pdata, 0, 8) == 0))
+		Bsuccess = image2gb_load_png((const guchar*) Pdata, UIsize, SfileName, Pimage);
+	else if ((UIsize >= 2) && (Pdata[0] == 'B') && (Pdata[1] == 'M'))
+		Bsuccess = image2gb_load_bmp((const guchar*) Pdata, UIsize, SfileName, Pimage);
+	else if ((UIsize >= 2) && (Pdata[0] == 'P') && (Pdata[1] == '5'))
+		Bsuccess = image2gb_load_pgm((const guchar*) Pdata, UIsize, SfileName, Pimage);
+	else
+		g_message("%s is not a PNG, BMP or binary PGM (P5) image.\n", SfileName);
+		
+	g_free(Pdata);
+	
+	if (! Bsuccess)
+		image2gb_free_image(Pimage);
+		
+	return Bsuccess;
+}
+
+static void
+image2gb_free_image(IndexedImage* Pimage)
+{
+	g_free(Pimage->pixels);
+	
+	Pimage->pixels = NULL;
+	Pimage->width = 0;
+	Pimage->height = 0;
+}
+
+static gboolean
+image2gb_alloc_image(IndexedImage* Pimage, gint64 Iwidth, gint64 Iheight, const gchar* SfileName)
+{
+	// Anything bigger could never be exported, so do not even try to allocate
+	// it (the rest of the checks are left to the caller).
+	if ((Iwidth <= 0) || (Iwidth > IMAGE2GB_IMAGE_SIZE_MAX) || (Iheight <= 0) || (Iheight > IMAGE2GB_IMAGE_SIZE_MAX))
+	{
+		g_message("%s: image size should be between 1x1 and %dx%d pixels.\n",
+		          SfileName, IMAGE2GB_IMAGE_SIZE_MAX, IMAGE2GB_IMAGE_SIZE_MAX);
+		          
+		return FALSE;
+	}
+	
+	Pimage->width = Iwidth;
+	Pimage->height = Iheight;
+	Pimage->pixels = g_new0(guchar, ((gsize) Pimage->width * Pimage->height));
+	
+	return TRUE;
+}
+
+static guchar
+image2gb_gray_to_index(guint UIgray, guint UImaxval)
+{
+	// Rounded to the nearest of the 4 levels, inverted (color 0 is white).
+	return ((((UImaxval - MIN(UIgray, UImaxval)) * IMAGE2GB_COLOR_MAX) + (UImaxval / 2)) / UImaxval);
+}
+
+static gboolean
+image2gb_load_png(const guchar* Pdata, gsize UIsize, const gchar* SfileName, IndexedImage* Pimage)
+{
+	PngSource StructSource = {Pdata, UIsize, 0, SfileName}; /**< Where libpng reads from. */
+	png_structp Ppng = NULL; /**< libpng reader. */
+	png_infop Pinfo = NULL; /**< Information of the PNG file. */
+	png_bytep* volatile ProwPointers = NULL; /**< Where libpng stores every line of the image (volatile, as it changes after setjmp()). */
+	png_uint_32 UIwidth = 0; /**< Width of the image, in pixels. */
+	png_uint_32 UIheight = 0; /**< Height of the image, in pixels. */
+	gint IbitDepth = 0; /**< Bits per pixel, as stored in the file. */
+	gint IcolorType = 0; /**< Palette, gray, RGB... */
+	
+	Ppng = png_create_read_struct(PNG_LIBPNG_VER_STRING, & StructSource, image2gb_png_error, image2gb_png_warning);
+	
+	if (Ppng == NULL)
+		return FALSE;
+		
+	Pinfo = png_create_info_struct(Ppng);
+	
+	if (Pinfo == NULL)
+	{
+		png_destroy_read_struct(& Ppng, NULL, NULL);
+		
+		return FALSE;
+	}
+	
+	// After reporting errors, libpng jumps back here. Only Pimage->pixels and
+	// the row pointers are allocated in the meantime (the caller frees the
+	// pixels).
+	if (setjmp(png_jmpbuf(Ppng)))
+	{
+		g_free(ProwPointers);
+		png_destroy_read_struct(& Ppng, & Pinfo, NULL);
+		
+		return FALSE;
+	}
+	
+	png_set_read_fn(Ppng, & StructSource, image2gb_png_read);
+	png_read_info(Ppng, Pinfo);
+	png_get_IHDR(Ppng, Pinfo, & UIwidth, & UIheight, & IbitDepth, & IcolorType, NULL, NULL, NULL);
+	
+	// Only indexed and grayscale images have a meaning as Game Boy colors.
+	if ((IcolorType != PNG_COLOR_TYPE_PALETTE) && (IcolorType != PNG_COLOR_TYPE_GRAY))
+	{
+		g_message("%s: the PNG image should be indexed (or grayscale), without transparency.\n", SfileName);
+		
+		png_destroy_read_struct(& Ppng, & Pinfo, NULL);
+		
+		return FALSE;
+	}
+	
+	// One byte per pixel whatever the bit depth, and whole images even if
+	// they are interlaced.
+	png_set_packing(Ppng);
+	png_set_strip_16(Ppng);
+	png_set_interlace_handling(Ppng);
+	png_read_update_info(Ppng, Pinfo);
+	
+	if (! image2gb_alloc_image(Pimage, UIwidth, UIheight, SfileName))
+	{
+		png_destroy_read_struct(& Ppng, & Pinfo, NULL);
+		
+		return FALSE;
+	}
+	
+	ProwPointers = g_new(png_bytep, Pimage->height);
+	
+	for (guint y = 0; y < Pimage->height; y++)
+		ProwPointers[y] = Pimage->pixels + ((gsize) y * Pimage->width);
+		
+	png_read_image(Ppng, ProwPointers);
+	png_read_end(Ppng, NULL);
+	
+	// Palette indices are used as they are, gray levels are converted.
+	if (IcolorType == PNG_COLOR_TYPE_GRAY)
+	{
+		guint UImaxval = ((1u << MIN(IbitDepth, 8)) - 1); /**< Value of white. */
+		
+		for (gsize p = 0; p < ((gsize) Pimage->width * Pimage->height); p++)
+			Pimage->pixels[p] = image2gb_gray_to_index(Pimage->pixels[p], UImaxval);
+	}
+	
+	g_free(ProwPointers);
+	png_destroy_read_struct(& Ppng, & Pinfo, NULL);
+	
+	return TRUE;
+}
+
+static void
+image2gb_png_read(png_structp Ppng, png_bytep Pbytes, png_size_t UIlength)
+{
+	PngSource* Psource = png_get_io_ptr(Ppng); /**< Where the bytes come from. */
+	
+	if (UIlength > (Psource->size - Psource->offset))
+		png_error(Ppng, "unexpected end of file");
+		
+	memcpy(Pbytes, Psource->data + Psource->offset, UIlength);
+	Psource->offset += UIlength;
+}
+
+static void
+image2gb_png_error(png_structp Ppng, png_const_charp Smessage)
+{
+	PngSource* Psource = png_get_error_ptr(Ppng); /**< File being read. */
+	
+	g_message("%s: the PNG file is damaged (%s).\n", Psource->name, Smessage);
+	
+	png_longjmp(Ppng, 1);
+}
+
+static void
+image2gb_png_warning(png_structp Ppng, png_const_charp Smessage)
+{
+}
+
+static gboolean
+image2gb_load_bmp(const guchar* Pdata, gsize UIsize, const gchar* SfileName, IndexedImage* Pimage)
+{
+	guint32 UIpixelOffset = 0; /**< Where the pixel data starts in the file. */
+	gint32 Iwidth = 0; /**< Width of the image, in pixels. */
+	gint32 Iheight = 0; /**< Height of the image, in pixels (negative if stored top-down). */
+	guint UIbitCount = 0; /**< Bits per pixel. */
+	guint32 UIcompression = 0; /**< Compression method (only 0, none, is supported). */
+	gsize UIlineSize = 0; /**< Bytes of every line in the file (padded to 4). */
+	
+	if (UIsize < IMAGE2GB_BMP_HEADER_SIZE)
+	{
+		g_message("%s: the BMP file is damaged.\n", SfileName);
+		
+		return FALSE;
+	}
+	
+	// All fields are little-endian, at fixed positions of the headers.
+	UIpixelOffset = (Pdata[10] | (Pdata[11] << 8) | (Pdata[12] << 16) | ((guint32) Pdata[13] << 24));
+	Iwidth = (gint32)(Pdata[18] | (Pdata[19] << 8) | (Pdata[20] << 16) | ((guint32) Pdata[21] << 24));
+	Iheight = (gint32)(Pdata[22] | (Pdata[23] << 8) | (Pdata[24] << 16) | ((guint32) Pdata[25] << 24));
+	UIbitCount = (Pdata[28] | (Pdata[29] << 8));
+	UIcompression = (Pdata[30] | (Pdata[31] << 8) | (Pdata[32] << 16) | ((guint32) Pdata[33] << 24));
+	
+	if (((UIbitCount != 1) && (UIbitCount != 4) && (UIbitCount != 8)) || (UIcompression != 0))
+	{
+		g_message("%s: the BMP image should be indexed (1, 4 or 8 bits per pixel) and uncompressed.\n", SfileName);
+		
+		return FALSE;
+	}
+	
+	if (! image2gb_alloc_image(Pimage, Iwidth, ABS((gint64) Iheight), SfileName))
+		return FALSE;
+		
+	UIlineSize = (((((gsize) Pimage->width * UIbitCount) + 31) / 32) * 4);
+	
+	if ((UIpixelOffset > UIsize) || (((UIsize - UIpixelOffset) / UIlineSize) < Pimage->height))
+	{
+		g_message("%s: the BMP file is damaged.\n", SfileName);
+		
+		return FALSE;
+	}
+	
+	for (guint y = 0; y < Pimage->height; y++)
+	{
+		// Lines are stored bottom-up, unless the height is negative.
+		const guchar* Pline = Pdata + UIpixelOffset + (UIlineSize * ((Iheight > 0) ? (Pimage->height - 1 - y) : y)); /**< Line of the file. */
+		guchar* Ppixels = Pimage->pixels + ((gsize) y * Pimage->width); /**< Line of the image. */
+		
+		// Pixels smaller than a byte start from its most significant bits.
+		for (guint x = 0; x < Pimage->width; x++)
+		{
+			guint UIbit = (x * UIbitCount); /**< Position of the pixel in the line, in bits. */
+			
+			Ppixels[x] = ((Pline[UIbit / 8] >> (8 - UIbitCount - (UIbit % 8))) & ((1u << UIbitCount) - 1));
+		}
+	}
+	
+	return TRUE;
+}
+
+static gboolean
+image2gb_load_pgm(const guchar* Pdata, gsize UIsize, const gchar* SfileName, IndexedImage* Pimage)
+{
+	gsize UIoffset = 2; /**< Current position in the file (after "P5"). */
+	gint64 Iwidth = image2gb_pgm_number(Pdata, UIsize, & UIoffset); /**< Width of the image, in pixels. */
+	gint64 Iheight = image2gb_pgm_number(Pdata, UIsize, & UIoffset); /**< Height of the image, in pixels. */
+	gint64 Imaxval = image2gb_pgm_number(Pdata, UIsize, & UIoffset); /**< Value of white. */
+	guint UIbytes = (Imaxval > 255) ? 2 : 1; /**< Bytes per pixel. */
+	
+	// A single blank separates the header from the pixels.
+	if ((Iwidth < 0) || (Iheight < 0) || (Imaxval <= 0) || (Imaxval > 65535) || (UIoffset >= UIsize))
+	{
+		g_message("%s: the PGM file is damaged.\n", SfileName);
+		
+		return FALSE;
+	}
+	
+	UIoffset++;
+	
+	if (! image2gb_alloc_image(Pimage, Iwidth, Iheight, SfileName))
+		return FALSE;
+		
+	if (((UIsize - UIoffset) / UIbytes / Pimage->width) < Pimage->height)
+	{
+		g_message("%s: the PGM file is damaged.\n", SfileName);
+		
+		return FALSE;
+	}
+	
+	// Pixels are gray levels, 16-bit ones are big-endian.
+	for (gsize p = 0; p < ((gsize) Pimage->width * Pimage->height); p++)
+	{
+		const guchar* Ppixel = Pdata + UIoffset + (p * UIbytes); /**< Pixel in the file. */
+		
+		Pimage->pixels[p] = image2gb_gray_to_index((UIbytes == 2) ? ((Ppixel[0] << 8) | Ppixel[1]) : Ppixel[0], Imaxval);
+	}
+	
+	return TRUE;
+}
+
+static gint64
+image2gb_pgm_number(const guchar* Pdata, gsize UIsize, gsize* PUIoffset)
+{
+	gint64 Inumber = 0; /**< Return value. */
+	
+	// Skip blanks, and comments until the end of their line.
+	while (* PUIoffset < UIsize)
+	{
+		if (Pdata[* PUIoffset] == '#')
+		{
+			while ((* PUIoffset < UIsize) && (Pdata[* PUIoffset] != '\n'))
+				(* PUIoffset)++;
+		}
+		else if (g_ascii_isspace(Pdata[* PUIoffset]))
+			(* PUIoffset)++;
+		else
+			break;
+	}
+	
+	if ((* PUIoffset >= UIsize) || (! g_ascii_isdigit(Pdata[* PUIoffset])))
+		return -1;
+		
+	// Anything with more digits than this is not a valid size anyway.
+	while ((* PUIoffset < UIsize) && g_ascii_isdigit(Pdata[* PUIoffset]) && (Inumber <= G_MAXINT32))
+	{
+		Inumber = ((Inumber * 10) + (Pdata[* PUIoffset] - '0'));
+		(* PUIoffset)++;
+	}
+	
+	return Inumber;
+}
@@ -0,0 +1,187 @@
+/**
+ * @file  image_trace.h
+ * @brief Timing and counters of the export pipeline, for finding out where the time goes - header + implementation.
+ */
+
+#pragma once
+
+// Ignore warnings in external libraries (GIMP, GTK...).
+#pragma GCC system_header
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// CONSTANTS ///////////////////////////////////////////////////////////////////
+
+#define IMAGE2GB_TRACE_VARIABLE "IMAGE2GB_TRACE" /**< Environment variable that enables the report (see image2gb_trace_report()). */
+
+// DEFINITIONS /////////////////////////////////////////////////////////////////
+
+/** Stages of the export pipeline that are timed.
+ */
+typedef enum ExportStage
+{
+	IMAGE2GB_STAGE_READ = 0,     /**< Getting the pixels from GIMP. */
+	IMAGE2GB_STAGE_PACK,         /**< Converting pixels to Game Boy tiles. */
+	IMAGE2GB_STAGE_DEDUPE,       /**< Finding duplicate tiles and building the tilemap. */
+	IMAGE2GB_STAGE_WRITE_HEADER, /**< Writing the .h file. */
+	IMAGE2GB_STAGE_WRITE_SOURCE, /**< Writing the .c file (or the binary files). */
+	IMAGE2GB_STAGE_CACHE,        /**< Computing the cache key, and copying the output from or to the cache. */
+	IMAGE2GB_STAGE_COMPRESS,     /**< Compressing the tile data and the tilemap (if the asset is compressed). */
+	IMAGE2GB_STAGE_COUNT         /**< Number of stages (not a stage). */
+} ExportStage;
+
+/** Object that stores the timing and counters of an export.
+ */
+typedef struct ExportStats
+{
+	gint64 start; /**< Monotonic time when the export started, in microseconds. */
+	gint64 end; /**< Monotonic time when the export finished, in microseconds. */
+	gint64 stageFirst[IMAGE2GB_STAGE_COUNT]; /**< Monotonic time when each stage was first entered (0 = never). */
+	gint64 stageTime[IMAGE2GB_STAGE_COUNT]; /**< Total time spent in each stage, in microseconds. */
+	guint64 pdbCalls; /**< Other calls to the GIMP core (image and drawable queries, parasites...), up to the report. */
+	guint64 pixelTransfers; /**< Pixel transfers from the GIMP core (bands, storage tiles or whole images read). */
+	guint64 bytesRead; /**< Bytes of pixels read from GIMP. */
+	guint64 bytesWritten; /**< Bytes written to the output files. */
+} ExportStats;
+
+// VARIABLES ///////////////////////////////////////////////////////////////////
+
+/** Names of the stages, as they appear in the report.
+ */
+static const gchar* const ArrayStageNames[IMAGE2GB_STAGE_COUNT] = {"read", "pack", "dedupe", "write header", "write source", "cache", "compress"};
+
+/** Serializes the writes to the trace file, exports running in parallel
+ *  append to the same one.
+ */
+G_LOCK_DEFINE_STATIC(trace_file);
+
+// FUNCTIONS ///////////////////////////////////////////////////////////////////
+
+/** Clears the statistics and marks the start of an export.
+ */
+static void
+image2gb_trace_reset(ExportStats* Pstats);
+
+/** Adds the time elapsed since ItimeStart (from g_get_monotonic_time()) to the
+ *  given stage. Returns the current time, so consecutive stages can be chained.
+ */
+static gint64
+image2gb_trace_stage(ExportStats* Pstats, ExportStage Estage, gint64 ItimeStart);
+
+/** Marks the end of the export and, if the IMAGE2GB_TRACE environment variable
+ *  is set, reports the statistics: through g_message() if its value is "1",
+ *  otherwise appended to the file it names (in Chrome trace event format if the
+ *  name ends in ".json", as plain text otherwise).
+ */
+static void
+image2gb_trace_report(ExportStats* Pstats, const gchar* SassetName);
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void
+image2gb_trace_reset(ExportStats* Pstats)
+{
+	memset(Pstats, 0, sizeof(ExportStats));
+	
+	Pstats->start = g_get_monotonic_time();
+}
+
+static gint64
+image2gb_trace_stage(ExportStats* Pstats, ExportStage Estage, gint64 ItimeStart)
+{
+	gint64 ItimeNow = g_get_monotonic_time(); /**< Return value. */
+	
+	if (Pstats->stageFirst[Estage] == 0)
+		Pstats->stageFirst[Estage] = ItimeStart;
+		
+	Pstats->stageTime[Estage] += (ItimeNow - ItimeStart);
+	
+	return ItimeNow;
+}
+
+static void
+image2gb_trace_report(ExportStats* Pstats, const gchar* SassetName)
+{
+	const gchar* Starget = g_getenv(IMAGE2GB_TRACE_VARIABLE); /**< Where to send the report. */
+	GString* Sreport = NULL; /**< Text of the report. */
+	FILE* FileLog = NULL; /**< Log file, if any. */
+	
+	Pstats->end = g_get_monotonic_time();
+	
+	if ((Starget == NULL) || (Starget[0] == '\0'))
+		return;
+		
+	Sreport = g_string_new(NULL);
+	
+	if (g_str_has_suffix(Starget, ".json"))
+	{
+		// Chrome trace event format (load it in chrome://tracing or Perfetto).
+		// One complete event for the whole export, one per stage (stages that
+		// are interleaved, like read and pack, show their total time starting
+		// when they were first entered), and the counters. The array is never
+		// closed, which the format allows, so events can just be appended.
+		gint Ipid = getpid(); /**< Tells apart the runs of the plugin (or of the command line tool). */
+		
+		g_string_append_printf(Sreport, "{\"name\": \"export %s\", \"ph\": \"X\", \"pid\": %d, \"tid\": 1, "
+		                       "\"ts\": %" G_GINT64_FORMAT ", \"dur\": %" G_GINT64_FORMAT "},\n",
+		                       SassetName, Ipid, Pstats->start, (Pstats->end - Pstats->start));
+		                       
+		for (guint stage = 0; stage < IMAGE2GB_STAGE_COUNT; stage++)
+		{
+			if (Pstats->stageFirst[stage] == 0)
+				continue;
+				
+			g_string_append_printf(Sreport, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %u, "
+			                       "\"ts\": %" G_GINT64_FORMAT ", \"dur\": %" G_GINT64_FORMAT "},\n",
+			                       ArrayStageNames[stage], Ipid, (stage + 2),
+			                       Pstats->stageFirst[stage], Pstats->stageTime[stage]);
+		}
+		
+		g_string_append_printf(Sreport, "{\"name\": \"counters %s\", \"ph\": \"C\", \"pid\": %d, \"ts\": %" G_GINT64_FORMAT ", "
+		                       "\"args\": {\"pdb calls\": %" G_GUINT64_FORMAT ", \"pixel transfers\": %" G_GUINT64_FORMAT ", "
+		                       "\"bytes read\": %" G_GUINT64_FORMAT ", \"bytes written\": %" G_GUINT64_FORMAT "}},\n",
+		                       SassetName, Ipid, Pstats->end,
+		                       Pstats->pdbCalls, Pstats->pixelTransfers, Pstats->bytesRead, Pstats->bytesWritten);
+	}
+	else
+	{
+		g_string_append_printf(Sreport, "Image2GB export of %s: %.3f ms total,",
+		                       SassetName, ((Pstats->end - Pstats->start) / 1000.0));
+		                       
+		for (guint stage = 0; stage < IMAGE2GB_STAGE_COUNT; stage++)
+			g_string_append_printf(Sreport, " %s %.3f ms,", ArrayStageNames[stage], (Pstats->stageTime[stage] / 1000.0));
+			
+		g_string_append_printf(Sreport, " %" G_GUINT64_FORMAT " PDB calls, %" G_GUINT64_FORMAT " pixel transfers, "
+		                       "%" G_GUINT64_FORMAT " bytes read, %" G_GUINT64_FORMAT " bytes written.\n",
+		                       Pstats->pdbCalls, Pstats->pixelTransfers, Pstats->bytesRead, Pstats->bytesWritten);
+	}
+	
+	if (strcmp(Starget, "1") == 0)
+		g_message("%s", Sreport->str);
+	else
+	{
+		G_LOCK(trace_file);
+		
+		FileLog = fopen(Starget, "a");
+		
+		if (FileLog != NULL)
+		{
+			// A new trace file must start by opening the array of events.
+			fseek(FileLog, 0, SEEK_END);
+			
+			if (g_str_has_suffix(Starget, ".json") && (ftell(FileLog) == 0))
+				fputs("[\n", FileLog);
+				
+			fputs(Sreport->str, FileLog);
+			fclose(FileLog);
+		}
+		else
+			g_message("Could not open trace file %s.\n", Starget);
+			
+		G_UNLOCK(trace_file);
+	}
+	
+	g_string_free(Sreport, TRUE);
+}
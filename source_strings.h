@@ -20,7 +20,7 @@
  * Size (tiles)  : %ux%u\n\
  * Size (pixels) : %ux%u\n\
  * Bank          : %u\n\
- */\n\
+%s */\n\
 \n\
 #pragma once\n\
 \n\
@@ -31,17 +31,18 @@
 // CONSTANTS ///////////////////////////////////////////////////////////////////\n\
 \n\
 #define GAME_BACKGROUNDS_%s_TILES %uU /**< How many unique tiles this background has. */\n\
+#define GAME_BACKGROUNDS_%s_TILE_BASE %uU /**< First VRAM tile slot the tiles must be loaded at (the map already counts from it). */\n\
 \n\
 #define GAME_BACKGROUNDS_%s_SIZE_X %uU /**< Width of this background, in 8x8 tiles. */\n\
 #define GAME_BACKGROUNDS_%s_SIZE_Y %uU /**< Height of this background, in 8x8 tiles. */\n\
 \n\
-/** %s (data), exported by Image2GB for use with GBDK-2020.\n\
+%s/** %s (data), exported by Image2GB for use with GBDK-2020.\n\
  */\n\
 extern const unsigned char BackgroundData%s[];\n\
 \n\
 /** %s (map), exported by Image2GB for use with GBDK-2020.\n\
  */\n\
-extern const unsigned char BackgroundMap%s[];\n"
+extern const %s BackgroundMap%s[];\n"
 
 /** String that stores part 1 of a premade .c source of a GBDK-2020 image asset,
  *  filled with format specifiers, ready to get sent to printf.
@@ -73,7 +74,203 @@ const unsigned char BackgroundData%s[] =\n\
  */
 #define IMAGE2GB_SOURCE_STRING_C_2 "};\n\
 \n\
-const unsigned char BackgroundMap%s[] =\n\
+const %s BackgroundMap%s[] =\n\
 {\n"
 
+/** String that stores a premade .h header of a GBDK-2020 image asset exported
+ *  in binary format (.2bpp and .tilemap files), filled with format specifiers,
+ *  ready to get sent to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_H_BINARY "/**\n\
+ * @file  %s.h\n\
+ * @brief %s, exported by Image2GB for use with GBDK-2020 - header (binary data).\n\
+ *\n\
+ * Unique tiles  : %u\n\
+ * Total tiles   : %u\n\
+ * Size (tiles)  : %ux%u\n\
+ * Size (pixels) : %ux%u\n\
+ * Bank          : %u\n\
+%s *\n\
+ * The data is in %s.2bpp (tiles) and %s.tilemap (map). Include both in one .c\n\
+ * file of your project (in the right bank), for example:\n\
+ *\n\
+ *     INCBIN(BackgroundData%s, \"%s.2bpp\")\n\
+ *     INCBIN(BackgroundMap%s, \"%s.tilemap\")\n\
+ */\n\
+\n\
+#pragma once\n\
+\n\
+#include <gbdk/incbin.h>\n\
+\n\
+// CONSTANTS ///////////////////////////////////////////////////////////////////\n\
+\n\
+#define GAME_BACKGROUNDS_%s_TILES %uU /**< How many unique tiles this background has. */\n\
+#define GAME_BACKGROUNDS_%s_TILE_BASE %uU /**< First VRAM tile slot the tiles must be loaded at (the map already counts from it). */\n\
+\n\
+#define GAME_BACKGROUNDS_%s_SIZE_X %uU /**< Width of this background, in 8x8 tiles. */\n\
+#define GAME_BACKGROUNDS_%s_SIZE_Y %uU /**< Height of this background, in 8x8 tiles. */\n\
+\n\
+%s#define GAME_BACKGROUNDS_%s_DATA_SIZE %uU /**< Size of %s.2bpp, in bytes. */\n\
+#define GAME_BACKGROUNDS_%s_MAP_ENTRY_SIZE %uU /**< Size of each tilemap entry, in bytes (2 means little-endian 16-bit). */\n\
+#define GAME_BACKGROUNDS_%s_MAP_SIZE %uU /**< Size of %s.tilemap, in bytes. */\n\
+\n\
+/** %s (data), exported by Image2GB for use with GBDK-2020.\n\
+ */\n\
+INCBIN_EXTERN(BackgroundData%s)\n\
+\n\
+/** %s (map), exported by Image2GB for use with GBDK-2020.\n\
+ */\n\
+INCBIN_EXTERN(BackgroundMap%s)\n"
+
+/** String that stores the details of the compression of an asset, to be
+ *  inserted in the comment at the top of the .h header (it is only there if
+ *  the asset is compressed), filled with format specifiers, ready to get sent
+ *  to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_COMPRESSION_INFO " * Compression   : %s, %u bytes of %u (%u%%)\n\
+ * Decoding      : ~%" G_GUINT64_FORMAT " CPU cycles into VRAM (%.2f frames)\n"
+
+/** String that stores the premade constants of a compressed asset, to be
+ *  inserted in the .h header, filled with format specifiers, ready to get sent
+ *  to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_COMPRESSION "#define GAME_BACKGROUNDS_%s_COMPRESSION %uU /**< How the data and the map are compressed (1 = RLE, 2 = LZ), for image2gb_decompress.h. */\n\
+#define GAME_BACKGROUNDS_%s_DATA_PACKED_SIZE %uU /**< Size of the compressed tile data, in bytes. */\n\
+#define GAME_BACKGROUNDS_%s_MAP_PACKED_SIZE %uU /**< Size of the compressed map, in bytes. */\n\
+#define GAME_BACKGROUNDS_%s_DECODE_CYCLES %" G_GUINT64_FORMAT "UL /**< Estimated CPU cycles to decompress both into VRAM (a frame has 70224). */\n\
+\n"
+
+/** String that stores a premade build-time check that the tiles of an asset
+ *  fit in VRAM from its tile base, to be inserted in the .h header (it is only
+ *  there if the tile base is not 0), filled with format specifiers, ready to
+ *  get sent to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_FIT_CHECK "#if (GAME_BACKGROUNDS_%s_TILE_BASE + GAME_BACKGROUNDS_%s_TILES) > %uU\n\
+#error \"%s: its tiles do not fit in VRAM from its tile base, export it again with a lower one.\"\n\
+#endif\n\
+\n"
+
+/** String that stores the premade constants of an asset with an upload table,
+ *  to be inserted in the .h header, filled with format specifiers, ready to
+ *  get sent to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_UPLOADS "#define GAME_BACKGROUNDS_%s_UPLOAD_CHUNKS %uU /**< Chunks of tile data in the upload table, one per frame (for image2gb_upload.h). */\n\
+#define GAME_BACKGROUNDS_%s_UPLOAD_CHUNK_TILES %uU /**< Most tiles a chunk copies to VRAM (%u bytes a frame at most). */\n\
+\n"
+
+/** String that stores the premade constants of an asset whose map is not laid
+ *  out row by row, to be inserted in the .h header, filled with format
+ *  specifiers, ready to get sent to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_MAP_LAYOUT "#define GAME_BACKGROUNDS_%s_MAP_LAYOUT %uU /**< Order of the map entries (%s): 1 = column by column, 2 = rows padded with tile 0 to the background map in VRAM. */\n\
+#define GAME_BACKGROUNDS_%s_MAP_PITCH %uU /**< Entries from the start of a %s of the map to the next one. */\n\
+\n"
+
+/** String that stores the premade declaration of the upload table of an asset,
+ *  to be inserted in the .h header (C source format), filled with format
+ *  specifiers, ready to get sent to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_UPLOADS_EXTERN "/** %s (upload table), exported by Image2GB for use with GBDK-2020. Every chunk\n\
+ *  of the tile data has 4 bytes: its offset (low byte first), its first VRAM\n\
+ *  tile and its number of tiles.\n\
+ */\n\
+extern const unsigned char BackgroundUploads%s[];\n\
+\n"
+
+/** String that stores the premade upload table of an asset, to be inserted in
+ *  the .h header (binary format, it has no .c source), filled with format
+ *  specifiers, ready to get sent to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_UPLOADS_TABLE "/** %s (upload table), exported by Image2GB for use with GBDK-2020. Every chunk\n\
+ *  of the tile data has 4 bytes: its offset (low byte first), its first VRAM\n\
+ *  tile and its number of tiles. Define it in one .c file of your project:\n\
+ *\n\
+ *     const unsigned char BackgroundUploads%s[] = GAME_BACKGROUNDS_%s_UPLOAD_TABLE;\n\
+ */\n\
+#define GAME_BACKGROUNDS_%s_UPLOAD_TABLE \\\n\
+{ \\\n\
+%s \\\n\
+}\n\
+\n"
+
+/** String that stores the premade upload table of an asset, to be appended to
+ *  the .c source (after the map), filled with format specifiers, ready to get
+ *  sent to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_C_UPLOADS "\n\
+\n\
+const unsigned char BackgroundUploads%s[] =\n\
+{\n\
+%s\n\
+};"
+
+/** String that stores a premade .h header of a GBDK-2020 animation asset,
+ *  filled with format specifiers, ready to get sent to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_H_ANIMATION "/**\n\
+ * @file  %s.h\n\
+ * @brief %s, animation exported by Image2GB for use with GBDK-2020 - header.\n\
+ *\n\
+ * Frames        : %u\n\
+ * Unique tiles  : %u (all frames)\n\
+ * Size (tiles)  : %ux%u\n\
+ * Size (pixels) : %ux%u\n\
+ * Bank          : %u\n\
+ * Changes       : %u tiles and %u map cells after the first frame (%u cells redrawing every frame)\n\
+ */\n\
+\n\
+#pragma once\n\
+\n\
+%s#include <gb/gb.h>\n\
+\n\
+%sBANKREF_EXTERN(GAME_BACKGROUNDS_%s)\n\
+\n\
+// CONSTANTS ///////////////////////////////////////////////////////////////////\n\
+\n\
+#define GAME_BACKGROUNDS_%s_TILES %uU /**< How many unique tiles this background has, in all frames. */\n\
+#define GAME_BACKGROUNDS_%s_TILE_BASE %uU /**< First VRAM tile slot the tiles must be loaded at (the map already counts from it). */\n\
+\n\
+#define GAME_BACKGROUNDS_%s_SIZE_X %uU /**< Width of this background, in 8x8 tiles. */\n\
+#define GAME_BACKGROUNDS_%s_SIZE_Y %uU /**< Height of this background, in 8x8 tiles. */\n\
+\n\
+#define GAME_BACKGROUNDS_%s_FRAMES %uU /**< Frames of the animation (for image2gb_animation.h). */\n\
+#define GAME_BACKGROUNDS_%s_FRAME_TILES_MAX %uU /**< Most tiles a frame loads, after the first one. */\n\
+#define GAME_BACKGROUNDS_%s_FRAME_CELLS_MAX %uU /**< Most map cells a frame changes. */\n\
+\n\
+/** %s (data, the tiles of all frames in order of appearance), exported by Image2GB for use with GBDK-2020.\n\
+ */\n\
+extern const unsigned char BackgroundData%s[];\n\
+\n\
+/** %s (map of the first frame), exported by Image2GB for use with GBDK-2020.\n\
+ */\n\
+extern const unsigned char BackgroundMap%s[];\n\
+\n\
+/** %s (frames, 5 bytes each: first new tile, number of new tiles and number\n\
+ *  of changed map cells, both low byte first), exported by Image2GB for use\n\
+ *  with GBDK-2020.\n\
+ */\n\
+extern const unsigned char AnimationFrames%s[];\n\
+\n\
+/** %s (changed map cells of every frame, 3 bytes each: column, row and tile;\n\
+ *  the ones of the first frame are for looping back to it), exported by\n\
+ *  Image2GB for use with GBDK-2020.\n\
+ */\n\
+extern const unsigned char AnimationDeltas%s[];\n"
+
+/** String that stores the premade frame table and changed map cells of an
+ *  animation asset, to be appended to the .c source (after the map), filled
+ *  with format specifiers, ready to get sent to printf.
+ */
+#define IMAGE2GB_SOURCE_STRING_C_ANIMATION "\n\
+\n\
+const unsigned char AnimationFrames%s[] =\n\
+{\n\
+%s\n\
+};\n\
+\n\
+const unsigned char AnimationDeltas%s[] =\n\
+{\n\
+%s\n\
+};"
+
 #endif // IMAGE2GB_SOURCE_STRINGS_H_INCLUDED